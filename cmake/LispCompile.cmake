@@ -0,0 +1,27 @@
+##
+## Copyright Troy D. Straszheim 2009
+##
+## Distributed under the Boost Software License, Version 1.0
+## See http://www.boost.org/LICENSE_1.0.txt
+##
+
+#
+#  lisp_add_executable(name file.lisp)
+#
+#  Translate file.lisp to C++ with lisp --compile-to-cpp and build it
+#  into the executable name, linked against the interpreter runtime.
+#
+function(lisp_add_executable name source)
+  get_filename_component(source_path ${source} ABSOLUTE)
+  set(cpp ${CMAKE_CURRENT_BINARY_DIR}/${name}.cpp)
+
+  add_custom_command(OUTPUT ${cpp}
+    COMMAND lisp --compile-to-cpp ${source_path} -o ${cpp}
+    DEPENDS lisp ${source_path}
+    COMMENT "Compiling ${source} to C++"
+    )
+
+  include_directories(${CMAKE_SOURCE_DIR}/src ${CMAKE_BINARY_DIR})
+  add_executable(${name} ${cpp})
+  target_link_libraries(${name} lisprt ${Boost_LIBRARIES})
+endfunction()
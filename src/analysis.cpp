@@ -0,0 +1,141 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "context.hpp"
+#include "dispatch.hpp"
+#include "analysis.hpp"
+#include "inline.hpp"
+#include "closure.hpp"
+#include "escape.hpp"
+#include "tail.hpp"
+#include "numeric.hpp"
+
+#include <boost/weak_ptr.hpp>
+
+#include <map>
+#include <vector>
+
+using boost::get;
+
+namespace lisp {
+
+  namespace {
+
+    typedef std::vector<boost::weak_ptr<procedure> > dependents_t;
+
+    // name -> procedures whose code is only right while name is unchanged
+    std::map<std::string, dependents_t> dependents;
+
+    void invalidate(const std::string& name, std::set<std::string>& done)
+    {
+      if (!done.insert(name).second)
+	return;
+
+      std::map<std::string, dependents_t>::iterator it = dependents.find(name);
+      if (it == dependents.end())
+	return;
+
+      dependents_t procs;
+      procs.swap(it->second);
+      dependents.erase(it);
+
+      for (unsigned u = 0; u < procs.size(); u++)
+	if (procedure_ptr proc = procs[u].lock())
+	  {
+	    analyze(proc);
+	    if (!proc->name.empty())
+	      invalidate(proc->name, done);
+	  }
+    }
+  }
+
+  void depends(const procedure_ptr& proc, const std::string& name)
+  {
+    if (name == proc->name)
+      return;
+    dependents_t& procs = dependents[name];
+    for (unsigned u = 0; u < procs.size(); u++)
+      if (procs[u].lock() == proc)
+	return;
+    procs.push_back(proc);
+  }
+
+  void invalidate(const std::string& name)
+  {
+    std::set<std::string> done;
+    invalidate(name, done);
+  }
+
+  void analyze(const procedure_ptr& proc)
+  {
+    proc->set_code(proc->source);
+    proc->inlined.clear();
+    inline_calls(proc);
+    closure_conversion(proc);
+    escape_analysis(proc);
+    tail_calls(proc);
+    numeric_analysis(proc);
+  }
+
+  void setf_targets(const variant& v, std::set<std::string>& targets)
+  {
+    const cons_ptr* p = get<cons_ptr>(&v);
+    if (!p || !*p)
+      return;
+    const std::string* name = form_name(*p);
+    if (name && *name == "setf")
+      if (const cons_ptr* rest = get<cons_ptr>(&(*p)->cdr))
+	if (*rest)
+	  if (const symbol* s = get<symbol>(&(*rest)->car))
+	    targets.insert(*s);
+    setf_targets((*p)->car, targets);
+    setf_targets((*p)->cdr, targets);
+  }
+
+  void symbols(const variant& v, std::set<std::string>& syms)
+  {
+    if (const symbol* s = get<symbol>(&v))
+      syms.insert(*s);
+    else if (const special<backquoted_>* s = get<special<backquoted_> >(&v))
+      symbols(s->v, syms);
+    else if (const special<comma_>* s = get<special<comma_> >(&v))
+      symbols(s->v, syms);
+    else if (const special<comma_at_>* s = get<special<comma_at_> >(&v))
+      symbols(s->v, syms);
+    else if (const array_ptr* a = get<array_ptr>(&v))
+      for (unsigned u = 0; u < (*a)->items.size(); u++)
+	symbols((*a)->items[u], syms);
+    else if (const cons_ptr* p = get<cons_ptr>(&v))
+      {
+	if (!*p)
+	  return;
+	const std::string* name = form_name(*p);
+	if (name && *name == "declare")
+	  return;
+	symbols((*p)->car, syms);
+	symbols((*p)->cdr, syms);
+      }
+  }
+
+  bool names_macro(context& ctx, const std::string& name)
+  {
+    try {
+      return is_macro(ctx.get<variant>(name));
+    } catch (const std::exception&) {
+      return false;
+    }
+  }
+
+  variant embed(const function& f, const char* name)
+  {
+    function named(f);
+    named.name = name;
+    return named;
+  }
+}
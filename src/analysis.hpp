@@ -0,0 +1,50 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_ANALYSIS_HPP_INCLUDED
+#define LISP_ANALYSIS_HPP_INCLUDED
+
+#include "dispatch.hpp"
+
+#include <set>
+#include <string>
+
+namespace lisp {
+
+  // source -> code: run the analysis passes over proc
+  void analyze(const procedure_ptr& proc);
+
+  // proc's code assumes name keeps its current meaning
+  void depends(const procedure_ptr& proc, const std::string& name);
+
+  //
+  //  name has just been rebound: analyze everything that depended on
+  //  the old binding again, and whatever depended on those.
+  //
+  void invalidate(const std::string& name);
+
+  //
+  //  bits and pieces the passes have in common
+  //
+
+  // symbols a setf in v might create or clobber
+  void setf_targets(const variant& v, std::set<std::string>& targets);
+
+  // every symbol v refers to, quoted data and declarations excluded
+  void symbols(const variant& v, std::set<std::string>& syms);
+
+  // true if name, looked up from ctx, is a macro
+  bool names_macro(context& ctx, const std::string& name);
+
+  //
+  //  f, named so form_name() recognizes it, ready to be put in the
+  //  operator position of a form in place of a symbol
+  //
+  variant embed(const function& f, const char* name);
+}
+
+#endif
@@ -29,7 +29,7 @@ namespace lisp
     return d;
   }
     
-  variant backquote_visitor::operator()(const std::string& s)
+  variant backquote_visitor::operator()(const string_ptr& s)
   {
     SHOW;
     return s;
@@ -92,5 +92,59 @@ namespace lisp
     return eval(ctx, s.v);
   }
 
+  //
+  //  `#(a ,b ,@c): as the list would be, made back into a vector
+  //
+  variant backquote_visitor::operator()(const array_ptr& a)
+  {
+    variant l = nil;
+    for (unsigned u = a->items.size(); u > 0; u--)
+      l = cons_ptr(new cons(a->items[u-1], l));
+    array_ptr result(new array);
+    for (variant r = visit(l); !is_nil(r); r = r >> cdr)
+      result->items.push_back(r >> car);
+    return result;
+  }
+
+  variant backquote_visitor::operator()(const hash_table_ptr& h)
+  {
+    return h;
+  }
+
+  variant backquote_visitor::operator()(const f64vector_ptr& f)
+  {
+    return f;
+  }
+
+  variant backquote_visitor::operator()(const structure_ptr& s)
+  {
+    return s;
+  }
+
+  variant backquote_visitor::operator()(const pmap_ptr& m)
+  {
+    return m;
+  }
+
+  variant backquote_visitor::operator()(const pvector_ptr& p)
+  {
+    return p;
+  }
+
+  variant backquote_visitor::operator()(const bitvector_ptr& b)
+  {
+    return b;
+  }
+
+  variant backquote_visitor::operator()(const table_ptr& t)
+  {
+    return t;
+  }
+
+  variant backquote_visitor::operator()(const lazy_seq_ptr& l)
+  {
+    return l;
+  }
+
 
 }
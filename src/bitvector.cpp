@@ -0,0 +1,438 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "bitvector.hpp"
+#include "kernels.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+using boost::get;
+
+namespace lisp {
+
+  void intrusive_ptr_add_ref(bitvector* v)
+  {
+    v->count++;
+  }
+
+  void intrusive_ptr_release(bitvector* v)
+  {
+    v->count--;
+    if (v->count == 0)
+      delete v;
+  }
+
+  bitvector::bitvector(const std::string& bits)
+    : count(0), size(bits.size()), words((bits.size() + word_bits - 1) / word_bits)
+  {
+    for (std::size_t i = 0; i < size; i++)
+      if (bits[i] == '1')
+	set(i, true);
+  }
+
+  std::string bitvector::str() const
+  {
+    std::string s(size, '0');
+    for (std::size_t i = 0; i < size; i++)
+      if (get(i))
+	s[i] = '1';
+    return s;
+  }
+
+  namespace {
+
+    typedef bitvector::word word;
+
+    //
+    //  The loops over whole words, a set for each instruction set we
+    //  know; kernels.hpp picks one.
+    //
+    struct kernel_set
+    {
+      const char* name;
+      void (*and_)(const word* a, const word* b, word* out, std::size_t n);
+      void (*or_)(const word* a, const word* b, word* out, std::size_t n);
+      void (*xor_)(const word* a, const word* b, word* out, std::size_t n);
+      void (*not_)(const word* a, word* out, std::size_t n);
+      std::size_t (*popcount)(const word* a, std::size_t n);
+      bool (*supported)();
+    };
+
+    unsigned popcount_word(word x)
+    {
+      x = x - ((x >> 1) & 0x5555555555555555ULL);
+      x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+      x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+      return (x * 0x0101010101010101ULL) >> 56;
+    }
+
+    // index of the lowest set bit in x, which isn't 0
+    unsigned lowest_bit(word x)
+    {
+#ifdef __GNUC__
+      return __builtin_ctzll(x);
+#else
+      unsigned i = 0;
+      while (!(x & 1))
+	{
+	  x >>= 1;
+	  i++;
+	}
+      return i;
+#endif
+    }
+
+    void and_scalar(const word* a, const word* b, word* out, std::size_t n)
+    {
+      for (std::size_t i = 0; i < n; i++)
+	out[i] = a[i] & b[i];
+    }
+
+    void or_scalar(const word* a, const word* b, word* out, std::size_t n)
+    {
+      for (std::size_t i = 0; i < n; i++)
+	out[i] = a[i] | b[i];
+    }
+
+    void xor_scalar(const word* a, const word* b, word* out, std::size_t n)
+    {
+      for (std::size_t i = 0; i < n; i++)
+	out[i] = a[i] ^ b[i];
+    }
+
+    void not_scalar(const word* a, word* out, std::size_t n)
+    {
+      for (std::size_t i = 0; i < n; i++)
+	out[i] = ~a[i];
+    }
+
+    std::size_t popcount_scalar(const word* a, std::size_t n)
+    {
+      std::size_t c = 0;
+      for (std::size_t i = 0; i < n; i++)
+	c += popcount_word(a[i]);
+      return c;
+    }
+
+    const kernel_set scalar_kernels =
+      { "scalar", and_scalar, or_scalar, xor_scalar, not_scalar,
+	popcount_scalar, always };
+
+#ifdef USE_SIMD
+
+    //
+    //  SSE2: two words at a time.  Counting stays a word at a time.
+    //
+#define SSE2_BINARY(name, op, scalar_op)				\
+    TARGET("sse2") void name(const word* a, const word* b, word* out,	\
+			     std::size_t n)				\
+    {									\
+      std::size_t i = 0;						\
+      for (; i + 2 <= n; i += 2)					\
+	_mm_storeu_si128((__m128i*)(out + i),				\
+			 op(_mm_loadu_si128((const __m128i*)(a + i)),	\
+			    _mm_loadu_si128((const __m128i*)(b + i))));	\
+      for (; i < n; i++)						\
+	out[i] = a[i] scalar_op b[i];					\
+    }
+
+    SSE2_BINARY(and_sse2, _mm_and_si128, &)
+    SSE2_BINARY(or_sse2, _mm_or_si128, |)
+    SSE2_BINARY(xor_sse2, _mm_xor_si128, ^)
+
+#undef SSE2_BINARY
+
+    TARGET("sse2") void not_sse2(const word* a, word* out, std::size_t n)
+    {
+      __m128i ones = _mm_set1_epi32(-1);
+      std::size_t i = 0;
+      for (; i + 2 <= n; i += 2)
+	_mm_storeu_si128((__m128i*)(out + i),
+			 _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i)), ones));
+      for (; i < n; i++)
+	out[i] = ~a[i];
+    }
+
+    bool has_sse2() { return __builtin_cpu_supports("sse2"); }
+
+    const kernel_set sse2_kernels =
+      { "sse2", and_sse2, or_sse2, xor_sse2, not_sse2, popcount_scalar, has_sse2 };
+
+    //
+    //  AVX2: four words at a time.  Counting looks each half byte up
+    //  in a table of counts with a shuffle, and adds the bytes up with
+    //  a sum of absolute differences against zero; what is left over
+    //  goes to the popcnt instruction.
+    //
+#define AVX2_BINARY(name, op, scalar_op)				\
+    TARGET("avx2") void name(const word* a, const word* b, word* out,	\
+			     std::size_t n)				\
+    {									\
+      std::size_t i = 0;						\
+      for (; i + 4 <= n; i += 4)					\
+	_mm256_storeu_si256((__m256i*)(out + i),			\
+			    op(_mm256_loadu_si256((const __m256i*)(a + i)), \
+			       _mm256_loadu_si256((const __m256i*)(b + i)))); \
+      for (; i < n; i++)						\
+	out[i] = a[i] scalar_op b[i];					\
+    }
+
+    AVX2_BINARY(and_avx2, _mm256_and_si256, &)
+    AVX2_BINARY(or_avx2, _mm256_or_si256, |)
+    AVX2_BINARY(xor_avx2, _mm256_xor_si256, ^)
+
+#undef AVX2_BINARY
+
+    TARGET("avx2") void not_avx2(const word* a, word* out, std::size_t n)
+    {
+      __m256i ones = _mm256_set1_epi32(-1);
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4)
+	_mm256_storeu_si256((__m256i*)(out + i),
+			    _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)),
+					     ones));
+      for (; i < n; i++)
+	out[i] = ~a[i];
+    }
+
+    TARGET("avx2,popcnt") std::size_t popcount_avx2(const word* a, std::size_t n)
+    {
+      const __m256i counts = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+					      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+      const __m256i low = _mm256_set1_epi8(0x0f);
+      __m256i total = _mm256_setzero_si256();
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4)
+	{
+	  __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+	  __m256i c = _mm256_add_epi8(_mm256_shuffle_epi8(counts, _mm256_and_si256(x, low)),
+				      _mm256_shuffle_epi8(counts,
+							  _mm256_and_si256(_mm256_srli_epi16(x, 4),
+									   low)));
+	  total = _mm256_add_epi64(total, _mm256_sad_epu8(c, _mm256_setzero_si256()));
+	}
+      word lanes[4];
+      _mm256_storeu_si256((__m256i*)lanes, total);
+      std::size_t c = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+      for (; i < n; i++)
+	c += __builtin_popcountll(a[i]);
+      return c;
+    }
+
+    bool has_avx2()
+    {
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    }
+
+    const kernel_set avx2_kernels =
+      { "avx2", and_avx2, or_avx2, xor_avx2, not_avx2, popcount_avx2, has_avx2 };
+
+#endif
+
+    // widest first
+    const kernel_set* const all_kernels[] =
+      {
+#ifdef USE_SIMD
+	&avx2_kernels, &sse2_kernels,
+#endif
+	&scalar_kernels, 0
+      };
+
+    kernel_choice<kernel_set> kernels(all_kernels);
+
+    bitvector_ptr as_bitvector(const variant& v, const char* fn)
+    {
+      const bitvector_ptr* p = get<bitvector_ptr>(&v);
+      if (!p)
+	throw std::runtime_error(std::string(fn) + ": not a bit vector");
+      return *p;
+    }
+
+    bool as_bit(const variant& v, const char* fn)
+    {
+      const double* d = get<double>(&v);
+      if (!d || (*d != 0 && *d != 1))
+	throw std::runtime_error(std::string(fn) + ": a bit is 0 or 1");
+      return *d == 1;
+    }
+
+    typedef void (*binary_kernel)(const word*, const word*, word*, std::size_t);
+
+    variant binary(context_ptr& c, variant v, const char* fn, binary_kernel k)
+    {
+      bitvector_ptr a = as_bitvector(eval(c, v >> car), fn);
+      bitvector_ptr b = as_bitvector(eval(c, v >> cdr >> car), fn);
+      if (a->size != b->size)
+	throw std::runtime_error(std::string(fn) + ": lengths differ");
+      bitvector_ptr r(new bitvector(a->size));
+      k(data(a->words), data(b->words), data(r->words), a->words.size());
+      return r;
+    }
+
+    // the set bit at or after start, or size if there is none
+    std::size_t next_set(const bitvector& v, std::size_t start)
+    {
+      if (start >= v.size)
+	return v.size;
+      std::size_t w = start / bitvector::word_bits;
+      word x = v.words[w] & (~word(0) << (start % bitvector::word_bits));
+      for (;;)
+	{
+	  if (x)
+	    return w * bitvector::word_bits + lowest_bit(x);
+	  if (++w == v.words.size())
+	    return v.size;
+	  x = v.words[w];
+	}
+    }
+  }
+
+  void set_bit_place(const variant& v, const variant& index, const variant& value)
+  {
+    bitvector_ptr b = as_bitvector(v, "sbit");
+    b->set(as_index(index, b->size, "sbit"), as_bit(value, "sbit"));
+  }
+
+  namespace ops {
+
+    //
+    //  (make-bit-vector n [bit])
+    //
+    variant make_bit_vector::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant n = eval(c, v >> car);
+      const double* d = get<double>(&n);
+      if (!d || *d < 0 || *d != std::floor(*d))
+	throw std::runtime_error("make-bit-vector: bad size");
+      bitvector_ptr r(new bitvector(std::size_t(*d)));
+      if (!is_nil(v >> cdr) && as_bit(eval(c, v >> cdr >> car), "make-bit-vector"))
+	for (std::size_t i = 0; i < r->size; i++)
+	  r->set(i, true);
+      return r;
+    }
+
+    variant sbit::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      bitvector_ptr b = as_bitvector(eval(c, v >> car), "sbit");
+      return double(b->get(as_index(eval(c, v >> cdr >> car), b->size, "sbit")));
+    }
+
+    variant bit_and::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      return binary(c, v, "bit-and", kernels->and_);
+    }
+
+    variant bit_or::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      return binary(c, v, "bit-or", kernels->or_);
+    }
+
+    variant bit_xor::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      return binary(c, v, "bit-xor", kernels->xor_);
+    }
+
+    variant bit_not::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      bitvector_ptr a = as_bitvector(eval(c, v >> car), "bit-not");
+      bitvector_ptr r(new bitvector(a->size));
+      kernels->not_(data(a->words), data(r->words), a->words.size());
+      // keep the bits past the end zero
+      if (std::size_t extra = a->size % bitvector::word_bits)
+	r->words.back() &= (word(1) << extra) - 1;
+      return r;
+    }
+
+    variant popcount::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      bitvector_ptr a = as_bitvector(eval(c, v >> car), "popcount");
+      return double(kernels->popcount(data(a->words), a->words.size()));
+    }
+
+    //
+    //  (find-first-set v [start]): index of the first 1 at or after
+    //  start, or nil
+    //
+    variant find_first_set::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      bitvector_ptr a = as_bitvector(eval(c, v >> car), "find-first-set");
+      std::size_t start = 0;
+      if (!is_nil(v >> cdr))
+	{
+	  variant s = eval(c, v >> cdr >> car);
+	  const double* d = get<double>(&s);
+	  if (!d || *d < 0 || *d != std::floor(*d))
+	    throw std::runtime_error("find-first-set: bad start");
+	  start = *d < a->size ? std::size_t(*d) : a->size;
+	}
+      std::size_t i = next_set(*a, start);
+      return i == a->size ? nil : variant(double(i));
+    }
+
+    //
+    //  (map-set-bits f v): (f i) for the index of each 1, in order
+    //
+    variant map_set_bits::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      function f = get<function>(eval(c, v >> car));
+      bitvector_ptr a = as_bitvector(eval(c, v >> cdr >> car), "map-set-bits");
+      for (std::size_t i = next_set(*a, 0); i < a->size; i = next_set(*a, i + 1))
+	{
+	  variant args = cons_ptr(new lisp::cons(special<quoted_>(double(i))));
+	  f(c, args);
+	}
+      return nil;
+    }
+
+    // (bit-positions v): the indices of the 1s, as a list
+    variant bit_positions::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      bitvector_ptr a = as_bitvector(eval(c, v >> car), "bit-positions");
+      variant result = nil;
+      cons_ptr last;
+      for (std::size_t i = next_set(*a, 0); i < a->size; i = next_set(*a, i + 1))
+	{
+	  cons_ptr cell(new lisp::cons(double(i)));
+	  if (last)
+	    last->cdr = cell;
+	  else
+	    result = cell;
+	  last = cell;
+	}
+      return result;
+    }
+
+    //
+    //  (bit-kernels) names the loops the bit- builtins run;
+    //  (bit-kernels 'scalar), 'sse2 or 'avx2 switches to others
+    //
+    variant bit_kernels::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      if (!is_nil(v))
+	kernels.use(eval(c, v >> car), "bit-kernels");
+      return symbol(kernels->name);
+    }
+  }
+}
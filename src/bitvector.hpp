@@ -0,0 +1,64 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_BITVECTOR_HPP_INCLUDED
+#define LISP_BITVECTOR_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace lisp {
+
+  //
+  //  #*0101: bits packed 64 to a word, bit i in word i / 64.  The
+  //  bits past size in the last word are always zero, so whole words
+  //  can be compared and counted.
+  //
+  struct bitvector : boost::noncopyable
+  {
+    typedef boost::uint64_t word;
+    enum { word_bits = 64 };
+
+    unsigned count;
+    std::size_t size;
+    std::vector<word> words;
+
+    bitvector(std::size_t n)
+      : count(0), size(n), words((n + word_bits - 1) / word_bits)
+    { }
+
+    // from a string of 0s and 1s
+    bitvector(const std::string& bits);
+
+    bool get(std::size_t i) const
+    {
+      return (words[i / word_bits] >> (i % word_bits)) & 1;
+    }
+
+    void set(std::size_t i, bool b)
+    {
+      word bit = word(1) << (i % word_bits);
+      if (b)
+	words[i / word_bits] |= bit;
+      else
+	words[i / word_bits] &= ~bit;
+    }
+
+    // 0s and 1s, as #* reads them
+    std::string str() const;
+  };
+
+  // the bit (sbit v index) refers to, for setf
+  void set_bit_place(const variant& v, const variant& index, const variant& value);
+}
+
+#endif
@@ -0,0 +1,90 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_CALLBACK_HPP_INCLUDED
+#define LISP_CALLBACK_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace lisp {
+
+  //
+  //  Calls a function on values already evaluated, as mapcar and the
+  //  rest do once for each element.  The argument list is made once
+  //  and filled in again for each call, unless the function kept hold
+  //  of it, when a new one is made for the next call.
+  //
+  class callback
+  {
+  public:
+    callback(const variant& f, unsigned nargs, const char* fn)
+      : cells_(nargs)
+    {
+      const function* p = boost::get<function>(&f);
+      if (!p)
+	throw std::runtime_error(std::string(fn) + ": not a function");
+      f_ = *p;
+      make_args();
+    }
+
+    const function& f() const { return f_; }
+
+    void set(unsigned u, const variant& v)
+    {
+      boost::get<special<quoted_> >(cells_[u]->car).v = v;
+    }
+
+    variant call(context_ptr& c)
+    {
+      variant r;
+      {
+	variant args = cells_.empty() ? nil : variant(cells_[0]);
+	r = f_(c, args);
+      }
+      for (unsigned u = 0; u < cells_.size(); u++)
+	if (cells_[u]->count != (u == 0 ? 1 : 2))
+	  {
+	    make_args();
+	    break;
+	  }
+      return r;
+    }
+
+    variant operator()(context_ptr& c, const variant& a)
+    {
+      set(0, a);
+      return call(c);
+    }
+
+    variant operator()(context_ptr& c, const variant& a, const variant& b)
+    {
+      set(0, a);
+      set(1, b);
+      return call(c);
+    }
+
+  private:
+    function f_;
+    std::vector<cons_ptr> cells_;
+
+    void make_args()
+    {
+      variant rest = nil;
+      for (unsigned u = cells_.size(); u > 0; u--)
+	{
+	  cells_[u-1] = new cons(special<quoted_>(nil), rest);
+	  rest = cells_[u-1];
+	}
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,203 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "context.hpp"
+#include "ops.hpp"
+#include "dispatch.hpp"
+#include "analysis.hpp"
+#include "closure.hpp"
+#include "escape.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+using boost::get;
+
+namespace lisp {
+
+  namespace {
+
+    // eval, nested definitions and macros can reach any variable
+    bool opaque(const variant& v, context& ctx)
+    {
+      if (const special<backquoted_>* s = get<special<backquoted_> >(&v))
+	return opaque(s->v, ctx);
+      if (const special<comma_>* s = get<special<comma_> >(&v))
+	return opaque(s->v, ctx);
+      if (const special<comma_at_>* s = get<special<comma_at_> >(&v))
+	return opaque(s->v, ctx);
+      if (const array_ptr* a = get<array_ptr>(&v))
+	{
+	  for (unsigned u = 0; u < (*a)->items.size(); u++)
+	    if (opaque((*a)->items[u], ctx))
+	      return true;
+	  return false;
+	}
+
+      const cons_ptr* p = get<cons_ptr>(&v);
+      if (!p || !*p)
+	return false;
+      if (const std::string* name = form_name(*p))
+	{
+	  if (*name == "quote")
+	    return false;
+	  if (*name == "eval" || *name == "defun" || *name == "defmacro"
+	      || names_macro(ctx, *name))
+	    return true;
+	}
+      return opaque((*p)->car, ctx) || opaque((*p)->cdr, ctx);
+    }
+
+    // names that let and lambda forms in v bind
+    void bound_names(const variant& v, std::set<std::string>& names)
+    {
+      const cons_ptr* p = get<cons_ptr>(&v);
+      if (!p || !*p)
+	return;
+      const std::string* name = form_name(*p);
+      const cons_ptr* rest = get<cons_ptr>(&(*p)->cdr);
+      if (name && rest && *rest && (*name == "let" || *name == "lambda"))
+	for (const cons_ptr* l = get<cons_ptr>(&(*rest)->car); l && *l; l = get<cons_ptr>(&(*l)->cdr))
+	  {
+	    const variant& b = (*l)->car;
+	    if (const symbol* s = get<symbol>(&b))
+	      names.insert(*s);
+	    else if (const cons_ptr* pair = get<cons_ptr>(&b))
+	      if (*pair)
+		if (const symbol* s = get<symbol>(&(*pair)->car))
+		  names.insert(*s);
+	  }
+      bound_names((*p)->car, names);
+      bound_names((*p)->cdr, names);
+    }
+
+    variant closure_maker(const closure_info_ptr& info)
+    {
+      ops::closure c;
+      c.info = info;
+      return embed(function(c), "lambda");
+    }
+
+    struct converter
+    {
+      context& ctx;
+      const std::set<std::string>& stable;
+
+      converter(context& _ctx, const std::set<std::string>& _stable)
+	: ctx(_ctx), stable(_stable)
+      { }
+
+      variant convert_list(const variant& v)
+      {
+	const cons_ptr* p = get<cons_ptr>(&v);
+	if (!p || !*p)
+	  return v;
+	return cons_ptr(new cons(convert((*p)->car), convert_list((*p)->cdr)));
+      }
+
+      variant convert(const variant& v)
+      {
+	const cons_ptr* pp = get<cons_ptr>(&v);
+	if (!pp || !*pp)
+	  return v;
+	const cons_ptr& p = *pp;
+
+	const symbol* s = get<symbol>(&p->car);
+	if (s && (*s == "quote" || *s == "defun" || *s == "defmacro" || names_macro(ctx, *s)))
+	  return v;
+
+	if (s && *s == "lambda" && !is_nil(p->cdr))
+	  {
+	    // inner lambdas first, so that this one knows they are flat
+	    cons_ptr rest = get<cons_ptr>(p->cdr);
+	    variant lambda = cons_ptr(new cons(rest->car, convert_list(rest->cdr)));
+	    closure_info_ptr info = analyze_closure(lambda, ctx, &stable);
+	    return cons_ptr(new cons(closure_maker(info), lambda));
+	  }
+
+	variant rest = convert_list(p->cdr);
+	return cons_ptr(new cons(s ? p->car : convert(p->car), rest));
+      }
+    };
+  }
+
+  closure_info_ptr analyze_closure(const variant& lambda, context& ctx,
+				   const std::set<std::string>* stable)
+  {
+    boost::shared_ptr<closure_info> info(new closure_info);
+
+    const cons_ptr& l = get<cons_ptr>(lambda);
+    for (const cons_ptr* a = get<cons_ptr>(&l->car); a && *a; a = get<cons_ptr>(&(*a)->cdr))
+      info->args.push_back(get<symbol>((*a)->car));
+
+    std::set<std::string> syms;
+    symbols(l->cdr, syms);
+    for (std::set<std::string>::const_iterator it = syms.begin(); it != syms.end(); it++)
+      if (std::find(info->args.begin(), info->args.end(), *it) == info->args.end())
+	{
+	  info->free.push_back(*it);
+	  info->shared.push_back(!stable || !stable->count(*it));
+	}
+
+    info->flat = !opaque(l->cdr, ctx);
+    info->stack_frame = !captures(l->cdr, ctx);
+    info->declared = declare_args(info->args, l->cdr);
+    return info;
+  }
+
+  context_ptr capture(context_ptr& c, const closure_info& info)
+  {
+    if (!info.flat)
+      return c->persistent();
+
+    context_ptr env = c->home().scope();
+    for (unsigned u = 0; u < info.free.size(); u++)
+      if (context::binding* b = c->frame_binding(info.free[u]))
+	{
+	  if (info.shared[u])
+	    env->put_box(info.free[u], b->boxed());
+	  else
+	    env->put(info.free[u], b->get());
+	}
+    return env;
+  }
+
+  void closure_conversion(const procedure_ptr& proc)
+  {
+    context& ctx = *proc->ctx;
+    try {
+      //
+      //  the names this procedure binds itself and never assigns; if
+      //  it does anything we can't see through, there aren't any
+      //
+      std::set<std::string> stable;
+      if (!opaque(proc->code, ctx))
+	{
+	  std::set<std::string> bound, assigned;
+	  bound.insert(proc->args.begin(), proc->args.end());
+	  bound_names(proc->code, bound);
+	  setf_targets(proc->code, assigned);
+	  std::set_difference(bound.begin(), bound.end(),
+			      assigned.begin(), assigned.end(),
+			      std::inserter(stable, stable.begin()));
+	}
+      converter c(ctx, stable);
+      proc->set_code(c.convert_list(proc->code));
+    } catch (const std::exception&) {
+      // malformed code: leave it for eval to complain about
+    }
+  }
+
+  bool flat_closure(const cons_ptr& form)
+  {
+    const function* f = get<function>(&form->car);
+    const ops::closure* c = f ? f->f.target<ops::closure>() : 0;
+    return c && c->info->flat;
+  }
+}
@@ -0,0 +1,57 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_CLOSURE_HPP_INCLUDED
+#define LISP_CLOSURE_HPP_INCLUDED
+
+#include "dispatch.hpp"
+#include "declare.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace lisp {
+
+  //
+  //  What a lambda needs from the scope it is made in.  A flat closure
+  //  copies just the variables it mentions out of the enclosing
+  //  frames; the ones that somebody may assign to are shared through a
+  //  box instead, so both sides see the update.
+  //
+  struct closure_info
+  {
+    std::vector<symbol> args;
+    std::vector<std::string> free;   // mentioned but not bound by the lambda
+    std::vector<bool> shared;        // box free[i] rather than copy it
+    bool flat;                       // no eval or macros: free is all it needs
+    bool stack_frame;                // its own frames can't be captured
+    declared_args_ptr declared;
+  };
+
+  typedef boost::shared_ptr<const closure_info> closure_info_ptr;
+
+  //
+  //  Look at lambda, a (args . body).  stable holds the names that the
+  //  code around the lambda binds and never assigns; those are copied.
+  //  0 means we haven't seen that code, and everything is shared.
+  //
+  closure_info_ptr analyze_closure(const variant& lambda, context& ctx,
+				   const std::set<std::string>* stable);
+
+  // the scope a closure described by info, made in c, keeps
+  context_ptr capture(context_ptr& c, const closure_info& info);
+
+  // turn the lambdas in proc's code into flat closure makers
+  void closure_conversion(const procedure_ptr& proc);
+
+  // true if form is a lambda that closure_conversion made flat
+  bool flat_closure(const cons_ptr& form);
+}
+
+#endif
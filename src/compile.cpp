@@ -0,0 +1,701 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "declare.hpp"
+#include "compile.hpp"
+#include "bitvector.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+using boost::get;
+using boost::lexical_cast;
+
+namespace lisp {
+
+  namespace {
+
+    // this defun stays with the interpreter
+    struct cant_compile { };
+
+    std::string literal(const std::string& s)
+    {
+      std::string r = "\"";
+      for (unsigned u = 0; u < s.size(); u++)
+	{
+	  unsigned char c = s[u];
+	  if (c == '"' || c == '\\')
+	    (r += '\\') += c;
+	  else if (c < ' ' || c > '~')
+	    {
+	      char buf[8];
+	      std::sprintf(buf, "\\%03o", c);
+	      r += buf;
+	    }
+	  else
+	    r += c;
+	}
+      return r + "\"";
+    }
+
+    std::string number(double d)
+    {
+      if (d != d)
+	return "std::numeric_limits<double>::quiet_NaN()";
+      if (std::fabs(d) > std::numeric_limits<double>::max())
+	return d > 0
+	  ? "std::numeric_limits<double>::infinity()"
+	  : "-std::numeric_limits<double>::infinity()";
+      char buf[32];
+      std::sprintf(buf, "%.17g", d);
+      return std::string("double(") + buf + ")";
+    }
+
+    std::vector<variant> elements(variant l)
+    {
+      std::vector<variant> v;
+      while (!is_nil(l))
+	{
+	  const cons_ptr* p = get<cons_ptr>(&l);
+	  if (!p)
+	    throw cant_compile();
+	  v.push_back((*p)->car);
+	  l = (*p)->cdr;
+	}
+      return v;
+    }
+
+    const symbol* head(const variant& form)
+    {
+      const cons_ptr* p = get<cons_ptr>(&form);
+      return p && *p ? get<symbol>(&(*p)->car) : 0;
+    }
+
+    bool is_declare(const variant& form)
+    {
+      const symbol* s = head(form);
+      return s && *s == "declare";
+    }
+
+    //
+    //  builtins that don't simply evaluate their arguments, or that
+    //  need to see the scope they're called from
+    //
+    bool special_form(const std::string& name)
+    {
+      static const char* const names[] =
+	{ "defun", "defvar", "defmacro", "lambda", "cons", "funcall", "eval",
+	  "defun-memo", "time", "defstruct", "with-output-to-string", 0 };
+      for (const char* const* n = names; *n; n++)
+	if (name == *n)
+	  return true;
+      return false;
+    }
+
+    // how often each name is (re)defined or assigned anywhere in v
+    void definitions(const variant& v, std::map<std::string, unsigned>& defs)
+    {
+      const cons_ptr* p = get<cons_ptr>(&v);
+      if (!p || !*p)
+	return;
+      const symbol* s = get<symbol>(&(*p)->car);
+      if (s && (*s == "defun" || *s == "defvar" || *s == "defmacro" || *s == "setf"
+		|| *s == "defun-memo" || *s == "memoize"))
+	if (const cons_ptr* rest = get<cons_ptr>(&(*p)->cdr))
+	  if (*rest)
+	    {
+	      // (memoize 'name): calls have to go through the binding
+	      variant target = (*rest)->car;
+	      if (const special<quoted_>* q = get<special<quoted_> >(&target))
+		target = q->v;
+	      if (const symbol* name = get<symbol>(&target))
+		defs[*name]++;
+	    }
+      definitions((*p)->car, defs);
+      definitions((*p)->cdr, defs);
+    }
+
+    struct defun_info
+    {
+      std::string name;
+      std::vector<symbol> args;
+      variant body;
+      std::string text;
+    };
+
+    class unit
+    {
+    public:
+      unit(const std::vector<variant>& forms);
+      void write(std::ostream& os, const std::string& source);
+
+      // quoted data, built once when the program starts
+      std::string constant(const variant& v);
+
+      std::vector<defun_info> defuns;
+      std::map<std::string, unsigned> direct;   // compiled defuns, by name
+      std::set<std::string> macros;
+
+    private:
+      std::vector<variant> forms_;
+      std::vector<int> defun_of_;               // per form, or -1
+      std::ostringstream init_;
+      unsigned nconstants_, ntemps_;
+
+      std::string build(const variant& v);
+      void compile_all();
+    };
+
+    class body
+    {
+    public:
+      body(unit& u)
+	: u_(u), temps_(0), indent_(1), assigns_(false), self_(0), tail_(false),
+	  looped_(false)
+      { }
+
+      std::string define(const defun_info& d, unsigned index);
+
+    private:
+      typedef std::map<std::string, std::string> env_t;
+
+      unit& u_;
+      std::ostringstream os_;
+      unsigned temps_;
+      int indent_;
+      bool assigns_;                            // there is a setf in the body
+
+      //
+      //  calls to ourselves in tail position assign the arguments and
+      //  go round the body again, see tail.hpp
+      //
+      const defun_info* self_;
+      bool tail_;                               // the next expr is in tail position
+      bool looped_;                             // and there was such a call
+
+      std::string temp(const char* prefix)
+      {
+	return prefix + lexical_cast<std::string>(temps_++);
+      }
+
+      void line(const std::string& s)
+      {
+	os_ << std::string(2 * indent_, ' ') << s << "\n";
+      }
+
+      std::string expr(const variant& v, const env_t& env);
+
+      //
+      //  the value of v, evaluated now: a variable may be assigned to
+      //  before the value is used
+      //
+      std::string hold(const variant& v, const env_t& env)
+      {
+	std::string r = expr(v, env);
+	if (!assigns_ || r.empty() || (r[0] != 'a' && r[0] != 'l')
+	    || r.find_first_not_of("0123456789", 1) != std::string::npos)
+	  return r;
+	std::string copy = temp("t");
+	line("lisp::variant " + copy + " = " + r + ";");
+	return copy;
+      }
+
+      std::string progn(const variant& forms, const env_t& env);
+      std::string form(const cons_ptr& p, const env_t& env, bool tail);
+      void checks(const variant& forms, const env_t& env);
+    };
+
+    std::string body::define(const defun_info& d, unsigned index)
+    {
+      std::map<std::string, unsigned> defs;
+      definitions(d.body, defs);
+      assigns_ = !defs.empty();
+
+      env_t env;
+      std::string params;
+      for (unsigned u = 0; u < d.args.size(); u++)
+	{
+	  std::string a = "a" + lexical_cast<std::string>(u);
+	  env[d.args[u]] = a;
+	  params += ", lisp::variant " + a;
+	}
+      self_ = &d;
+      tail_ = true;
+      checks(d.body, env);
+      std::string result = progn(d.body, env);
+      line("return " + result + ";");
+
+      std::string code = os_.str();
+      if (looped_)
+	{
+	  std::string indented = "  for (;;) {\n";
+	  std::istringstream lines(code);
+	  for (std::string l; std::getline(lines, l); )
+	    indented += "  " + l + "\n";
+	  code = indented + "  }\n";
+	}
+
+      std::string f = "f" + lexical_cast<std::string>(index);
+      std::ostringstream os;
+      os << "// " << d.name << "\n"
+	 << "lisp::variant " << f << "(const lisp::context_ptr& home" << params << ")\n"
+	 << "{\n  lisp::depth_guard guard;\n" << code << "}\n\n"
+	 << "struct e" << index << "\n{\n"
+	 << "  lisp::context_ptr home;\n"
+	 << "  e" << index << "(const lisp::context_ptr& _home) : home(_home) { }\n"
+	 << "  lisp::variant operator()(lisp::context_ptr c, lisp::variant args)\n"
+	 << "  {\n";
+      std::string call = f + "(home";
+      for (unsigned u = 0; u < d.args.size(); u++)
+	{
+	  os << "    lisp::variant a" << u << " = rt::arg(c, args, "
+	     << literal(d.name) << ");\n";
+	  call += ", a" + lexical_cast<std::string>(u);
+	}
+      os << "    return " << call << ");\n"
+	 << "  }\n};\n\n";
+      return os.str();
+    }
+
+    // type checks for what the declarations at the head of forms say
+    void body::checks(const variant& forms, const env_t& env)
+    {
+      declarations decls;
+      if (!parse_declarations(forms, decls) || decls.unchecked)
+	return;
+      for (std::map<std::string, lisp_type>::const_iterator it = decls.types.begin();
+	   it != decls.types.end(); it++)
+	{
+	  env_t::const_iterator var = env.find(it->first);
+	  if (var != env.end() && it->second != any_type)
+	    line("lisp::check_type(" + literal(it->first) + ", " + var->second
+		 + ", lisp::lisp_type(" + lexical_cast<std::string>(int(it->second)) + "));");
+	}
+    }
+
+    std::string body::progn(const variant& forms, const env_t& env)
+    {
+      std::vector<variant> v = elements(forms);
+      unsigned u = 0;
+      while (u < v.size() && is_declare(v[u]))
+	u++;
+      std::string result = "lisp::variant()";
+      bool tail = tail_;
+      for (; u < v.size(); u++)
+	{
+	  tail_ = tail && u + 1 == v.size();
+	  result = expr(v[u], env);
+	}
+      tail_ = false;
+      return result;
+    }
+
+    std::string body::expr(const variant& v, const env_t& env)
+    {
+      bool tail = tail_;
+      tail_ = false;
+      if (const double* d = get<double>(&v))
+	return "lisp::variant(" + number(*d) + ")";
+      if (get<string_ptr>(&v) || get<array_ptr>(&v) || get<bitvector_ptr>(&v))
+	return u_.constant(v);
+      if (const special<quoted_>* q = get<special<quoted_> >(&v))
+	return u_.constant(q->v);
+      if (const symbol* s = get<symbol>(&v))
+	{
+	  env_t::const_iterator it = env.find(*s);
+	  if (it != env.end())
+	    return it->second;
+	  if (*s == "t")
+	    return "lisp::t";
+	  if (*s == "nil")
+	    return "lisp::nil";
+	  std::string r = temp("t");
+	  line("lisp::variant " + r + " = rt::value(home, " + literal(*s) + ");");
+	  return r;
+	}
+      if (const cons_ptr* p = get<cons_ptr>(&v))
+	{
+	  if (!*p)
+	    return "lisp::nil";
+	  return form(*p, env, tail);
+	}
+      throw cant_compile();
+    }
+
+    std::string body::form(const cons_ptr& p, const env_t& env, bool tail)
+    {
+      const symbol* s = get<symbol>(&p->car);
+      if (!s || env.count(*s))
+	throw cant_compile();
+      const std::string& name = *s;
+      std::vector<variant> args = elements(p->cdr);
+
+      if (name == "quote" && args.size() == 1)
+	return u_.constant(args[0]);
+
+      if (name == "declare")
+	return "lisp::nil";
+
+      if (name == "progn")
+	{
+	  tail_ = tail;
+	  return progn(p->cdr, env);
+	}
+
+      if (name == "if" && (args.size() == 2 || args.size() == 3))
+	{
+	  std::string cond = expr(args[0], env);
+	  std::string r = temp("t");
+	  line("lisp::variant " + r + ";");
+	  line("if (rt::truth(" + cond + ")) {");
+	  indent_++;
+	  tail_ = tail;
+	  line(r + " = " + expr(args[1], env) + ";");
+	  indent_--;
+	  line("} else {");
+	  indent_++;
+	  tail_ = tail;
+	  line(r + " = " + (args.size() == 3 ? expr(args[2], env) : "lisp::nil") + ";");
+	  tail_ = false;
+	  indent_--;
+	  line("}");
+	  return r;
+	}
+
+      if (name == "let" && !args.empty())
+	{
+	  std::vector<variant> pairs = elements(args[0]);
+	  std::vector<std::string> names, values;
+	  for (unsigned u = 0; u < pairs.size(); u++)
+	    {
+	      std::vector<variant> pair = elements(pairs[u]);
+	      const symbol* var = pair.size() == 2 ? get<symbol>(&pair[0]) : 0;
+	      if (!var)
+		throw cant_compile();
+	      names.push_back(*var);
+	      values.push_back(hold(pair[1], env));
+	    }
+	  std::string r = temp("t");
+	  line("lisp::variant " + r + ";");
+	  line("{");
+	  indent_++;
+	  env_t inner(env);
+	  for (unsigned u = 0; u < names.size(); u++)
+	    {
+	      std::string l = temp("l");
+	      line("lisp::variant " + l + " = " + values[u] + ";");
+	      inner[names[u]] = l;
+	    }
+	  checks(p->cdr >> cdr, inner);
+	  tail_ = tail;
+	  line(r + " = " + progn(p->cdr >> cdr, inner) + ";");
+	  indent_--;
+	  line("}");
+	  return r;
+	}
+
+      if (name == "setf" && args.size() == 2)
+	{
+	  const symbol* var = get<symbol>(&args[0]);
+	  env_t::const_iterator it = var ? env.find(*var) : env.end();
+	  if (it == env.end())
+	    throw cant_compile();
+	  line(it->second + " = " + expr(args[1], env) + ";");
+	  return it->second;
+	}
+
+      if (name == "+" || name == "*")
+	{
+	  std::string d = temp("d");
+	  line("double " + d + " = " + (name == "+" ? "0" : "1") + ";");
+	  for (unsigned u = 0; u < args.size(); u++)
+	    line(d + " = " + d + " " + name + " rt::num(" + expr(args[u], env) + ");");
+	  std::string r = temp("t");
+	  line("lisp::variant " + r + " = " + d + ";");
+	  return r;
+	}
+
+      if ((name == "-" || name == "/") && !args.empty())
+	{
+	  std::vector<std::string> values;
+	  for (unsigned u = 0; u < args.size(); u++)
+	    values.push_back(hold(args[u], env));
+	  std::string d = temp("d");
+	  line("double " + d + " = rt::num(" + values[0] + ");");
+	  if (values.size() == 1)
+	    line(d + " = " + (name == "-" ? "-" + d : "1.0 / " + d) + ";");
+	  for (unsigned u = 1; u < values.size(); u++)
+	    line(d + " = " + d + " " + name + " rt::num(" + values[u] + ");");
+	  std::string r = temp("t");
+	  line("lisp::variant " + r + " = " + d + ";");
+	  return r;
+	}
+
+      if (name == "<" || name == ">" || name == "<=" || name == ">=" || name == "=")
+	{
+	  std::string op = name == "=" ? "==" : name;
+	  std::string b = temp("b"), prev = temp("d");
+	  line("bool " + b + " = true;");
+	  line("double " + prev + " = 0;");
+	  for (unsigned u = 0; u < args.size(); u++)
+	    {
+	      std::string d = temp("d");
+	      line("double " + d + " = rt::num(" + expr(args[u], env) + ");");
+	      if (u > 0)
+		line("if (!(" + prev + " " + op + " " + d + ")) " + b + " = false;");
+	      line(prev + " = " + d + ";");
+	    }
+	  std::string r = temp("t");
+	  line("lisp::variant " + r + " = rt::boolean(" + b + ");");
+	  return r;
+	}
+
+      if (name == "quote" || name == "if" || name == "let" || name == "setf"
+	  || special_form(name) || u_.macros.count(name))
+	throw cant_compile();
+
+      std::vector<std::string> values;
+      for (unsigned u = 0; u < args.size(); u++)
+	values.push_back(hold(args[u], env));
+      if (tail && name == self_->name && args.size() == self_->args.size())
+	{
+	  std::vector<std::string> next;
+	  for (unsigned u = 0; u < values.size(); u++)
+	    {
+	      next.push_back(temp("t"));
+	      line("lisp::variant " + next[u] + " = " + values[u] + ";");
+	    }
+	  for (unsigned u = 0; u < next.size(); u++)
+	    line("a" + lexical_cast<std::string>(u) + " = " + next[u] + ";");
+	  line("continue;");
+	  looped_ = true;
+	  return "lisp::nil";
+	}
+
+      std::string r = temp("t");
+
+      std::map<std::string, unsigned>::const_iterator it = u_.direct.find(name);
+      if (it != u_.direct.end() && u_.defuns[it->second].args.size() == args.size())
+	{
+	  std::string call = "f" + lexical_cast<std::string>(it->second) + "(home";
+	  for (unsigned u = 0; u < values.size(); u++)
+	    call += ", " + values[u];
+	  line("lisp::variant " + r + " = " + call + ");");
+	  return r;
+	}
+
+      std::string list = "lisp::nil";
+      for (unsigned u = values.size(); u > 0; u--)
+	list = "rt::args(" + values[u-1] + ", " + list + ")";
+      line("lisp::variant " + r + " = rt::call(home, " + literal(name) + ", " + list + ");");
+      return r;
+    }
+
+    unit::unit(const std::vector<variant>& forms)
+      : forms_(forms), nconstants_(0), ntemps_(0)
+    {
+      std::map<std::string, unsigned> defs;
+      for (unsigned u = 0; u < forms.size(); u++)
+	definitions(forms[u], defs);
+
+      for (unsigned u = 0; u < forms.size(); u++)
+	{
+	  defun_of_.push_back(-1);
+	  const symbol* s = head(forms[u]);
+	  if (!s || (*s != "defun" && *s != "defmacro"))
+	    continue;
+	  try {
+	    std::vector<variant> v = elements(forms[u]);
+	    const symbol* name = v.size() >= 3 ? get<symbol>(&v[1]) : 0;
+	    if (name && *s == "defmacro")
+	      macros.insert(*name);
+	    if (!name || *s != "defun" || defs[*name] != 1)
+	      continue;
+	    defun_info d;
+	    d.name = *name;
+	    std::vector<variant> args = elements(v[2]);
+	    for (unsigned a = 0; a < args.size(); a++)
+	      {
+		const symbol* arg = get<symbol>(&args[a]);
+		if (!arg)
+		  throw cant_compile();
+		d.args.push_back(*arg);
+	      }
+	    d.body = forms_[u] >> cdr >> cdr >> cdr;
+	    defun_of_.back() = defuns.size();
+	    direct[d.name] = defuns.size();
+	    defuns.push_back(d);
+	  } catch (const cant_compile&) { }
+	}
+
+      compile_all();
+    }
+
+    //
+    //  Compiling a defun can fail, and then calls to it from the others
+    //  can't be direct: go round until nothing changes.
+    //
+    void unit::compile_all()
+    {
+      bool changed = true;
+      while (changed)
+	{
+	  changed = false;
+	  init_.str("");
+	  nconstants_ = ntemps_ = 0;
+	  for (unsigned u = 0; u < defuns.size(); u++)
+	    {
+	      if (!direct.count(defuns[u].name))
+		continue;
+	      try {
+		defuns[u].text = body(*this).define(defuns[u], u);
+	      } catch (const cant_compile&) {
+		direct.erase(defuns[u].name);
+		changed = true;
+	      } catch (const std::exception&) {
+		// e.g. a bad declaration: the interpreter will complain
+		direct.erase(defuns[u].name);
+		changed = true;
+	      }
+	    }
+	}
+    }
+
+    std::string unit::build(const variant& v)
+    {
+      if (const double* d = get<double>(&v))
+	return "lisp::variant(" + number(*d) + ")";
+      if (const string_ptr* s = get<string_ptr>(&v))
+	return "lisp::variant(lisp::make_string(" + literal((*s)->chars) + "))";
+      if (const symbol* s = get<symbol>(&v))
+	return "lisp::variant(lisp::symbol(" + literal(*s) + "))";
+      if (const special<quoted_>* q = get<special<quoted_> >(&v))
+	return "rt::quoted(" + build(q->v) + ")";
+      if (const special<backquoted_>* q = get<special<backquoted_> >(&v))
+	return "rt::backquoted(" + build(q->v) + ")";
+      if (const special<comma_>* q = get<special<comma_> >(&v))
+	return "rt::comma(" + build(q->v) + ")";
+      if (const special<comma_at_>* q = get<special<comma_at_> >(&v))
+	return "rt::comma_at(" + build(q->v) + ")";
+      if (const array_ptr* a = get<array_ptr>(&v))
+	{
+	  std::vector<std::string> items;
+	  for (unsigned u = 0; u < (*a)->items.size(); u++)
+	    items.push_back(build((*a)->items[u]));
+	  std::string c = "c" + lexical_cast<std::string>(ntemps_++);
+	  init_ << "  lisp::array_ptr " << c << "(new lisp::array);\n";
+	  for (unsigned u = 0; u < items.size(); u++)
+	    init_ << "  " << c << "->items.push_back(" << items[u] << ");\n";
+	  return "lisp::variant(" + c + ")";
+	}
+      if (const bitvector_ptr* b = get<bitvector_ptr>(&v))
+	return "rt::bits(" + literal((*b)->str()) + ")";
+      const cons_ptr* p = get<cons_ptr>(&v);
+      if (!p)
+	throw std::runtime_error("can't compile a function object");
+      if (!*p)
+	return "lisp::nil";
+
+      // lists are built back to front, so only nesting makes for depth
+      std::vector<variant> items;
+      variant l = v;
+      while (const cons_ptr* q = get<cons_ptr>(&l))
+	{
+	  if (!*q)
+	    break;
+	  items.push_back((*q)->car);
+	  l = (*q)->cdr;
+	}
+      std::string tail = build(l);
+      std::string c = "c" + lexical_cast<std::string>(ntemps_++);
+      init_ << "  lisp::variant " << c << " = " << tail << ";\n";
+      for (unsigned u = items.size(); u > 0; u--)
+	{
+	  std::string item = build(items[u-1]);
+	  init_ << "  " << c << " = rt::cons(" << item << ", " << c << ");\n";
+	}
+      return c;
+    }
+
+    std::string unit::constant(const variant& v)
+    {
+      std::string k = "k" + lexical_cast<std::string>(nconstants_++);
+      std::string value = build(v);
+      init_ << "  " << k << " = " << value << ";\n";
+      return k;
+    }
+
+    void unit::write(std::ostream& os, const std::string& source)
+    {
+      std::ostringstream forms;
+      for (unsigned u = 0; u < forms_.size(); u++)
+	{
+	  forms << "void form" << u << "(const lisp::context_ptr& scope)\n{\n";
+	  int d = defun_of_[u];
+	  if (d >= 0 && direct.count(defuns[d].name))
+	    forms << "  rt::defun(scope, " << literal(defuns[d].name)
+		  << ", lisp::function(e" << d << "(scope)));\n";
+	  else
+	    forms << "  rt::eval(scope, " << constant(forms_[u]) << ");\n";
+	  forms << "}\n\n";
+	}
+
+      os << "//\n"
+	 << "// generated by lisp --compile-to-cpp from " << source << "\n"
+	 << "//\n\n"
+	 << "#include \"runtime.hpp\"\n"
+	 << "#include \"stack.hpp\"\n\n"
+	 << "namespace {\n\n"
+	 << "namespace rt = lisp::rt;\n\n";
+
+      for (unsigned u = 0; u < nconstants_; u++)
+	os << "lisp::variant k" << u << ";\n";
+      os << "\nvoid init_constants()\n{\n" << init_.str() << "}\n\n";
+
+      for (unsigned u = 0; u < defuns.size(); u++)
+	if (direct.count(defuns[u].name))
+	  {
+	    os << "lisp::variant f" << u << "(const lisp::context_ptr& home";
+	    for (unsigned a = 0; a < defuns[u].args.size(); a++)
+	      os << ", lisp::variant";
+	    os << ");\n";
+	  }
+      os << "\n";
+
+      for (unsigned u = 0; u < defuns.size(); u++)
+	if (direct.count(defuns[u].name))
+	  os << defuns[u].text;
+
+      os << forms.str()
+	 << "}\n\n"
+	 << "int main()\n{\n"
+	 << "  lisp::add_builtins();\n"
+	 << "  init_constants();\n"
+	 << "  lisp::context_ptr scope = lisp::global->toplevel();\n";
+      for (unsigned u = 0; u < forms_.size(); u++)
+	os << "  rt::toplevel(scope, &form" << u << ");\n";
+      os << "  return 0;\n}\n";
+    }
+  }
+
+  void compile_to_cpp(const std::vector<variant>& forms,
+		      const std::string& source, std::ostream& os)
+  {
+    unit u(forms);
+    u.write(os, source);
+  }
+}
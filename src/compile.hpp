@@ -0,0 +1,35 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_COMPILE_HPP_INCLUDED
+#define LISP_COMPILE_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace lisp {
+
+  //
+  //  Write a C++ program that does what evaluating forms, the top
+  //  level forms of the file source, one after the other would.
+  //
+  //  A defun whose body is made of arithmetic, comparisons, if, let,
+  //  progn, setf of its own variables, quoted data and calls becomes a
+  //  C++ function over variants, calling the functions of the same
+  //  file directly.  Everything else (macros, lambdas, eval, ...) is
+  //  kept as data and handed to the interpreter, which the program
+  //  links, when its turn comes.  See runtime.hpp and
+  //  cmake/LispCompile.cmake.
+  //
+  void compile_to_cpp(const std::vector<variant>& forms,
+		      const std::string& source, std::ostream& os);
+}
+
+#endif
@@ -10,10 +10,123 @@
 #include "print.hpp"
 #include "config.hpp"
 
+#include <boost/make_shared.hpp>
+
+#include <cassert>
+#include <cstdlib>
 #include <iostream>
+#include <vector>
 
 namespace lisp 
 {
+  //
+  //  Bump allocator for frames that die in the order they were made.
+  //  Chunks are kept around once allocated, so steady state recursion
+  //  does not touch malloc at all.
+  //
+  struct frame_arena : boost::noncopyable
+  {
+    enum { chunk_size = 64 * 1024, alignment = 16 };
+
+    std::vector<char*> chunks;
+    std::size_t chunk, top;
+
+    frame_arena() : chunk(0), top(0) { }
+
+    ~frame_arena()
+    {
+      for (unsigned u = 0; u < chunks.size(); u++)
+	std::free(chunks[u]);
+    }
+
+    void* allocate(std::size_t n)
+    {
+      n = (n + alignment - 1) & ~std::size_t(alignment - 1);
+      assert(n <= chunk_size);
+      if (chunks.empty() || top + n > chunk_size)
+	{
+	  if (!chunks.empty())
+	    chunk++;
+	  if (chunk == chunks.size())
+	    chunks.push_back(static_cast<char*>(std::malloc(chunk_size)));
+	  top = 0;
+	}
+      void* p = chunks[chunk] + top;
+      top += n;
+      return p;
+    }
+
+    void release(std::size_t _chunk, std::size_t _top)
+    {
+      chunk = _chunk;
+      top = _top;
+    }
+  };
+
+  frame_arena* new_frame_arena()
+  {
+    return new frame_arena;
+  }
+
+  void delete_frame_arena(frame_arena* a)
+  {
+    delete a;
+  }
+
+  namespace {
+
+    frame_arena main_arena;
+
+    frame_arena* arena = &main_arena;
+
+    template <typename T>
+    struct arena_allocator
+    {
+      typedef T value_type;
+      typedef T* pointer;
+      typedef const T* const_pointer;
+      typedef T& reference;
+      typedef const T& const_reference;
+      typedef std::size_t size_type;
+      typedef std::ptrdiff_t difference_type;
+
+      template <typename U> struct rebind { typedef arena_allocator<U> other; };
+
+      arena_allocator() { }
+      template <typename U> arena_allocator(const arena_allocator<U>&) { }
+
+      T* allocate(std::size_t n, const void* = 0)
+      {
+	return static_cast<T*>(arena->allocate(n * sizeof(T)));
+      }
+
+      // released wholesale by ~stack_scope
+      void deallocate(T*, std::size_t) { }
+
+      void construct(T* p, const T& t) { new (p) T(t); }
+      void destroy(T* p) { p->~T(); }
+      std::size_t max_size() const { return frame_arena::chunk_size / sizeof(T); }
+    };
+
+    template <typename T, typename U>
+    bool operator==(const arena_allocator<T>&, const arena_allocator<U>&) { return true; }
+
+    template <typename T, typename U>
+    bool operator!=(const arena_allocator<T>&, const arena_allocator<U>&) { return false; }
+  }
+
+  context::context() : nslots_(0), frame_(false), on_stack_(false) { }
+
+  boost::shared_ptr<variant> context::binding::boxed()
+  {
+    if (!box)
+      {
+	box.reset(new variant(value));
+	value = variant();
+      }
+    return box;
+  }
+
   context_ptr context::scope()
   {
     context* newctx = new context;
@@ -23,12 +136,62 @@ namespace lisp
     context_ptr this_ptr = shared_from_this();
     assert(this_ptr.get() == this);
     newscope->next_ = this_ptr;
+    newscope->frame_ = true;
     //    std::cout << "new ";
     if (debug_contexts)
       newscope->dump(std::cout);
     return newscope;
   }
 
+  context_ptr context::toplevel()
+  {
+    context_ptr newscope = scope();
+    newscope->frame_ = false;
+    return newscope;
+  }
+
+  context& context::home()
+  {
+    context* c = this;
+    while (c->frame_)
+      c = c->next_.get();
+    return *c;
+  }
+
+  context::binding* context::find(const std::string& s)
+  {
+    for (unsigned u = 0; u < nslots_; u++)
+      if (slots_[u].first == s)
+	return &slots_[u].second;
+    if (!m_.empty())
+      {
+	std::map<std::string, binding>::iterator iter = m_.find(s);
+	if (iter != m_.end())
+	  return &iter->second;
+      }
+    return 0;
+  }
+
+  context::binding& context::insert(const std::string& s)
+  {
+    if (binding* b = find(s))
+      return *b;
+    if (nslots_ < inline_slots && m_.empty())
+      {
+	slots_[nslots_].first = s;
+	return slots_[nslots_++].second;
+      }
+    return m_[s];
+  }
+
+  context::binding* context::frame_binding(const std::string& s)
+  {
+    for (context* c = this; c->frame_; c = c->next_.get())
+      if (binding* b = c->find(s))
+	return b;
+    return 0;
+  }
+
   template <typename T>
   T& context::convert(variant& v)
   {
@@ -46,22 +209,74 @@ namespace lisp
   T& context::get(const std::string& s)
   {
     //    std::cout << "looking for " << s << "\n";
-    context_ptr ctx = shared_from_this();
     if (debug_contexts)
-      ctx->dump(std::cerr);
-    while (ctx)
-      {
-	std::map<std::string, variant>::iterator iter = ctx->m_.find(s);
-	if (iter != ctx->m_.end())
-	  return convert<T>(iter->second);
-	ctx = ctx->next_;
-      }
+      dump(std::cerr);
+    for (context* c = this; c; c = c->next_.get())
+      if (binding* b = c->find(s))
+	return convert<T>(b->get());
     throw std::runtime_error("symbol not found");
   }
 
   void context::put(const std::string& s, variant v)
   {
-    m_[s] = v;
+    insert(s).get() = v;
+  }
+
+  void context::put_box(const std::string& s, boost::shared_ptr<variant> box)
+  {
+    insert(s).box = box;
+  }
+
+  context_ptr context::persistent()
+  {
+    bool reaches_stack = false;
+    for (context* c = this; c && !reaches_stack; c = c->next_.get())
+      reaches_stack = c->on_stack_;
+    if (!reaches_stack)
+      return shared_from_this();
+
+    //
+    //  nothing says the closure won't assign what it sees here, or
+    //  that we won't: the copy shares each binding through a box
+    //
+    context_ptr copy(new context);
+    copy->frame_ = frame_;
+    copy->nslots_ = nslots_;
+    for (unsigned u = 0; u < nslots_; u++)
+      {
+	copy->slots_[u].first = slots_[u].first;
+	copy->slots_[u].second.box = slots_[u].second.boxed();
+      }
+    for (std::map<std::string, binding>::iterator it = m_.begin(); it != m_.end(); it++)
+      copy->m_[it->first].box = it->second.boxed();
+    copy->next_ = next_->persistent();
+    return copy;
+  }
+
+  frame_arena* use_frame_arena(frame_arena* a)
+  {
+    frame_arena* was = arena;
+    arena = a;
+    return was;
+  }
+
+  stack_scope::stack_scope(context& parent)
+    : chunk_(arena->chunk), top_(arena->top)
+  {
+    scope_ = boost::allocate_shared<context>(arena_allocator<context>());
+    scope_->next_ = parent.shared_from_this();
+    scope_->frame_ = true;
+    scope_->on_stack_ = true;
+    if (debug_contexts)
+      scope_->dump(std::cout);
+  }
+
+  stack_scope::~stack_scope()
+  {
+    // if analysis was wrong somebody is about to read freed memory
+    assert(scope_.unique());
+    scope_.reset();
+    arena->release(chunk_, top_);
   }
 
   template variant& context::get(const std::string&);
@@ -74,12 +289,18 @@ namespace lisp
     while (ctx)
       {
 	std::cout << "[ ";
-	for (std::map<std::string, variant>::const_iterator iter = ctx->m_.begin();
+	for (unsigned u = 0; u < ctx->nslots_; u++)
+	  {
+	    os << "\t" << ctx->slots_[u].first << " ";
+	    print(os, const_cast<binding&>(ctx->slots_[u].second).get());
+	    os << "\n";
+	  }
+	for (std::map<std::string, binding>::const_iterator iter = ctx->m_.begin();
 	     iter != ctx->m_.end();
 	     iter++)
 	  {
 	    os << "\t" << iter->first << " ";
-	    print(os, iter->second);
+	    print(os, const_cast<binding&>(iter->second).get());
 	    os << "\n";
 	  }
 	os << "]\n";
@@ -10,36 +10,123 @@
 
 #include "types.hpp"
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <cstddef>
 #include <map>
 #include <string>
+#include <utility>
 
 namespace lisp {
-  
+
   struct context;
   typedef boost::shared_ptr<context> context_ptr;
 
   struct context : boost::enable_shared_from_this<context>
   {
-    template <typename T> 
+    //
+    //  A variable.  Once a closure has captured one that somebody
+    //  assigns to, the value moves into a box that both share.
+    //
+    struct binding
+    {
+      variant value;
+      boost::shared_ptr<variant> box;
+
+      variant& get() { return box ? *box : value; }
+      boost::shared_ptr<variant> boxed();
+    };
+
+    context();
+
+    template <typename T>
     T& get(const std::string& name);
 
     void put(const std::string& name, variant what);
 
+    // a frame: a scope for the arguments of a call or for a let
     context_ptr scope();
 
+    //
+    //  a scope for top level forms.  Closures refer to what lives
+    //  here by name instead of capturing it.
+    //
+    context_ptr toplevel();
+
+    // the nearest enclosing scope that isn't a frame
+    context& home();
+
+    //
+    //  the binding of name in the frames between here and home(),
+    //  or 0 if it is a top level or global variable.
+    //
+    binding* frame_binding(const std::string& name);
+
+    void put_box(const std::string& name, boost::shared_ptr<variant> box);
+
+    //
+    //  this context, or if it or anything it chains to lives on the
+    //  frame stack, a heap copy that shares its bindings and may be kept
+    //  indefinitely.
+    //
+    context_ptr persistent();
+
     void dump(std::ostream&) const;
 
   private:
 
-    std::map<std::string, variant> m_;
+    friend class stack_scope;
+
+    //
+    //  frames are small: the first few bindings live in the context
+    //  itself and only big scopes (the globals) pay for map nodes
+    //
+    enum { inline_slots = 4 };
+    std::pair<std::string, binding> slots_[inline_slots];
+    unsigned nslots_;
+    std::map<std::string, binding> m_;
 
     context_ptr next_;
+    bool frame_, on_stack_;
+
+    binding* find(const std::string& name);
+    binding& insert(const std::string& name);
+
     template <typename T> T& convert(variant&);
 
 
   };
 
+  //
+  //  A scope for a frame that analysis says nobody can hold on to.
+  //  It is carved out of a LIFO arena instead of the heap and is gone
+  //  as soon as the stack_scope is.
+  //
+  class stack_scope : boost::noncopyable
+  {
+  public:
+    stack_scope(context& parent);
+    ~stack_scope();
+
+    context_ptr& get() { return scope_; }
+
+  private:
+    std::size_t chunk_, top_;
+    context_ptr scope_;
+  };
+
+  //
+  //  Where stack_scopes come from.  A generator keeps its frames while
+  //  it is suspended and others come and go, so it has an arena of its
+  //  own and makes it the current one while it runs.
+  //
+  struct frame_arena;
+
+  frame_arena* new_frame_arena();
+  void delete_frame_arena(frame_arena* a);
+  // makes a the current arena, and returns the one that was
+  frame_arena* use_frame_arena(frame_arena* a);
+
   extern context_ptr global;
 }
 
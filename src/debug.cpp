@@ -7,6 +7,13 @@
 
 #include "types.hpp"
 #include "debug.hpp"
+#include "hash_table.hpp"
+#include "f64vector.hpp"
+#include "structure.hpp"
+#include "persistent.hpp"
+#include "bitvector.hpp"
+#include "table.hpp"
+#include "lazy.hpp"
 
 namespace lisp {
 
@@ -19,9 +26,9 @@ namespace lisp {
     os << "(double:" << d << ")";
   }
     
-  void cons_debug::operator()(const std::string& s) const
+  void cons_debug::operator()(const string_ptr& s) const
   {
-    os << "(string:\"" << s << "\")";
+    os << "(string:\"" << s->chars << "\")";
   }
     
   void cons_debug::operator()(const symbol& s) const
@@ -75,6 +82,54 @@ namespace lisp {
     os << ",";
     boost::apply_visitor(*this, s.v);
   }
+  void cons_debug::operator()(const array_ptr& a) const
+  {
+    os << "(array @" << a.get() << " " << a->items.size() << ":";
+    for (unsigned u = 0; u < a->items.size(); u++)
+      {
+	os << " ";
+	boost::apply_visitor(*this, a->items[u]);
+      }
+    os << ")";
+  }
+  void cons_debug::operator()(const hash_table_ptr& h) const
+  {
+    os << "(hash-table @" << h.get() << " " << h->size() << ")";
+  }
+  void cons_debug::operator()(const f64vector_ptr& f) const
+  {
+    os << "(f64vector @" << f.get() << " " << f->items.size() << ")";
+  }
+  void cons_debug::operator()(const structure_ptr& s) const
+  {
+    os << "(" << s->type->name << " @" << s.get();
+    for (unsigned u = 0; u < s->items.size(); u++)
+      {
+	os << " ";
+	boost::apply_visitor(*this, s->items[u]);
+      }
+    os << ")";
+  }
+  void cons_debug::operator()(const pmap_ptr& m) const
+  {
+    os << "(pmap @" << m.get() << " " << m->size << ")";
+  }
+  void cons_debug::operator()(const pvector_ptr& p) const
+  {
+    os << "(pvector @" << p.get() << " " << p->size << ")";
+  }
+  void cons_debug::operator()(const bitvector_ptr& b) const
+  {
+    os << "(bitvector @" << b.get() << " " << b->size << ")";
+  }
+  void cons_debug::operator()(const table_ptr& t) const
+  {
+    os << "(table @" << t.get() << " " << t->rows << ")";
+  }
+  void cons_debug::operator()(const lazy_seq_ptr& l) const
+  {
+    os << "(" << l->name() << " @" << l.get() << ")";
+  }
   
   std::ostream& operator<<(std::ostream& os,
 			   const cons_ptr& cp)
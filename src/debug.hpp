@@ -21,7 +21,7 @@ namespace lisp {
     cons_debug(std::ostream& _os);
 
     void operator()(double d) const;
-    void operator()(const std::string& s) const;
+    void operator()(const string_ptr& s) const;
     void operator()(const symbol& s) const;
     void operator()(const cons_ptr p) const;
     void operator()(const function f) const;
@@ -30,6 +30,15 @@ namespace lisp {
     void operator()(const special<quoted_>& s) const;
     void operator()(const special<comma_at_>& s) const;
     void operator()(const special<comma_>& s) const;
+    void operator()(const array_ptr& a) const;
+    void operator()(const hash_table_ptr& h) const;
+    void operator()(const f64vector_ptr& f) const;
+    void operator()(const structure_ptr& s) const;
+    void operator()(const pmap_ptr& m) const;
+    void operator()(const pvector_ptr& p) const;
+    void operator()(const bitvector_ptr& b) const;
+    void operator()(const table_ptr& t) const;
+    void operator()(const lazy_seq_ptr& l) const;
   };
   
   std::ostream& operator<<(std::ostream& os, const cons_ptr& cp);
@@ -0,0 +1,224 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "context.hpp"
+#include "dispatch.hpp"
+#include "declare.hpp"
+
+#include <stdexcept>
+
+using boost::get;
+
+namespace lisp {
+
+  namespace {
+
+    struct type_names
+    {
+      std::map<std::string, lisp_type> m;
+
+      type_names()
+      {
+	m["t"] = any_type;
+	m["number"] = m["real"] = m["float"] = m["double"]
+	  = m["double-float"] = m["single-float"]
+	  = m["integer"] = m["fixnum"] = number_type;
+	m["list"] = m["cons"] = list_type;
+	m["string"] = string_type;
+	m["symbol"] = symbol_type;
+	m["function"] = function_type;
+      }
+    };
+
+    bool type_named(const variant& v, lisp_type& type)
+    {
+      static const type_names names;
+      const symbol* s = get<symbol>(&v);
+      if (!s)
+	return false;
+      std::map<std::string, lisp_type>::const_iterator it = names.m.find(*s);
+      if (it == names.m.end())
+	return false;
+      type = it->second;
+      return true;
+    }
+
+    const cons_ptr* as_list(const variant& v)
+    {
+      const cons_ptr* p = get<cons_ptr>(&v);
+      if (!p)
+	throw std::runtime_error("malformed declaration");
+      return p;
+    }
+
+    bool is_declare(const variant& form)
+    {
+      const cons_ptr* p = get<cons_ptr>(&form);
+      if (!p || !*p)
+	return false;
+      const std::string* name = form_name(*p);
+      return name && *name == "declare";
+    }
+
+    // (speed 3) or just speed
+    void quality(const variant& v, int& speed, int& safety)
+    {
+      const symbol* s = get<symbol>(&v);
+      int level = 3;
+      if (!s)
+	{
+	  const cons_ptr& p = *as_list(v);
+	  s = p ? get<symbol>(&p->car) : 0;
+	  const cons_ptr* rest = p ? get<cons_ptr>(&p->cdr) : 0;
+	  const double* d = rest && *rest ? get<double>(&(*rest)->car) : 0;
+	  if (!s || !d)
+	    throw std::runtime_error("malformed optimize declaration");
+	  level = int(*d);
+	}
+      if (*s == "speed")
+	speed = level;
+      else if (*s == "safety")
+	safety = level;
+    }
+
+    void declaration(const variant& spec, declarations& decls,
+		     int& speed, int& safety)
+    {
+      const cons_ptr& p = *as_list(spec);
+      if (!p)
+	throw std::runtime_error("malformed declaration");
+      const symbol* head = get<symbol>(&p->car);
+      if (!head)
+	throw std::runtime_error("malformed declaration");
+
+      variant names = p->cdr;
+      lisp_type type;
+      if (*head == "optimize")
+	{
+	  for (const cons_ptr* q = as_list(names); *q; q = as_list((*q)->cdr))
+	    quality((*q)->car, speed, safety);
+	  return;
+	}
+      if (*head == "type")
+	{
+	  const cons_ptr& q = *as_list(names);
+	  if (!q || !type_named(q->car, type))
+	    throw std::runtime_error("unknown type in declaration");
+	  names = q->cdr;
+	}
+      else if (!type_named(*head, type))
+	{
+	  if (*head == "ignore" || *head == "ignorable")
+	    return;
+	  throw std::runtime_error("unknown declaration " + *head);
+	}
+
+      for (const cons_ptr* q = as_list(names); *q; q = as_list((*q)->cdr))
+	{
+	  const symbol* s = get<symbol>(&(*q)->car);
+	  if (!s)
+	    throw std::runtime_error("malformed type declaration");
+	  decls.types[*s] = type;
+	}
+    }
+  }
+
+  const char* type_name(lisp_type type)
+  {
+    switch (type)
+      {
+      case number_type: return "number";
+      case list_type: return "list";
+      case string_type: return "string";
+      case symbol_type: return "symbol";
+      case function_type: return "function";
+      default: return "t";
+      }
+  }
+
+  bool has_type(const variant& v, lisp_type type)
+  {
+    switch (type)
+      {
+      case number_type: return get<double>(&v) != 0;
+      case list_type: return get<cons_ptr>(&v) != 0;
+      case string_type: return get<string_ptr>(&v) != 0;
+      case symbol_type: return get<symbol>(&v) != 0;
+      case function_type: return get<function>(&v) != 0;
+      default: return true;
+      }
+  }
+
+  void check_type(const std::string& name, const variant& v, lisp_type type)
+  {
+    if (!has_type(v, type))
+      throw std::runtime_error("type error: " + name + " is not a "
+			       + type_name(type));
+  }
+
+  lisp_type declarations::type_of(const std::string& name) const
+  {
+    std::map<std::string, lisp_type>::const_iterator it = types.find(name);
+    return it == types.end() ? any_type : it->second;
+  }
+
+  bool parse_declarations(const variant& body, declarations& decls)
+  {
+    int speed = 1, safety = -1;
+    bool found = false;
+    for (const cons_ptr* p = get<cons_ptr>(&body);
+	 p && *p && is_declare((*p)->car);
+	 p = get<cons_ptr>(&(*p)->cdr))
+      {
+	found = true;
+	variant specs = (*p)->car >> cdr;
+	for (const cons_ptr* q = as_list(specs); *q; q = as_list((*q)->cdr))
+	  declaration((*q)->car, decls, speed, safety);
+      }
+    decls.unchecked = safety == 0 || (speed >= 3 && safety < 0);
+    return found;
+  }
+
+  declared_args_ptr declare_args(const std::vector<symbol>& args,
+				 const variant& body)
+  {
+    declarations decls;
+    if (!parse_declarations(body, decls) || decls.types.empty())
+      return declared_args_ptr();
+
+    boost::shared_ptr<declared_args> declared(new declared_args);
+    for (unsigned u = 0; u < args.size(); u++)
+      declared->types.push_back(decls.type_of(args[u]));
+    declared->checked = !decls.unchecked;
+    return declared;
+  }
+
+  void check_declarations(context_ptr& scope, const variant& body)
+  {
+    const cons_ptr* p = get<cons_ptr>(&body);
+    if (!p || !*p || !is_declare((*p)->car))
+      return;
+
+    declarations decls;
+    parse_declarations(body, decls);
+    if (decls.unchecked)
+      return;
+    for (std::map<std::string, lisp_type>::const_iterator it = decls.types.begin();
+	 it != decls.types.end(); it++)
+      {
+	variant* v;
+	try {
+	  v = &scope->get<variant>(it->first);
+	} catch (const std::exception&) {
+	  continue;
+	}
+	check_type(it->first, *v, it->second);
+      }
+  }
+}
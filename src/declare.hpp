@@ -0,0 +1,76 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_DECLARE_HPP_INCLUDED
+#define LISP_DECLARE_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace lisp {
+
+  enum lisp_type
+    {
+      any_type,
+      number_type,
+      list_type,
+      string_type,
+      symbol_type,
+      function_type
+    };
+
+  const char* type_name(lisp_type type);
+
+  bool has_type(const variant& v, lisp_type type);
+
+  // throws if v, the value of name, isn't of the declared type
+  void check_type(const std::string& name, const variant& v, lisp_type type);
+
+  //
+  //  What the (declare ...) forms at the head of a body say:
+  //
+  //    (declare (type double x y) (list l))
+  //    (declare (optimize (speed 3)))
+  //
+  //  Unless asked for speed 3 (and not for safety), declared types are
+  //  checked when the variables are bound.
+  //
+  struct declarations
+  {
+    std::map<std::string, lisp_type> types;
+    bool unchecked;
+
+    declarations() : unchecked(false) { }
+
+    lisp_type type_of(const std::string& name) const;
+  };
+
+  // parse the declarations at the head of body; false if there are none
+  bool parse_declarations(const variant& body, declarations& decls);
+
+  // what a procedure's declarations say about its arguments
+  struct declared_args
+  {
+    std::vector<lisp_type> types;    // one per argument
+    bool checked;
+  };
+
+  typedef boost::shared_ptr<const declared_args> declared_args_ptr;
+
+  // empty if body declares nothing about args
+  declared_args_ptr declare_args(const std::vector<symbol>& args,
+				 const variant& body);
+
+  // check the variables a let body declares, now that they're bound
+  void check_declarations(context_ptr& scope, const variant& body);
+}
+
+#endif
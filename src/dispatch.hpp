@@ -0,0 +1,195 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_DISPATCH_HPP_INCLUDED
+#define LISP_DISPATCH_HPP_INCLUDED
+
+#include "config.hpp"
+#include "types.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "numeric.hpp"
+#include "declare.hpp"
+#include "tier.hpp"
+#include "stack.hpp"
+#include "tail.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <string>
+#include <vector>
+
+namespace lisp {
+
+  //
+  //  Everything we know about a user defined function.  Shared by all
+  //  copies of the dispatcher, so that analysis can rewrite the code
+  //  in place after the function object has been handed out.
+  //
+  struct procedure
+  {
+    std::string name;              // empty for lambdas
+    std::vector<symbol> args;
+    variant source;                // body as written
+    variant code;                  // body after analysis
+    variant body;                  // (progn . code), what actually runs
+    context_ptr ctx;
+    bool redefinition;             // name was already bound to a procedure
+    std::vector<std::string> inlined;
+    bool stack_frame;              // frame can't be captured, see escape.hpp
+    bool tail_loop;                // self tail calls loop, see tail.hpp
+    numeric_code_ptr numeric;      // unboxed version of code, if any
+    declared_args_ptr declared;    // what (declare ...) says about args
+    unsigned tier, calls;          // see tier.hpp
+
+    procedure(const variant& _source);
+
+    void set_code(const variant& _code);
+  };
+
+  typedef boost::shared_ptr<procedure> procedure_ptr;
+
+  namespace ops {
+
+    template <typename Signature>
+    struct dispatch
+    {
+      procedure_ptr proc;
+
+      dispatch(procedure_ptr _proc) : proc(_proc) { }
+
+      variant operator()(context_ptr c, const variant v)
+      {
+	SHOW;
+	depth_guard guard;
+	procedure& p = *proc;
+	if (++p.calls >= tier_hot_calls && p.tier == cold_tier && !p.name.empty())
+	  promote(proc);
+	tier_clock clock(p.tier);
+	if (numeric_code_ptr n = p.numeric)
+	  return run(c, v, *n);
+	// hold on to the body: analysis may swap it out while we run
+	variant body = p.body;
+	if (p.stack_frame)
+	  {
+	    stack_scope scope(*p.ctx);
+	    bind(c, v, scope.get());
+	    return loop(scope.get(), body);
+	  }
+	context_ptr scope = p.ctx->scope();
+	bind(c, v, scope);
+	return loop(scope, body);
+      }
+
+      //
+      //  Evaluate body in scope, and each time it ends in a self_call,
+      //  rebind the arguments and evaluate it again.  A frame on the
+      //  stack can be reused as is; one on the heap may have been
+      //  captured, so it gets a fresh copy.
+      //
+      variant loop(context_ptr& scope, const variant& body)
+      {
+	variant result = eval(scope, body);
+	if (!tail_call_pending)
+	  return result;
+
+	const procedure& p = *proc;
+	bool checked = p.declared && p.declared->checked;
+	std::vector<variant> args;
+	context_ptr frame = scope;
+	while (tail_call_pending)
+	  {
+	    tail_call_pending = false;
+	    args.swap(tail_call_args);
+	    if (!p.stack_frame)
+	      frame = p.ctx->scope();
+	    for (unsigned u = 0; u < p.args.size(); u++)
+	      {
+		if (checked)
+		  check_type(p.args[u], args[u], p.declared->types[u]);
+		frame->put(p.args[u], args[u]);
+	      }
+	    result = eval(frame, body);
+	  }
+	return result;
+      }
+
+      //
+      //  Evaluate the arguments into a frame of doubles and run the
+      //  numeric code on it.  The first argument that turns out not
+      //  to be a number sends us back to the ordinary path.
+      //
+      variant run(context_ptr& c, const variant& v, const numeric_code& n)
+      {
+	const procedure& p = *proc;
+	double frame[numeric_code::max_frame];
+	cons_ptr l = boost::get<cons_ptr>(v);
+	for(unsigned u = 0; u<p.args.size(); u++)
+	  {
+	    variant evalled = eval(c, l->car);
+	    l = boost::get<cons_ptr>(l->cdr);
+	    if (const double* d = boost::get<double>(&evalled))
+	      {
+		frame[u] = *d;
+		continue;
+	      }
+	    bool checked = p.declared && p.declared->checked;
+	    variant body = p.body;
+	    context_ptr scope = p.ctx->scope();
+	    for (unsigned i = 0; i < u; i++)
+	      scope->put(p.args[i], frame[i]);
+	    for (;;)
+	      {
+		if (checked)
+		  check_type(p.args[u], evalled, p.declared->types[u]);
+		scope->put(p.args[u], evalled);
+		if (++u == p.args.size())
+		  break;
+		evalled = eval(c, l->car);
+		l = boost::get<cons_ptr>(l->cdr);
+	      }
+	    return loop(scope, body);
+	  }
+	return n.box(n.enter(frame));
+      }
+
+      void bind(context_ptr& c, const variant& v, context_ptr& scope)
+      {
+	const procedure& p = *proc;
+	bool checked = p.declared && p.declared->checked;
+	cons_ptr l = boost::get<cons_ptr>(v);
+	for(unsigned u = 0; u<p.args.size(); u++)
+	  {
+	    variant evalled = eval(c, l->car);
+	    if (checked)
+	      check_type(p.args[u], evalled, p.declared->types[u]);
+	    scope->put(p.args[u], evalled);
+	    l = boost::get<cons_ptr>(l->cdr);
+	  }
+      }
+    };
+  }
+
+  // the procedure behind v, if v is a function made by defun or lambda
+  procedure_ptr as_procedure(const variant& v);
+
+  //
+  //  name of the operator in form p: its symbol, or the name of a
+  //  builtin that analysis has embedded in the code directly.
+  //
+  inline const std::string* form_name(const cons_ptr& p)
+  {
+    if (const symbol* s = boost::get<symbol>(&p->car))
+      return s;
+    if (const function* f = boost::get<function>(&p->car))
+      return f->name.empty() ? 0 : &f->name;
+    return 0;
+  }
+
+  bool is_macro(const variant& v);
+}
+
+#endif
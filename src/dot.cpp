@@ -6,12 +6,20 @@
 //
 
 #include "dot.hpp"
+#include "hash_table.hpp"
+#include "f64vector.hpp"
+#include "structure.hpp"
+#include "persistent.hpp"
+#include "bitvector.hpp"
+#include "table.hpp"
+#include "lazy.hpp"
 #include "config.hpp"
 
 #include <boost/format.hpp>
 
 #include <iostream>
 #include <fstream>
+#include <vector>
 
 
 
@@ -32,11 +40,11 @@ namespace lisp
     return (void*)&d;
   }
     
-  void* dot::operator()(const std::string& s)
+  void* dot::operator()(const string_ptr& s)
   {
     SHOW;
-    *os << "\"" << &s << "\" [ label = \"string " << s << "\" ];\n";
-    return (void*)&s;
+    *os << "\"" << s.get() << "\" [ label = \"string " << s->chars << "\" ];\n";
+    return (void*)s.get();
   }
     
   void* dot::operator()(const symbol& s)
@@ -69,6 +77,87 @@ namespace lisp
     return (void*)&f;
   }
 
+  void* dot::operator()(const array_ptr& a)
+  {
+    SHOW;
+    std::vector<void*> items;
+    for (unsigned u = 0; u < a->items.size(); u++)
+      items.push_back(boost::apply_visitor(*this, a->items[u]));
+
+    *os << "\"" << &a << "\" [ label =\"";
+    for (unsigned u = 0; u < items.size(); u++)
+      *os << (u ? "|" : "") << "<i" << u << ">" << u;
+    *os << "\"\n shape = record ];";
+    for (unsigned u = 0; u < items.size(); u++)
+      *os << "\"" << &a << "\":i" << u << " -> \"" << items[u] << "\"\n";
+    return (void*)&a;
+  }
+
+  void* dot::operator()(const hash_table_ptr& h)
+  {
+    SHOW;
+    *os << "\"" << &h << "\" [ label = \"hash-table " << h->size() << "\" ];\n";
+    return (void*)&h;
+  }
+
+  void* dot::operator()(const f64vector_ptr& f)
+  {
+    SHOW;
+    *os << "\"" << &f << "\" [ label = \"f64vector " << f->items.size() << "\" ];\n";
+    return (void*)&f;
+  }
+
+  void* dot::operator()(const structure_ptr& s)
+  {
+    SHOW;
+    std::vector<void*> items;
+    for (unsigned u = 0; u < s->items.size(); u++)
+      items.push_back(boost::apply_visitor(*this, s->items[u]));
+
+    *os << "\"" << &s << "\" [ label =\"" << s->type->name;
+    for (unsigned u = 0; u < items.size(); u++)
+      *os << "|<i" << u << ">" << s->type->slots[u];
+    *os << "\"\n shape = record ];";
+    for (unsigned u = 0; u < items.size(); u++)
+      *os << "\"" << &s << "\":i" << u << " -> \"" << items[u] << "\"\n";
+    return (void*)&s;
+  }
+
+  void* dot::operator()(const pmap_ptr& m)
+  {
+    SHOW;
+    *os << "\"" << &m << "\" [ label = \"pmap " << m->size << "\" ];\n";
+    return (void*)&m;
+  }
+
+  void* dot::operator()(const pvector_ptr& p)
+  {
+    SHOW;
+    *os << "\"" << &p << "\" [ label = \"pvector " << p->size << "\" ];\n";
+    return (void*)&p;
+  }
+
+  void* dot::operator()(const bitvector_ptr& b)
+  {
+    SHOW;
+    *os << "\"" << &b << "\" [ label = \"bitvector " << b->size << "\" ];\n";
+    return (void*)&b;
+  }
+
+  void* dot::operator()(const table_ptr& t)
+  {
+    SHOW;
+    *os << "\"" << &t << "\" [ label = \"table " << t->rows << "\" ];\n";
+    return (void*)&t;
+  }
+
+  void* dot::operator()(const lazy_seq_ptr& l)
+  {
+    SHOW;
+    *os << "\"" << &l << "\" [ label = \"" << l->name() << "\" ];\n";
+    return (void*)&l;
+  }
+
   void* dot::operator()(const variant& v)
   {
     SHOW;
@@ -24,10 +24,19 @@ namespace lisp {
     ~dot();
 
     void* operator()(const double &d);
-    void* operator()(const std::string& s);
+    void* operator()(const string_ptr& s);
     void* operator()(const symbol& s);
     void* operator()(const cons_ptr& p);
     void* operator()(const function& f);
+    void* operator()(const array_ptr& a);
+    void* operator()(const hash_table_ptr& h);
+    void* operator()(const f64vector_ptr& f);
+    void* operator()(const structure_ptr& s);
+    void* operator()(const pmap_ptr& m);
+    void* operator()(const pvector_ptr& p);
+    void* operator()(const bitvector_ptr& b);
+    void* operator()(const table_ptr& t);
+    void* operator()(const lazy_seq_ptr& l);
     void* operator()(const variant& v);
     template <typename T> void* operator()(const special<T>& s) { return 0; }
 
@@ -0,0 +1,409 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "dispatch.hpp"
+#include "equal.hpp"
+#include "f64vector.hpp"
+#include "structure.hpp"
+#include "persistent.hpp"
+#include "bitvector.hpp"
+#include "table.hpp"
+#include "lazy.hpp"
+#include "strings.hpp"
+#include "format.hpp"
+#include "regex.hpp"
+
+#include <boost/functional/hash.hpp>
+
+namespace lisp {
+
+  namespace {
+
+    struct equal_visitor
+    : public boost::static_visitor<bool>
+    {
+      template <typename T, typename U>
+      bool operator()( const T &, const U & ) const
+      {
+        return false; // cannot compare different types
+      }
+
+      template <typename T>
+      bool operator()( const T & lhs, const T & rhs ) const
+      {
+        return lhs == rhs;
+      }
+
+      template <typename T>
+      bool operator()( const lisp::function & lhs, const lisp::function & rhs ) const
+      {
+        return &lhs == &rhs;
+      }
+
+      bool operator()( const lisp::string_ptr& lhs, const lisp::string_ptr & rhs ) const
+      {
+	return lhs == rhs || lhs->chars == rhs->chars;
+      }
+
+      bool operator()( const lisp::cons_ptr& lhs, const lisp::cons_ptr & rhs ) const
+      {
+	if (is_nil(lhs) && is_nil(rhs))
+	  return true;
+	if (is_nil(lhs) || is_nil(rhs))
+	  return false;
+
+        return boost::apply_visitor(*this, lhs->car, rhs->car)
+	  && boost::apply_visitor(*this, lhs->cdr, rhs->cdr);
+      }
+
+      bool operator()( const lisp::array_ptr& lhs, const lisp::array_ptr & rhs ) const
+      {
+	if (lhs->items.size() != rhs->items.size())
+	  return false;
+	for (unsigned u = 0; u < lhs->items.size(); u++)
+	  if (!boost::apply_visitor(*this, lhs->items[u], rhs->items[u]))
+	    return false;
+	return true;
+      }
+
+      bool operator()( const lisp::f64vector_ptr& lhs, const lisp::f64vector_ptr & rhs ) const
+      {
+	return lhs->items == rhs->items;
+      }
+
+      bool operator()( const lisp::structure_ptr& lhs, const lisp::structure_ptr & rhs ) const
+      {
+	if (lhs->type != rhs->type)
+	  return false;
+	for (unsigned u = 0; u < lhs->items.size(); u++)
+	  if (!boost::apply_visitor(*this, lhs->items[u], rhs->items[u]))
+	    return false;
+	return true;
+      }
+
+      bool operator()( const lisp::pmap_ptr& lhs, const lisp::pmap_ptr & rhs ) const
+      {
+	if (lhs->size != rhs->size)
+	  return false;
+	std::vector<std::pair<variant, variant> > entries;
+	lhs->entries(entries);
+	for (unsigned u = 0; u < entries.size(); u++)
+	  {
+	    const variant* other = rhs->find(entries[u].first);
+	    if (!other || !boost::apply_visitor(*this, entries[u].second, *other))
+	      return false;
+	  }
+	return true;
+      }
+
+      bool operator()( const lisp::pvector_ptr& lhs, const lisp::pvector_ptr & rhs ) const
+      {
+	if (lhs->size != rhs->size)
+	  return false;
+	for (std::size_t i = 0; i < lhs->size; i++)
+	  if (!boost::apply_visitor(*this, lhs->nth(i), rhs->nth(i)))
+	    return false;
+	return true;
+      }
+
+      bool operator()( const lisp::bitvector_ptr& lhs, const lisp::bitvector_ptr & rhs ) const
+      {
+	return lhs->size == rhs->size && lhs->words == rhs->words;
+      }
+
+      bool operator()( const lisp::table_ptr& lhs, const lisp::table_ptr & rhs ) const
+      {
+	return lhs->rows == rhs->rows && lhs->columns == rhs->columns;
+      }
+
+      // a recipe that may never end: only the same one is equal
+      bool operator()( const lisp::lazy_seq_ptr& lhs, const lisp::lazy_seq_ptr & rhs ) const
+      {
+	return lhs == rhs;
+      }
+    };
+
+    //
+    //  structural_hash mixes in the type, since nothing of one type
+    //  is equal to anything of another.  Functions are equal only to
+    //  themselves, which a hash can't see, so they all land together.
+    //
+    struct hash_visitor
+    : public boost::static_visitor<std::size_t>
+    {
+      std::size_t operator()(double d) const
+      {
+	// 0.0 and -0.0 are equal
+	return boost::hash<double>()(d == 0 ? 0.0 : d);
+      }
+
+      std::size_t operator()(const string_ptr& s) const
+      {
+	return s->hash();
+      }
+
+      std::size_t operator()(const symbol& s) const
+      {
+	std::size_t h = 0x5bd1e995;
+	boost::hash_combine(h, static_cast<const std::string&>(s));
+	return h;
+      }
+
+      std::size_t operator()(const function&) const
+      {
+	return 0x27d4eb2d;
+      }
+
+      // lists iteratively along the cdrs, as they can be long
+      std::size_t operator()(cons_ptr p) const
+      {
+	std::size_t h = 0x9e3779b9;
+	for (;;)
+	  {
+	    if (!p)
+	      return h;
+	    boost::hash_combine(h, structural_hash(p->car));
+	    const cons_ptr* next = boost::get<cons_ptr>(&p->cdr);
+	    if (!next)
+	      {
+		boost::hash_combine(h, structural_hash(p->cdr));
+		return h;
+	      }
+	    p = *next;
+	  }
+      }
+
+      std::size_t operator()(const hash_table_ptr& t) const
+      {
+	return boost::hash<void*>()(t.get());
+      }
+
+      std::size_t operator()(const array_ptr& a) const
+      {
+	std::size_t h = a->items.size();
+	for (unsigned u = 0; u < a->items.size(); u++)
+	  boost::hash_combine(h, structural_hash(a->items[u]));
+	return h;
+      }
+
+      std::size_t operator()(const f64vector_ptr& f) const
+      {
+	std::size_t h = f->items.size();
+	for (unsigned u = 0; u < f->items.size(); u++)
+	  boost::hash_combine(h, (*this)(f->items[u]));
+	return h;
+      }
+
+      std::size_t operator()(const structure_ptr& s) const
+      {
+	std::size_t h = boost::hash<std::string>()(s->type->name);
+	for (unsigned u = 0; u < s->items.size(); u++)
+	  boost::hash_combine(h, structural_hash(s->items[u]));
+	return h;
+      }
+
+      // the same whatever order the entries come out in
+      std::size_t operator()(const pmap_ptr& m) const
+      {
+	std::vector<std::pair<variant, variant> > entries;
+	m->entries(entries);
+	std::size_t h = m->size;
+	for (unsigned u = 0; u < entries.size(); u++)
+	  {
+	    std::size_t e = structural_hash(entries[u].first);
+	    boost::hash_combine(e, structural_hash(entries[u].second));
+	    h += e;
+	  }
+	return h;
+      }
+
+      std::size_t operator()(const pvector_ptr& p) const
+      {
+	std::size_t h = p->size;
+	for (std::size_t i = 0; i < p->size; i++)
+	  boost::hash_combine(h, structural_hash(p->nth(i)));
+	return h;
+      }
+
+      std::size_t operator()(const bitvector_ptr& b) const
+      {
+	std::size_t h = b->size;
+	boost::hash_range(h, b->words.begin(), b->words.end());
+	return h;
+      }
+
+      std::size_t operator()(const table_ptr& t) const
+      {
+	std::size_t h = t->rows;
+	for (unsigned u = 0; u < t->columns.size(); u++)
+	  boost::hash_combine(h, static_cast<const std::string&>(t->columns[u].name));
+	return h;
+      }
+
+      std::size_t operator()(const lazy_seq_ptr& l) const
+      {
+	return boost::hash<void*>()(l.get());
+      }
+
+      template <typename T>
+      std::size_t operator()(const special<T>& s) const
+      {
+	return structural_hash(s.v);
+      }
+    };
+  }
+
+  namespace {
+
+    //
+    //  What a builtin that carries state shares between its copies,
+    //  since boost::function copies the functor: the buffer of a
+    //  string output stream, the program of a compiled format, the DFA
+    //  of a compiled regex.  0 for the rest, which are all alike.
+    //
+    const void* function_state(const function& f)
+    {
+      if (std::string* text = output_buffer(f))
+	return text;
+      if (const ops::compiled_format* cf = f.f.target<ops::compiled_format>())
+	return cf->program.get();
+      return regex_machine(f);
+    }
+
+    struct identity_visitor
+    : public boost::static_visitor<bool>
+    {
+      template <typename T, typename U>
+      bool operator()(const T&, const U&) const
+      {
+	return false;
+      }
+
+      // atoms, and pointers to the things that have an identity
+      template <typename T>
+      bool operator()(const T& lhs, const T& rhs) const
+      {
+	return lhs == rhs;
+      }
+
+      // strings were values before they were shared, and eq still says so
+      bool operator()(const string_ptr& lhs, const string_ptr& rhs) const
+      {
+	return lhs == rhs || lhs->chars == rhs->chars;
+      }
+
+      bool operator()(const function& lhs, const function& rhs) const
+      {
+	procedure_ptr p = as_procedure(lhs), q = as_procedure(rhs);
+	if (p || q)
+	  return p == q;
+	const void* a = function_state(lhs);
+	const void* b = function_state(rhs);
+	if (a || b)
+	  return a == b;
+	return lhs.f.target_type() == rhs.f.target_type();
+      }
+
+      template <typename T>
+      bool operator()(const special<T>& lhs, const special<T>& rhs) const
+      {
+	return structurally_equal(lhs.v, rhs.v);
+      }
+    };
+
+    struct identity_hash_visitor
+    : public boost::static_visitor<std::size_t>
+    {
+      std::size_t operator()(const cons_ptr& p) const
+      {
+	return boost::hash<void*>()(p.get());
+      }
+
+      std::size_t operator()(const array_ptr& a) const
+      {
+	return boost::hash<void*>()(a.get());
+      }
+
+      std::size_t operator()(const hash_table_ptr& h) const
+      {
+	return boost::hash<void*>()(h.get());
+      }
+
+      std::size_t operator()(const f64vector_ptr& f) const
+      {
+	return boost::hash<void*>()(f.get());
+      }
+
+      std::size_t operator()(const structure_ptr& s) const
+      {
+	return boost::hash<void*>()(s.get());
+      }
+
+      std::size_t operator()(const pmap_ptr& m) const
+      {
+	return boost::hash<void*>()(m.get());
+      }
+
+      std::size_t operator()(const pvector_ptr& p) const
+      {
+	return boost::hash<void*>()(p.get());
+      }
+
+      std::size_t operator()(const bitvector_ptr& b) const
+      {
+	return boost::hash<void*>()(b.get());
+      }
+
+      std::size_t operator()(const table_ptr& t) const
+      {
+	return boost::hash<void*>()(t.get());
+      }
+
+      std::size_t operator()(const lazy_seq_ptr& l) const
+      {
+	return boost::hash<void*>()(l.get());
+      }
+
+      std::size_t operator()(const function& f) const
+      {
+	if (const void* state = function_state(f))
+	  return boost::hash<const void*>()(state);
+	return structural_hash(f);
+      }
+
+      template <typename T>
+      std::size_t operator()(const T& v) const
+      {
+	return structural_hash(v);
+      }
+    };
+  }
+
+  bool identical(const variant& lhs, const variant& rhs)
+  {
+    return boost::apply_visitor(identity_visitor(), lhs, rhs);
+  }
+
+  std::size_t identity_hash(const variant& v)
+  {
+    return boost::apply_visitor(identity_hash_visitor(), v);
+  }
+
+  bool structurally_equal(const variant& lhs, const variant& rhs)
+  {
+    return boost::apply_visitor(equal_visitor(), lhs, rhs);
+  }
+
+  std::size_t structural_hash(const variant& v)
+  {
+    std::size_t h = v.which();
+    boost::hash_combine(h, boost::apply_visitor(hash_visitor(), v));
+    return h;
+  }
+}
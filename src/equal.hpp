@@ -0,0 +1,36 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_EQUAL_HPP_INCLUDED
+#define LISP_EQUAL_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <cstddef>
+
+namespace lisp {
+
+  // what the equal builtin says: same type, same value, same structure
+  bool structurally_equal(const variant& lhs, const variant& rhs);
+
+  //
+  //  a hash to go with structurally_equal: values it calls equal hash
+  //  the same
+  //
+  std::size_t structural_hash(const variant& v);
+
+  //
+  //  eq: the very same list, vector or table, the same function, or
+  //  an atom equal to the other one
+  //
+  bool identical(const variant& lhs, const variant& rhs);
+
+  // and a hash for it
+  std::size_t identity_hash(const variant& v);
+}
+
+#endif
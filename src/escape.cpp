@@ -0,0 +1,120 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "context.hpp"
+#include "ops.hpp"
+#include "dispatch.hpp"
+#include "escape.hpp"
+#include "analysis.hpp"
+#include "closure.hpp"
+
+using boost::get;
+
+namespace lisp {
+
+  namespace {
+
+    bool captures_form(const variant& v, context& ctx)
+    {
+      if (const special<backquoted_>* s = get<special<backquoted_> >(&v))
+	return captures_form(s->v, ctx);
+      if (const special<comma_>* s = get<special<comma_> >(&v))
+	return captures_form(s->v, ctx);
+      if (const special<comma_at_>* s = get<special<comma_at_> >(&v))
+	return captures_form(s->v, ctx);
+      if (const array_ptr* a = get<array_ptr>(&v))
+	{
+	  for (unsigned u = 0; u < (*a)->items.size(); u++)
+	    if (captures_form((*a)->items[u], ctx))
+	      return true;
+	  return false;
+	}
+
+      const cons_ptr* p = get<cons_ptr>(&v);
+      if (!p || !*p)
+	return false;
+
+      if (const std::string* name = form_name(*p))
+	{
+	  if (*name == "quote")
+	    return false;
+	  if (*name == "lambda")
+	    return !flat_closure(*p);
+	  if (*name == "defun" || *name == "eval" || names_macro(ctx, *name))
+	    return true;
+	}
+      for (cons_ptr l = *p; l; )
+	{
+	  if (captures_form(l->car, ctx))
+	    return true;
+	  const cons_ptr* next = get<cons_ptr>(&l->cdr);
+	  if (!next)
+	    return captures_form(l->cdr, ctx);
+	  l = *next;
+	}
+      return false;
+    }
+
+    const variant& stack_let()
+    {
+      static const variant f = embed(function(ops::stack_let()), "let");
+      return f;
+    }
+
+    variant rewrite(const variant& v, context& ctx);
+
+    variant rewrite_list(const variant& v, context& ctx)
+    {
+      const cons_ptr* p = get<cons_ptr>(&v);
+      if (!p || !*p)
+	return v;
+      return cons_ptr(new cons(rewrite((*p)->car, ctx), rewrite_list((*p)->cdr, ctx)));
+    }
+
+    variant rewrite(const variant& v, context& ctx)
+    {
+      const cons_ptr* pp = get<cons_ptr>(&v);
+      if (!pp || !*pp)
+	return v;
+      const cons_ptr& p = *pp;
+
+      const symbol* s = get<symbol>(&p->car);
+      if (s && (*s == "quote" || *s == "defun" || *s == "defmacro" || names_macro(ctx, *s)))
+	return v;
+
+      variant rest = rewrite_list(p->cdr, ctx);
+
+      // (let bindings . body)
+      if (s && *s == "let" && !is_nil(rest) && !captures(rest >> cdr, ctx))
+	return cons_ptr(new cons(stack_let(), rest));
+      return cons_ptr(new cons(s ? p->car : rewrite(p->car, ctx), rest));
+    }
+  }
+
+  bool captures(const variant& body, context& ctx)
+  {
+    const cons_ptr* p = get<cons_ptr>(&body);
+    if (!p)
+      return false;
+    for (cons_ptr l = *p; l; l = get<cons_ptr>(l->cdr))
+      if (captures_form(l->car, ctx))
+	return true;
+    return false;
+  }
+
+  void escape_analysis(const procedure_ptr& proc)
+  {
+    try {
+      proc->set_code(rewrite_list(proc->code, *proc->ctx));
+      proc->stack_frame = !captures(proc->code, *proc->ctx);
+    } catch (const std::exception&) {
+      // malformed code: leave it for eval to complain about
+    }
+  }
+}
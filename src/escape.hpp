@@ -0,0 +1,31 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_ESCAPE_HPP_INCLUDED
+#define LISP_ESCAPE_HPP_INCLUDED
+
+#include "dispatch.hpp"
+
+namespace lisp {
+
+  //
+  //  true if evaluating body could leave something holding on to the
+  //  scope it runs in: a closure that isn't flat, a nested defun, eval
+  //  of unknown code or a macro whose expansion we can't see yet.
+  //
+  bool captures(const variant& body, context& ctx);
+
+  //
+  //  Decide which frames of proc can live on the frame stack: its own,
+  //  and those of the lets inside it, which are rewritten to allocate
+  //  theirs there.  Lambdas have already been seen to by
+  //  closure_conversion.
+  //
+  void escape_analysis(const procedure_ptr& proc);
+}
+
+#endif
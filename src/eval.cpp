@@ -10,6 +10,7 @@
 #include "eval.hpp"
 #include "print.hpp"
 #include "backquote.hpp"
+#include "stack.hpp"
 
 #include <iostream>
 
@@ -17,6 +18,8 @@ namespace lisp
 {
   variant eval(context_ptr& ctx, const variant& v)
   {
+    if (stack_low())
+      stack_overflow();
     eval_visitor e(ctx);
     return boost::apply_visitor(e, v);
   }
@@ -35,7 +38,7 @@ namespace lisp
     return d;
   }
     
-  variant eval_visitor::operator()(const std::string& s)
+  variant eval_visitor::operator()(const string_ptr& s)
   {
     SHOW;
     return s;
@@ -58,7 +61,8 @@ namespace lisp
       return p;
     // ctx->dump(std::cout);
     variant v = visit(p->car);
-    function f = boost::get<function>(v);
+    // v keeps the function alive even if the call rebinds its name
+    function& f = boost::get<function>(v);
 
     return f(ctx, p->cdr);
   }
@@ -83,5 +87,50 @@ namespace lisp
     return s.v;
   }
 
+  variant eval_visitor::operator()(const array_ptr& a)
+  {
+    return a;
+  }
+
+  variant eval_visitor::operator()(const hash_table_ptr& h)
+  {
+    return h;
+  }
+
+  variant eval_visitor::operator()(const f64vector_ptr& f)
+  {
+    return f;
+  }
+
+  variant eval_visitor::operator()(const structure_ptr& s)
+  {
+    return s;
+  }
+
+  variant eval_visitor::operator()(const pmap_ptr& m)
+  {
+    return m;
+  }
+
+  variant eval_visitor::operator()(const pvector_ptr& p)
+  {
+    return p;
+  }
+
+  variant eval_visitor::operator()(const bitvector_ptr& b)
+  {
+    return b;
+  }
+
+  variant eval_visitor::operator()(const table_ptr& t)
+  {
+    return t;
+  }
+
+  variant eval_visitor::operator()(const lazy_seq_ptr& l)
+  {
+    return l;
+  }
+
 
 }
@@ -20,7 +20,7 @@ namespace lisp
     eval_visitor(context_ptr _ctx);
 
     variant operator()(double d);
-    variant operator()(const std::string& s);
+    variant operator()(const string_ptr& s);
     variant operator()(const symbol& s);
     variant operator()(const function& p);
     variant operator()(const cons_ptr& p);
@@ -28,6 +28,15 @@ namespace lisp
     variant operator()(const special<quoted_>& s);
     variant operator()(const special<comma_at_>& s);
     variant operator()(const special<comma_>& s);
+    variant operator()(const array_ptr& a);
+    variant operator()(const hash_table_ptr& h);
+    variant operator()(const f64vector_ptr& f);
+    variant operator()(const structure_ptr& s);
+    variant operator()(const pmap_ptr& m);
+    variant operator()(const pvector_ptr& p);
+    variant operator()(const bitvector_ptr& b);
+    variant operator()(const table_ptr& t);
+    variant operator()(const lazy_seq_ptr& l);
 
   private:
 
@@ -0,0 +1,27 @@
+;
+; the same sums over a vector of boxed numbers and over an f64vector;
+; run with lisp src/f64bench.lisp, the times go to stderr
+;
+
+(defun fill (v i n) (if (< i n) (progn (setf (aref v i) i) (fill v (+ i 1) n)) v))
+(defun boxed-sum (v i n acc)
+  (if (< i n) (boxed-sum v (+ i 1) n (+ acc (aref v i))) acc))
+(defun boxed-dot (v i n acc)
+  (if (< i n) (boxed-dot v (+ i 1) n (+ acc (* (aref v i) (aref v i)))) acc))
+
+(defvar n 200000)
+(defvar boxed (fill (make-array n 0) 0 n))
+(defvar v (make-f64vector boxed))
+
+(print (time (boxed-sum boxed 0 n 0)))
+(print (time (boxed-dot boxed 0 n 0)))
+
+(print (f64-kernels))
+(print (time (f64-sum v)))
+(print (time (f64-dot v v)))
+(print (time (f64-max (f64-prefix-sum v))))
+
+(f64-kernels 'scalar)
+(print (time (f64-sum v)))
+(print (time (f64-dot v v)))
+(print (time (f64-max (f64-prefix-sum v))))
@@ -0,0 +1,534 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "f64vector.hpp"
+#include "kernels.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+using boost::get;
+
+namespace lisp {
+
+  void intrusive_ptr_add_ref(f64vector* v)
+  {
+    v->count++;
+  }
+
+  void intrusive_ptr_release(f64vector* v)
+  {
+    v->count--;
+    if (v->count == 0)
+      delete v;
+  }
+
+  namespace {
+
+    //
+    //  The loops behind the f64- builtins, a set for each instruction
+    //  set we know (see kernels.hpp for which one runs).  The SIMD
+    //  loops keep several sums going at once and finish the last
+    //  few elements one at a time, so n can be anything; min and max
+    //  want n > 0.
+    //
+    struct kernel_set
+    {
+      const char* name;
+      double (*sum)(const double* a, std::size_t n);
+      double (*dot)(const double* a, const double* b, std::size_t n);
+      double (*min)(const double* a, std::size_t n);
+      double (*max)(const double* a, std::size_t n);
+      void (*add)(const double* a, const double* b, double* out, std::size_t n);
+      void (*mul)(const double* a, const double* b, double* out, std::size_t n);
+      void (*scale)(const double* a, double k, double* out, std::size_t n);
+      // out[i] is the sum of a[0] through a[i]
+      void (*prefix_sum)(const double* a, double* out, std::size_t n);
+      bool (*supported)();
+    };
+
+    double sum_scalar(const double* a, std::size_t n)
+    {
+      double s = 0;
+      for (std::size_t i = 0; i < n; i++)
+	s += a[i];
+      return s;
+    }
+
+    double dot_scalar(const double* a, const double* b, std::size_t n)
+    {
+      double s = 0;
+      for (std::size_t i = 0; i < n; i++)
+	s += a[i] * b[i];
+      return s;
+    }
+
+    double min_scalar(const double* a, std::size_t n)
+    {
+      double m = a[0];
+      for (std::size_t i = 1; i < n; i++)
+	m = a[i] < m ? a[i] : m;
+      return m;
+    }
+
+    double max_scalar(const double* a, std::size_t n)
+    {
+      double m = a[0];
+      for (std::size_t i = 1; i < n; i++)
+	m = a[i] > m ? a[i] : m;
+      return m;
+    }
+
+    void add_scalar(const double* a, const double* b, double* out, std::size_t n)
+    {
+      for (std::size_t i = 0; i < n; i++)
+	out[i] = a[i] + b[i];
+    }
+
+    void mul_scalar(const double* a, const double* b, double* out, std::size_t n)
+    {
+      for (std::size_t i = 0; i < n; i++)
+	out[i] = a[i] * b[i];
+    }
+
+    void scale_scalar(const double* a, double k, double* out, std::size_t n)
+    {
+      for (std::size_t i = 0; i < n; i++)
+	out[i] = a[i] * k;
+    }
+
+    void prefix_sum_scalar(const double* a, double* out, std::size_t n)
+    {
+      double s = 0;
+      for (std::size_t i = 0; i < n; i++)
+	out[i] = s += a[i];
+    }
+
+    const kernel_set scalar_kernels =
+      { "scalar", sum_scalar, dot_scalar, min_scalar, max_scalar,
+	add_scalar, mul_scalar, scale_scalar, prefix_sum_scalar, always };
+
+#ifdef USE_SIMD
+
+    //
+    //  SSE2: two doubles at a time
+    //
+    TARGET("sse2") double hsum128(__m128d x)
+    {
+      return _mm_cvtsd_f64(_mm_add_sd(x, _mm_unpackhi_pd(x, x)));
+    }
+
+    TARGET("sse2") double sum_sse2(const double* a, std::size_t n)
+    {
+      __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4)
+	{
+	  s0 = _mm_add_pd(s0, _mm_loadu_pd(a + i));
+	  s1 = _mm_add_pd(s1, _mm_loadu_pd(a + i + 2));
+	}
+      double s = hsum128(_mm_add_pd(s0, s1));
+      for (; i < n; i++)
+	s += a[i];
+      return s;
+    }
+
+    TARGET("sse2") double dot_sse2(const double* a, const double* b, std::size_t n)
+    {
+      __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4)
+	{
+	  s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+	  s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2),
+					 _mm_loadu_pd(b + i + 2)));
+	}
+      double s = hsum128(_mm_add_pd(s0, s1));
+      for (; i < n; i++)
+	s += a[i] * b[i];
+      return s;
+    }
+
+    TARGET("sse2") double min_sse2(const double* a, std::size_t n)
+    {
+      __m128d m = _mm_set1_pd(a[0]);
+      std::size_t i = 0;
+      for (; i + 2 <= n; i += 2)
+	m = _mm_min_pd(_mm_loadu_pd(a + i), m);
+      m = _mm_min_sd(_mm_unpackhi_pd(m, m), m);
+      double r = _mm_cvtsd_f64(m);
+      for (; i < n; i++)
+	r = a[i] < r ? a[i] : r;
+      return r;
+    }
+
+    TARGET("sse2") double max_sse2(const double* a, std::size_t n)
+    {
+      __m128d m = _mm_set1_pd(a[0]);
+      std::size_t i = 0;
+      for (; i + 2 <= n; i += 2)
+	m = _mm_max_pd(_mm_loadu_pd(a + i), m);
+      m = _mm_max_sd(_mm_unpackhi_pd(m, m), m);
+      double r = _mm_cvtsd_f64(m);
+      for (; i < n; i++)
+	r = a[i] > r ? a[i] : r;
+      return r;
+    }
+
+    TARGET("sse2") void add_sse2(const double* a, const double* b, double* out,
+				 std::size_t n)
+    {
+      std::size_t i = 0;
+      for (; i + 2 <= n; i += 2)
+	_mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+      for (; i < n; i++)
+	out[i] = a[i] + b[i];
+    }
+
+    TARGET("sse2") void mul_sse2(const double* a, const double* b, double* out,
+				 std::size_t n)
+    {
+      std::size_t i = 0;
+      for (; i + 2 <= n; i += 2)
+	_mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+      for (; i < n; i++)
+	out[i] = a[i] * b[i];
+    }
+
+    TARGET("sse2") void scale_sse2(const double* a, double k, double* out, std::size_t n)
+    {
+      __m128d kk = _mm_set1_pd(k);
+      std::size_t i = 0;
+      for (; i + 2 <= n; i += 2)
+	_mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), kk));
+      for (; i < n; i++)
+	out[i] = a[i] * k;
+    }
+
+    //
+    //  each pair becomes (x0, x0 + x1) by adding itself shifted up a
+    //  lane, then gets the running total so far added to both
+    //
+    TARGET("sse2") void prefix_sum_sse2(const double* a, double* out, std::size_t n)
+    {
+      __m128d total = _mm_setzero_pd();
+      std::size_t i = 0;
+      for (; i + 2 <= n; i += 2)
+	{
+	  __m128d x = _mm_loadu_pd(a + i);
+	  x = _mm_add_pd(x, _mm_unpacklo_pd(_mm_setzero_pd(), x));
+	  x = _mm_add_pd(x, total);
+	  _mm_storeu_pd(out + i, x);
+	  total = _mm_unpackhi_pd(x, x);
+	}
+      double s = _mm_cvtsd_f64(total);
+      for (; i < n; i++)
+	out[i] = s += a[i];
+    }
+
+    bool has_sse2() { return __builtin_cpu_supports("sse2"); }
+
+    const kernel_set sse2_kernels =
+      { "sse2", sum_sse2, dot_sse2, min_sse2, max_sse2,
+	add_sse2, mul_sse2, scale_sse2, prefix_sum_sse2, has_sse2 };
+
+    //
+    //  AVX: four at a time.  A prefix sum doesn't get much out of the
+    //  wider registers, as the lanes have to wait on each other, so
+    //  that one stays SSE2.
+    //
+    TARGET("avx") double hsum256(__m256d x)
+    {
+      __m128d h = _mm_add_pd(_mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1));
+      return _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+    }
+
+    TARGET("avx") double sum_avx(const double* a, std::size_t n)
+    {
+      __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+      std::size_t i = 0;
+      for (; i + 8 <= n; i += 8)
+	{
+	  s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+	  s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+	}
+      double s = hsum256(_mm256_add_pd(s0, s1));
+      for (; i < n; i++)
+	s += a[i];
+      return s;
+    }
+
+    TARGET("avx") double dot_avx(const double* a, const double* b, std::size_t n)
+    {
+      __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+      std::size_t i = 0;
+      for (; i + 8 <= n; i += 8)
+	{
+	  s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i),
+					       _mm256_loadu_pd(b + i)));
+	  s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4),
+					       _mm256_loadu_pd(b + i + 4)));
+	}
+      double s = hsum256(_mm256_add_pd(s0, s1));
+      for (; i < n; i++)
+	s += a[i] * b[i];
+      return s;
+    }
+
+    TARGET("avx") double min_avx(const double* a, std::size_t n)
+    {
+      __m256d m = _mm256_set1_pd(a[0]);
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4)
+	m = _mm256_min_pd(_mm256_loadu_pd(a + i), m);
+      __m128d h = _mm_min_pd(_mm256_castpd256_pd128(m), _mm256_extractf128_pd(m, 1));
+      double r = _mm_cvtsd_f64(_mm_min_sd(_mm_unpackhi_pd(h, h), h));
+      for (; i < n; i++)
+	r = a[i] < r ? a[i] : r;
+      return r;
+    }
+
+    TARGET("avx") double max_avx(const double* a, std::size_t n)
+    {
+      __m256d m = _mm256_set1_pd(a[0]);
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4)
+	m = _mm256_max_pd(_mm256_loadu_pd(a + i), m);
+      __m128d h = _mm_max_pd(_mm256_castpd256_pd128(m), _mm256_extractf128_pd(m, 1));
+      double r = _mm_cvtsd_f64(_mm_max_sd(_mm_unpackhi_pd(h, h), h));
+      for (; i < n; i++)
+	r = a[i] > r ? a[i] : r;
+      return r;
+    }
+
+    TARGET("avx") void add_avx(const double* a, const double* b, double* out,
+			       std::size_t n)
+    {
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4)
+	_mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i),
+						_mm256_loadu_pd(b + i)));
+      for (; i < n; i++)
+	out[i] = a[i] + b[i];
+    }
+
+    TARGET("avx") void mul_avx(const double* a, const double* b, double* out,
+			       std::size_t n)
+    {
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4)
+	_mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i),
+						_mm256_loadu_pd(b + i)));
+      for (; i < n; i++)
+	out[i] = a[i] * b[i];
+    }
+
+    TARGET("avx") void scale_avx(const double* a, double k, double* out, std::size_t n)
+    {
+      __m256d kk = _mm256_set1_pd(k);
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4)
+	_mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), kk));
+      for (; i < n; i++)
+	out[i] = a[i] * k;
+    }
+
+    bool has_avx() { return __builtin_cpu_supports("avx"); }
+
+    const kernel_set avx_kernels =
+      { "avx", sum_avx, dot_avx, min_avx, max_avx,
+	add_avx, mul_avx, scale_avx, prefix_sum_sse2, has_avx };
+
+#endif
+
+    // widest first
+    const kernel_set* const all_kernels[] =
+      {
+#ifdef USE_SIMD
+	&avx_kernels, &sse2_kernels,
+#endif
+	&scalar_kernels, 0
+      };
+
+    kernel_choice<kernel_set> kernels(all_kernels);
+
+    f64vector_ptr as_f64vector(const variant& v, const char* fn)
+    {
+      const f64vector_ptr* p = get<f64vector_ptr>(&v);
+      if (!p)
+	throw std::runtime_error(std::string(fn) + ": not an f64vector");
+      return *p;
+    }
+
+    double as_double(const variant& v, const char* fn)
+    {
+      const double* d = get<double>(&v);
+      if (!d)
+	throw std::runtime_error(std::string(fn) + ": not a number");
+      return *d;
+    }
+
+    // the two vectors of an elementwise builtin, which had better match
+    void operands(context_ptr& c, variant v, const char* fn,
+		  f64vector_ptr& a, f64vector_ptr& b)
+    {
+      a = as_f64vector(eval(c, v >> car), fn);
+      b = as_f64vector(eval(c, v >> cdr >> car), fn);
+      if (a->items.size() != b->items.size())
+	throw std::runtime_error(std::string(fn) + ": lengths differ");
+    }
+
+    // the one vector of a reduction, which for min and max can't be empty
+    f64vector_ptr operand(context_ptr& c, variant v, const char* fn,
+			  bool nonempty)
+    {
+      f64vector_ptr a = as_f64vector(eval(c, v >> car), fn);
+      if (nonempty && a->items.empty())
+	throw std::runtime_error(std::string(fn) + ": empty f64vector");
+      return a;
+    }
+  }
+
+  double& f64_place(const variant& vec, const variant& index)
+  {
+    f64vector_ptr a = as_f64vector(vec, "f64ref");
+    return a->items[as_index(index, a->items.size(), "f64ref")];
+  }
+
+  namespace ops {
+
+    //
+    //  (make-f64vector n [initial]), or (make-f64vector sequence) for
+    //  one holding the numbers in a list or vector
+    //
+    variant make_f64vector::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant what = eval(c, v >> car);
+      if (const double* d = get<double>(&what))
+	{
+	  if (*d < 0 || *d != std::floor(*d))
+	    throw std::runtime_error("make-f64vector: bad size");
+	  variant rest = v >> cdr;
+	  double initial = is_nil(rest) ? 0 : as_double(eval(c, rest >> car),
+							"make-f64vector");
+	  return f64vector_ptr(new f64vector(std::size_t(*d), initial));
+	}
+
+      std::vector<variant> items;
+      if (const array_ptr* a = get<array_ptr>(&what))
+	items = (*a)->items;
+      else
+	for (variant l = what; !is_nil(l); l = l >> cdr)
+	  items.push_back(l >> car);
+
+      f64vector_ptr r(new f64vector(items.size(), 0));
+      for (unsigned u = 0; u < items.size(); u++)
+	r->items[u] = as_double(items[u], "make-f64vector");
+      return r;
+    }
+
+    variant f64ref::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant vec = eval(c, v >> car);
+      return f64_place(vec, eval(c, v >> cdr >> car));
+    }
+
+    variant f64_sum::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      f64vector_ptr a = operand(c, v, "f64-sum", false);
+      return kernels->sum(data(a->items), a->items.size());
+    }
+
+    variant f64_dot::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      f64vector_ptr a, b;
+      operands(c, v, "f64-dot", a, b);
+      return kernels->dot(data(a->items), data(b->items), a->items.size());
+    }
+
+    variant f64_min::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      f64vector_ptr a = operand(c, v, "f64-min", true);
+      return kernels->min(data(a->items), a->items.size());
+    }
+
+    variant f64_max::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      f64vector_ptr a = operand(c, v, "f64-max", true);
+      return kernels->max(data(a->items), a->items.size());
+    }
+
+    //
+    //  the elementwise ones return a new vector and leave their
+    //  arguments alone
+    //
+    variant f64_add::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      f64vector_ptr a, b;
+      operands(c, v, "f64-add", a, b);
+      f64vector_ptr r(new f64vector(a->items.size(), 0));
+      kernels->add(data(a->items), data(b->items), data(r->items), a->items.size());
+      return r;
+    }
+
+    variant f64_mul::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      f64vector_ptr a, b;
+      operands(c, v, "f64-mul", a, b);
+      f64vector_ptr r(new f64vector(a->items.size(), 0));
+      kernels->mul(data(a->items), data(b->items), data(r->items), a->items.size());
+      return r;
+    }
+
+    // (f64-scale v k)
+    variant f64_scale::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      f64vector_ptr a = operand(c, v, "f64-scale", false);
+      double k = as_double(eval(c, v >> cdr >> car), "f64-scale");
+      f64vector_ptr r(new f64vector(a->items.size(), 0));
+      kernels->scale(data(a->items), k, data(r->items), a->items.size());
+      return r;
+    }
+
+    variant f64_prefix_sum::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      f64vector_ptr a = operand(c, v, "f64-prefix-sum", false);
+      f64vector_ptr r(new f64vector(a->items.size(), 0));
+      kernels->prefix_sum(data(a->items), data(r->items), a->items.size());
+      return r;
+    }
+
+    //
+    //  (f64-kernels) names the loops the f64- builtins run;
+    //  (f64-kernels 'scalar), 'sse2 or 'avx switches to others, if
+    //  this CPU has them, to compare or to check one against another
+    //
+    variant f64_kernels::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      if (!is_nil(v))
+	kernels.use(eval(c, v >> car), "f64-kernels");
+      return symbol(kernels->name);
+    }
+  }
+}
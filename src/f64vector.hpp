@@ -0,0 +1,38 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_F64VECTOR_HPP_INCLUDED
+#define LISP_F64VECTOR_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <vector>
+
+namespace lisp {
+
+  //
+  //  make-f64vector: doubles stored as they are, not one variant
+  //  apiece, so the f64- builtins can run over them in SIMD loops
+  //  (see f64vector.cpp).
+  //
+  struct f64vector : boost::noncopyable
+  {
+    unsigned count;
+    std::vector<double> items;
+
+    f64vector(std::size_t n, double initial)
+      : count(0), items(n, initial)
+    { }
+  };
+
+  // the element (f64ref vec index) refers to, for setf
+  double& f64_place(const variant& vec, const variant& index);
+}
+
+#endif
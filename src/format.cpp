@@ -0,0 +1,366 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "print.hpp"
+#include "strings.hpp"
+#include "format.hpp"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+using boost::get;
+
+namespace lisp {
+
+  //
+  //  Runs of plain text, ~% and ~~ included, are one directive each;
+  //  a ~{ knows where its ~} is.
+  //
+  struct format_program
+  {
+    struct directive
+    {
+      char kind;          // 0 for text, else one of a s d f { }
+      std::string text;
+      int params[2];      // ~w,dF and the like; -1 if not given
+      std::size_t end;    // for ~{, the index of its ~}
+    };
+
+    std::vector<directive> code;
+  };
+
+  namespace {
+
+    typedef format_program::directive directive;
+
+    // widths and digits past this are surely mistakes
+    const int max_param = 10000;
+
+    directive make_directive(char kind)
+    {
+      directive d;
+      d.kind = kind;
+      d.params[0] = d.params[1] = -1;
+      d.end = 0;
+      return d;
+    }
+
+    void flush_text(format_program& program, std::string& text)
+    {
+      if (text.empty())
+	return;
+      directive d = make_directive(0);
+      d.text.swap(text);
+      program.code.push_back(d);
+    }
+  }
+
+  format_program_ptr compile_format(const std::string& control)
+  {
+    boost::shared_ptr<format_program> program(new format_program);
+    std::vector<std::size_t> open;
+    std::string text;
+    for (std::size_t i = 0; i < control.size(); i++)
+      {
+	if (control[i] != '~')
+	  {
+	    text += control[i];
+	    continue;
+	  }
+
+	directive d = make_directive(0);
+	for (unsigned p = 0; ++i < control.size(); )
+	  {
+	    unsigned char c = control[i];
+	    if (std::isdigit(c))
+	      {
+		int n = (d.params[p] < 0 ? 0 : d.params[p]) * 10 + (c - '0');
+		if (n > max_param)
+		  throw std::runtime_error("format: a directive parameter is too big");
+		d.params[p] = n;
+	      }
+	    else if (c == ',' && p == 0)
+	      p = 1;
+	    else
+	      break;
+	  }
+	if (i == control.size())
+	  throw std::runtime_error("format: control string ends in the middle of a directive");
+
+	char kind = std::tolower(static_cast<unsigned char>(control[i]));
+	switch (kind)
+	  {
+	  case '%':
+	    text += '\n';
+	    continue;
+	  case '~':
+	    text += '~';
+	    continue;
+	  case 'a': case 's': case 'd': case 'f': case '{':
+	    break;
+	  case '}':
+	    if (open.empty())
+	      throw std::runtime_error("format: ~} without ~{");
+	    break;
+	  default:
+	    throw std::runtime_error(std::string("format: unknown directive ~") + control[i]);
+	  }
+
+	flush_text(*program, text);
+	d.kind = kind;
+	if (kind == '{')
+	  open.push_back(program->code.size());
+	if (kind == '}')
+	  {
+	    program->code[open.back()].end = program->code.size();
+	    open.pop_back();
+	  }
+	program->code.push_back(d);
+      }
+    if (!open.empty())
+      throw std::runtime_error("format: ~{ without ~}");
+    flush_text(*program, text);
+    return program;
+  }
+
+  namespace {
+
+    // a streambuf that adds what is written to the end of a string
+    class append_buf : public std::streambuf
+    {
+    public:
+      append_buf(std::string& s) : s_(s) { }
+
+    protected:
+      int_type overflow(int_type c)
+      {
+	if (!traits_type::eq_int_type(c, traits_type::eof()))
+	  s_ += traits_type::to_char_type(c);
+	return traits_type::not_eof(c);
+      }
+
+      std::streamsize xsputn(const char* p, std::streamsize n)
+      {
+	s_.append(p, n);
+	return n;
+      }
+
+    private:
+      std::string& s_;
+    };
+
+    //
+    //  Runs a program, writing straight onto the end of out: text is
+    //  copied over, numbers are printed into a buffer on the stack,
+    //  and only what print has to do goes through an ostream.
+    //
+    struct formatter
+    {
+      const format_program& program;
+      std::string& out;
+
+      formatter(const format_program& p, std::string& o) : program(p), out(o) { }
+
+      const variant& next_arg(const std::vector<variant>& args, std::size_t& next)
+      {
+	if (next == args.size())
+	  throw std::runtime_error("format: not enough arguments");
+	return args[next++];
+      }
+
+      // pads what was written since from out to width
+      void pad(std::size_t from, int width, bool left)
+      {
+	std::size_t written = out.size() - from;
+	if (width < 0 || written >= std::size_t(width))
+	  return;
+	out.insert(left ? out.begin() + from : out.end(), width - written, ' ');
+      }
+
+      void number(const char* fmt, double d)
+      {
+	char buf[64];
+	int n = std::snprintf(buf, sizeof buf, fmt, d);
+	out.append(buf, n < int(sizeof buf) ? n : sizeof buf - 1);
+      }
+
+      // ~a without the quotes, ~s as print would
+      void value(const variant& v, bool readably)
+      {
+	const std::string* s = readably ? 0 : string_chars(v);
+	const double* d = get<double>(&v);
+	if (s)
+	  out += *s;
+	else if (d)
+	  number("%g", *d);
+	else
+	  {
+	    append_buf buf(out);
+	    std::ostream os(&buf);
+	    print(os, v);
+	  }
+      }
+
+      void fixed(double d, int digits)
+      {
+	if (digits >= 0)
+	  {
+	    char buf[400];
+	    int n = std::snprintf(buf, sizeof buf, "%.*f", digits > 60 ? 60 : digits, d);
+	    out.append(buf, n < int(sizeof buf) ? n : sizeof buf - 1);
+	    return;
+	  }
+	// as many digits as it takes, but at least one after the point
+	std::size_t from = out.size();
+	char buf[400];
+	int n = std::snprintf(buf, sizeof buf, "%f", d);
+	out.append(buf, n < int(sizeof buf) ? n : sizeof buf - 1);
+	std::size_t point = out.find('.', from);
+	if (point == std::string::npos)
+	  return;
+	std::size_t last = out.find_last_not_of('0');
+	out.erase(last == point ? point + 2 : last + 1);
+      }
+
+      // runs code[from, to) on what's left of args
+      void run(std::size_t from, std::size_t to,
+	       const std::vector<variant>& args, std::size_t& next)
+      {
+	for (std::size_t i = from; i < to; i++)
+	  {
+	    const directive& d = program.code[i];
+	    std::size_t start = out.size();
+	    switch (d.kind)
+	      {
+	      case 0:
+		out += d.text;
+		break;
+	      case 'a':
+	      case 's':
+		value(next_arg(args, next), d.kind == 's');
+		pad(start, d.params[0], false);
+		break;
+	      case 'd':
+		{
+		  const variant& x = next_arg(args, next);
+		  const double* n = get<double>(&x);
+		  if (n && *n == std::floor(*n) && std::fabs(*n) < 1e18)
+		    number("%.0f", *n);
+		  else
+		    value(x, false);
+		  pad(start, d.params[0], true);
+		}
+		break;
+	      case 'f':
+		{
+		  const variant& x = next_arg(args, next);
+		  const double* n = get<double>(&x);
+		  if (!n)
+		    throw std::runtime_error("format: ~f of something that isn't a number");
+		  fixed(*n, d.params[1]);
+		  pad(start, d.params[0], true);
+		}
+		break;
+	      case '{':
+		{
+		  std::vector<variant> items;
+		  const cons_ptr* l = get<cons_ptr>(&next_arg(args, next));
+		  if (!l)
+		    throw std::runtime_error("format: ~{ of something that isn't a list");
+		  for (cons_ptr p = *l; p; p = get<cons_ptr>(p->cdr))
+		    items.push_back(p->car);
+		  std::size_t item = 0;
+		  while (item < items.size())
+		    {
+		      std::size_t before = item;
+		      run(i + 1, d.end, items, item);
+		      // a body that takes nothing would go round forever
+		      if (item == before)
+			break;
+		    }
+		  i = d.end;
+		}
+		break;
+	      }
+	  }
+      }
+    };
+
+    //
+    //  (format dest control arg...) once control has been compiled:
+    //  the text is made and returned for dest nil, written to
+    //  standard output for t, or added to a string output stream
+    //
+    variant run_format(context_ptr& c, const format_program& program,
+		       const variant& dest, variant v)
+    {
+      std::vector<variant> args;
+      for (; !is_nil(v); v = v >> cdr)
+	args.push_back(eval(c, v >> car));
+      std::size_t next = 0;
+
+      if (dest == nil)
+	{
+	  std::string text;
+	  formatter(program, text).run(0, program.code.size(), args, next);
+	  return adopt_string(text);
+	}
+      if (dest == t)
+	{
+	  // nothing in a run evaluates anything, so the one will do
+	  static std::string text;
+	  text.clear();
+	  formatter(program, text).run(0, program.code.size(), args, next);
+	  std::cout.write(text.data(), text.size());
+	  return nil;
+	}
+      if (std::string* text = output_buffer(dest))
+	{
+	  formatter(program, *text).run(0, program.code.size(), args, next);
+	  return nil;
+	}
+      throw std::runtime_error("format: the destination is nil, t or a string output stream");
+    }
+
+    // for calls whose control string analysis hasn't seen
+    string_keyed_cache<format_program> programs(compile_format);
+  }
+
+  namespace ops {
+
+    variant format::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant dest = eval(c, v >> car);
+      variant control = eval(c, v >> cdr >> car);
+      const string_ptr* s = get<string_ptr>(&control);
+      if (!s)
+	throw std::runtime_error("format: the control string isn't a string");
+      // evaluating the arguments may run a format that takes the slot
+      format_program_ptr program = programs(*s);
+      return run_format(c, *program, dest, v >> cdr >> cdr);
+    }
+
+    variant compiled_format::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant dest = eval(c, v >> car);
+      return run_format(c, *program, dest, v >> cdr >> cdr);
+    }
+  }
+}
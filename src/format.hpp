@@ -0,0 +1,44 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_FORMAT_HPP_INCLUDED
+#define LISP_FORMAT_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <string>
+
+namespace lisp {
+
+  //
+  //  A control string taken apart into the pieces of text and the
+  //  directives between them, so that running it is a walk down a
+  //  vector.  See format.cpp.
+  //
+  struct format_program;
+  typedef boost::shared_ptr<const format_program> format_program_ptr;
+
+  // throws if control has a directive we don't know
+  format_program_ptr compile_format(const std::string& control);
+
+  namespace ops {
+
+    //
+    //  format, at a call site whose control string analysis found
+    //  was a literal and compiled once and for all (see inline.cpp).
+    //  The control string is still there in the arguments, unread.
+    //
+    struct compiled_format
+    {
+      format_program_ptr program;
+      variant operator()(context_ptr, variant);
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,334 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "stack.hpp"
+#include "generator.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef USE_FAST_SWITCH
+#include <ucontext.h>
+#endif
+
+using boost::get;
+
+#ifdef USE_FAST_SWITCH
+
+//
+//  Saves the registers a callee must keep on the stack we're on,
+//  with the SSE and x87 control words (the rounding mode and the
+//  like are callee-saved too), leaves its stack pointer in *from,
+//  and carries on from to, which an earlier switch left behind.  A
+//  new stack starts out looking as if it had been switched away from
+//  just before the first instruction of its function.
+//
+extern "C" void lisp_switch_stack(void** from, void* to);
+
+asm(".pushsection .text\n"
+    ".globl lisp_switch_stack\n"
+    ".type lisp_switch_stack, @function\n"
+    "lisp_switch_stack:\n"
+    "\tpushq %rbp\n"
+    "\tpushq %rbx\n"
+    "\tpushq %r12\n"
+    "\tpushq %r13\n"
+    "\tpushq %r14\n"
+    "\tpushq %r15\n"
+    "\tleaq -8(%rsp), %rsp\n"
+    "\tstmxcsr (%rsp)\n"
+    "\tfnstcw 4(%rsp)\n"
+    "\tmovq %rsp, (%rdi)\n"
+    "\tmovq %rsi, %rsp\n"
+    "\tldmxcsr (%rsp)\n"
+    "\tfldcw 4(%rsp)\n"
+    "\tleaq 8(%rsp), %rsp\n"
+    "\tpopq %r15\n"
+    "\tpopq %r14\n"
+    "\tpopq %r13\n"
+    "\tpopq %r12\n"
+    "\tpopq %rbx\n"
+    "\tpopq %rbp\n"
+    "\tret\n"
+    ".size lisp_switch_stack, .-lisp_switch_stack\n"
+    ".popsection\n");
+
+#endif
+
+namespace lisp {
+
+  namespace {
+
+    // reserved, and only committed as it is touched
+    const std::size_t stack_size = 16 * 1024 * 1024;
+
+    // what's left when stack_low() says stop: enough to throw
+    const std::size_t margin = 256 * 1024;
+
+    // stacks of generators that are gone, for the next ones
+    std::vector<char*> spare_stacks;
+
+    const unsigned max_spare_stacks = 16;
+
+    char* new_stack()
+    {
+      if (!spare_stacks.empty())
+	{
+	  char* s = spare_stacks.back();
+	  spare_stacks.pop_back();
+	  return s;
+	}
+      void* p = mmap(0, stack_size, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (p == MAP_FAILED)
+	throw std::runtime_error("make-generator: can't reserve a stack");
+      // running off the end faults rather than scribbling on the heap
+      mprotect(p, sysconf(_SC_PAGESIZE), PROT_NONE);
+      return static_cast<char*>(p);
+    }
+
+    void free_stack(char* s)
+    {
+      if (spare_stacks.size() < max_spare_stacks)
+	spare_stacks.push_back(s);
+      else
+	munmap(s, stack_size);
+    }
+
+    // thrown out of yield to unwind a generator nobody wants any more
+    struct unwind { };
+  }
+
+  //
+  //  What a generator needs to run on its stack, and whatever was
+  //  running before it to go back to.  Nothing is allocated to switch
+  //  either way.
+  //
+  struct generator::coroutine
+  {
+    char* stack;
+    frame_arena* arena;
+    unsigned depth;
+#ifdef USE_FAST_SWITCH
+    void* sp;
+    void* caller_sp;
+#else
+    ucontext_t self, caller;
+#endif
+
+    coroutine() : stack(new_stack()), arena(new_frame_arena()), depth(0)
+    {
+#ifdef USE_FAST_SWITCH
+      void** top = reinterpret_cast<void**>(stack + stack_size);
+      *--top = 0;                         // where run would return to
+      *--top = reinterpret_cast<void*>(&generator::run);
+      for (unsigned u = 0; u < 6; u++)    // rbp, rbx, r12 to r15
+	*--top = 0;
+      // the control words it starts with are the ones we have now
+      *--top = 0;
+      asm volatile("stmxcsr (%0)\n\tfnstcw 4(%0)" : : "r"(top) : "memory");
+      sp = top;
+#else
+      getcontext(&self);
+      self.uc_stack.ss_sp = stack;
+      self.uc_stack.ss_size = stack_size;
+      self.uc_link = 0;
+      makecontext(&self, &generator::run, 0);
+#endif
+    }
+
+    ~coroutine()
+    {
+      delete_frame_arena(arena);
+      free_stack(stack);
+    }
+  };
+
+  generator* generator::current = 0;
+
+  generator::generator(const function& f, const context_ptr& c)
+    : f_(f), c_(c), status_(fresh), unwinding_(false), failed_(false), co_(0)
+  { }
+
+  generator::~generator()
+  {
+    if (status_ == suspended)
+      {
+	unwinding_ = true;
+	variant ignored;
+	try {
+	  resume(ignored);
+	} catch (const std::exception&) { }
+      }
+    delete co_;
+  }
+
+  //
+  //  Runs on the generator's own stack, and never returns: there is
+  //  nothing to return to.  Exceptions can't leave the stack either,
+  //  so they are carried over to resume by hand.
+  //
+  void generator::run()
+  {
+    generator* g = current;
+    try {
+      context_ptr c = g->c_;
+      variant args = nil;
+      g->f_(c, args);
+    } catch (const unwind&) {
+    } catch (const std::exception& e) {
+      g->failed_ = true;
+      g->error_ = e.what();
+    } catch (...) {
+      g->failed_ = true;
+      g->error_ = "generator: unknown exception";
+    }
+    g->status_ = finished;
+    g->switch_out();
+  }
+
+  void generator::switch_in()
+  {
+#ifdef USE_FAST_SWITCH
+    lisp_switch_stack(&co_->caller_sp, co_->sp);
+#else
+    swapcontext(&co_->caller, &co_->self);
+#endif
+  }
+
+  void generator::switch_out()
+  {
+#ifdef USE_FAST_SWITCH
+    lisp_switch_stack(&co_->sp, co_->caller_sp);
+#else
+    swapcontext(&co_->self, &co_->caller);
+#endif
+  }
+
+  bool generator::resume(variant& out)
+  {
+    if (status_ == running)
+      throw std::runtime_error("next: generator is already running");
+    if (status_ == finished)
+      return false;
+    if (!co_)
+      co_ = new coroutine;
+
+    // the depth, stack and arena are all the generator's while it runs
+    unsigned depth = depth_guard::depth();
+    char* limit = stack_limit;
+    frame_arena* arena = use_frame_arena(co_->arena);
+    generator* outer = current;
+    depth_guard::set_depth(co_->depth);
+    stack_limit = co_->stack + margin;
+    current = this;
+    status_ = running;
+
+    switch_in();
+
+    current = outer;
+    co_->depth = depth_guard::depth();
+    depth_guard::set_depth(depth);
+    stack_limit = limit;
+    use_frame_arena(arena);
+
+    if (failed_)
+      {
+	failed_ = false;
+	throw std::runtime_error(error_);
+      }
+    if (status_ == finished)
+      return false;
+    out = value_;
+    value_ = nil;
+    return true;
+  }
+
+  void generator::yield(const variant& x)
+  {
+    generator* g = current;
+    if (!g)
+      throw std::runtime_error("yield: not in a generator");
+    g->value_ = x;
+    g->status_ = suspended;
+    g->switch_out();
+    if (g->unwinding_)
+      throw unwind();
+  }
+
+  namespace {
+
+    class generator_cursor : public cursor
+    {
+    public:
+      generator_cursor(generator* g) : keep_(g), g_(g) { }
+
+      bool next(context_ptr&, variant& out)
+      {
+	return g_->resume(out);
+      }
+
+    private:
+      lazy_seq_ptr keep_;
+      generator* g_;
+    };
+  }
+
+  cursor_ptr generator::start() const
+  {
+    return cursor_ptr(new generator_cursor(const_cast<generator*>(this)));
+  }
+
+  namespace ops {
+
+    // (make-generator f): a generator running f, a function of no arguments
+    variant make_generator::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant f = eval(c, v >> car);
+      const function* p = get<function>(&f);
+      if (!p)
+	throw std::runtime_error("make-generator: not a function");
+      return lazy_seq_ptr(new generator(*p, c->persistent()));
+    }
+
+    // (yield x): hands x to the next that resumed us, and waits for another
+    variant yield::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      generator::yield(eval(c, v >> car));
+      return nil;
+    }
+
+    //
+    //  (next gen) or (next gen default): the next value gen yields;
+    //  once it has finished, default, or nil without one
+    //
+    variant next::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant g = eval(c, v >> car);
+      const lazy_seq_ptr* l = get<lazy_seq_ptr>(&g);
+      generator* gen = l ? dynamic_cast<generator*>(l->get()) : 0;
+      if (!gen)
+	throw std::runtime_error("next: not a generator");
+      variant out;
+      if (gen->resume(out))
+	return out;
+      variant rest = v >> cdr;
+      return is_nil(rest) ? nil : eval(c, rest >> car);
+    }
+  }
+}
@@ -0,0 +1,63 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_GENERATOR_HPP_INCLUDED
+#define LISP_GENERATOR_HPP_INCLUDED
+
+#include "types.hpp"
+#include "lazy.hpp"
+
+#include <string>
+
+namespace lisp {
+
+  //
+  //  make-generator: a function of no arguments that runs on a stack
+  //  of its own, a bit at a time.  Each next runs it until it yields
+  //  a value, and leaves it there until the one after; when it returns
+  //  there are no more.  It is a lazy sequence too, but one that can
+  //  only be gone through once, since what it has handed out is gone.
+  //
+  class generator : public lazy_seq
+  {
+  public:
+    generator(const function& f, const context_ptr& c);
+    // one that hasn't finished is unwound first, out of its yield
+    ~generator();
+
+    // the next value yielded in out, or false once f has returned
+    bool resume(variant& out);
+
+    // hands x to whoever resumed the generator that is running now
+    static void yield(const variant& x);
+
+    cursor_ptr start() const;
+    const char* name() const { return "generator"; }
+
+    struct coroutine;
+
+  private:
+    enum status_t { fresh, suspended, running, finished };
+
+    function f_;
+    context_ptr c_;
+    status_t status_;
+    bool unwinding_;
+    variant value_;
+    bool failed_;
+    std::string error_;
+    coroutine* co_;
+
+    static generator* current;
+
+    static void run();
+    void switch_in();
+    void switch_out();
+  };
+}
+
+#endif
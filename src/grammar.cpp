@@ -31,6 +31,7 @@
 #include "print.hpp"
 #include "dot.hpp"
 #include "grammar.hpp"
+#include "bitvector.hpp"
 
 using namespace boost::spirit;
 using namespace boost::spirit::qi;
@@ -90,6 +91,48 @@ namespace lisp
     phoenix::function<make_cons_actor> make_cons;
   }
 
+  // #(...)
+  struct make_array_actor : variant_maker
+  {
+    variant operator()(const std::vector<variant>& v) const
+    {
+      return array_ptr(new array(v));
+    }
+  };
+
+  namespace 
+  {
+    phoenix::function<make_array_actor> make_array;
+  }
+
+  // #*0101
+  struct make_bit_vector_actor : variant_maker
+  {
+    variant operator()(const std::vector<char>& v) const
+    {
+      return bitvector_ptr(new bitvector(std::string(v.begin(), v.end())));
+    }
+  };
+
+  namespace 
+  {
+    phoenix::function<make_bit_vector_actor> make_bit_vector;
+  }
+
+  // "..."
+  struct make_string_actor : variant_maker
+  {
+    variant operator()(const std::vector<char>& v) const
+    {
+      return make_string(std::string(v.begin(), v.end()));
+    }
+  };
+
+  namespace 
+  {
+    phoenix::function<make_string_actor> make_string_literal;
+  }
+
   template <typename T>
   struct sugar_ : variant_maker
   {
@@ -165,13 +208,16 @@ namespace lisp
       | ",@" >> sexpr                [ _val = comma_at(_1)     ]
       | "," >> sexpr                 [ _val = comma(_1)        ]  
       | cons                         [ _val = _1               ]
+      | bit_vector                   [ _val = _1               ]
+      | simple_vector                [ _val = _1               ]
       | ( char_("(") >> ( +sexpr )   [ _val = make_list(_1)    ]
           > char_(")"))
       ;
       
     identifier = 
       lexeme[
-	     +(alnum | char_("+") | char_("-") | char_("*") | char_("/"))
+	     +(alnum | char_("+") | char_("-") | char_("*") | char_("/")
+	       | char_("<") | char_(">") | char_("="))
 	     ]
       [ 
        _val = construct<symbol>(_1) 
@@ -182,7 +228,7 @@ namespace lisp
 
     quoted_string = 
       lexeme[ '"' >> *escaped_char >> '"' ]
-      [ _val = construct<std::string>(&front(_1), size(_1)) ]
+      [ _val = make_string_literal(_1) ]
       ;
 
     atom %=
@@ -192,6 +238,16 @@ namespace lisp
       | quoted_string
       ;
       
+    simple_vector =
+      ( lit("#(") >> ( *sexpr )      [ _val = make_array(_1)   ]
+        > char_(")"))
+      ;
+
+    bit_vector =
+      lexeme[ lit("#*") >> *char_("01") ]
+      [ _val = make_bit_vector(_1) ]
+      ;
+
     nil = 
       ((char_("(") >> char_(")")) | "NIL" | "nil") [ _val = val(::lisp::nil) ];
 
@@ -212,6 +268,8 @@ namespace lisp
 	identifier.name("identifier");
 	cons.name("cons");
 	quoted_string.name("quoted_string");
+	simple_vector.name("simple_vector");
+	bit_vector.name("bit_vector");
 	start.name("start");
 	escaped_char.name("escaped_char");
 
@@ -221,6 +279,8 @@ namespace lisp
 	debug(identifier);
 	debug(cons);
 	debug(quoted_string);
+	debug(simple_vector);
+	debug(bit_vector);
 	debug(start);
 	debug(escaped_char);
       }
@@ -67,7 +67,8 @@ namespace lisp
     interpreter(bool _show_debug);
     
     qi::rule<Iterator, variant(), white_space<Iterator> > 
-    start, atom, sexpr, identifier, nil, cons, quoted_string;
+    start, atom, sexpr, identifier, nil, cons, quoted_string, simple_vector,
+    bit_vector;
 
     qi::rule<Iterator, char()> escaped_char;
 
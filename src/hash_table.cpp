@@ -0,0 +1,226 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "equal.hpp"
+#include "hash_table.hpp"
+
+#include <stdexcept>
+#include <string>
+
+using boost::get;
+
+namespace lisp {
+
+  void intrusive_ptr_add_ref(hash_table* h)
+  {
+    h->count++;
+  }
+
+  void intrusive_ptr_release(hash_table* h)
+  {
+    h->count--;
+    if (h->count == 0)
+      delete h;
+  }
+
+  hash_table::hash_table(test t)
+    : count(0), test_(t), hashes_(8, std::size_t(empty)), slots_(8),
+      size_(0), occupied_(0)
+  { }
+
+  std::size_t hash_table::hash(const variant& key) const
+  {
+    std::size_t h = test_ == eq_test ? identity_hash(key) : structural_hash(key);
+    return h < 2 ? h + 2 : h;
+  }
+
+  bool hash_table::same(const variant& lhs, const variant& rhs) const
+  {
+    return test_ == eq_test ? identical(lhs, rhs) : structurally_equal(lhs, rhs);
+  }
+
+  // the slot holding key, or the empty one where the probe ended
+  std::size_t hash_table::probe(const variant& key, std::size_t h) const
+  {
+    std::size_t mask = hashes_.size() - 1;
+    std::size_t i = h & mask;
+    while (hashes_[i] != empty)
+      {
+	if (hashes_[i] == h && same(slots_[i].first, key))
+	  return i;
+	i = (i + 1) & mask;
+      }
+    return i;
+  }
+
+  const variant* hash_table::find(const variant& key) const
+  {
+    std::size_t i = probe(key, hash(key));
+    return hashes_[i] == empty ? 0 : &slots_[i].second;
+  }
+
+  void hash_table::put(const variant& key, const variant& value)
+  {
+    std::size_t h = hash(key);
+    std::size_t i = probe(key, h);
+    if (hashes_[i] != empty)
+      {
+	slots_[i].second = value;
+	return;
+      }
+    hashes_[i] = h;
+    slots_[i] = std::make_pair(key, value);
+    size_++;
+    occupied_++;
+    // keep the load, removed slots included, under 3/4
+    if (occupied_ * 4 > hashes_.size() * 3)
+      rehash(size_ * 2 > hashes_.size() ? hashes_.size() * 2 : hashes_.size());
+  }
+
+  bool hash_table::remove(const variant& key)
+  {
+    std::size_t i = probe(key, hash(key));
+    if (hashes_[i] == empty)
+      return false;
+    hashes_[i] = removed;
+    slots_[i] = std::make_pair(nil, nil);
+    size_--;
+    return true;
+  }
+
+  void hash_table::entries(std::vector<std::pair<variant, variant> >& out) const
+  {
+    for (std::size_t i = 0; i < hashes_.size(); i++)
+      if (hashes_[i] > removed)
+	out.push_back(slots_[i]);
+  }
+
+  void hash_table::rehash(std::size_t capacity)
+  {
+    std::vector<std::size_t> hashes(capacity, std::size_t(empty));
+    std::vector<std::pair<variant, variant> > slots(capacity);
+    std::size_t mask = capacity - 1;
+    for (std::size_t i = 0; i < hashes_.size(); i++)
+      if (hashes_[i] > removed)
+	{
+	  std::size_t j = hashes_[i] & mask;
+	  while (hashes[j] != empty)
+	    j = (j + 1) & mask;
+	  hashes[j] = hashes_[i];
+	  slots[j] = slots_[i];
+	}
+    hashes_.swap(hashes);
+    slots_.swap(slots);
+    occupied_ = size_;
+  }
+
+  namespace ops {
+
+    namespace {
+
+      hash_table_ptr as_table(const variant& v, const char* fn)
+      {
+	const hash_table_ptr* h = get<hash_table_ptr>(&v);
+	if (!h)
+	  throw std::runtime_error(std::string(fn) + ": not a hash table");
+	return *h;
+      }
+    }
+
+    //
+    //  (make-hash-table ['eq | 'equal]), eq by default
+    //
+    variant make_hash_table::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      hash_table::test test = hash_table::eq_test;
+      if (!is_nil(v))
+	{
+	  variant name = eval(c, v >> car);
+	  const symbol* s = get<symbol>(&name);
+	  if (s && *s == "equal")
+	    test = hash_table::equal_test;
+	  else if (!s || *s != "eq")
+	    throw std::runtime_error("make-hash-table: the test is eq or equal");
+	}
+      return hash_table_ptr(new hash_table(test));
+    }
+
+    //
+    //  (gethash key table [default])
+    //
+    variant gethash::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant key = eval(c, v >> car);
+      hash_table_ptr table = as_table(eval(c, v >> cdr >> car), "gethash");
+      if (const variant* found = table->find(key))
+	return *found;
+      variant rest = v >> cdr >> cdr;
+      return is_nil(rest) ? nil : eval(c, rest >> car);
+    }
+
+    //
+    //  (puthash key value table)
+    //
+    variant puthash::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant key = eval(c, v >> car);
+      variant value = eval(c, v >> cdr >> car);
+      as_table(eval(c, v >> cdr >> cdr >> car), "puthash")->put(key, value);
+      return value;
+    }
+
+    variant remhash::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant key = eval(c, v >> car);
+      return as_table(eval(c, v >> cdr >> car), "remhash")->remove(key) ? t : nil;
+    }
+
+    //
+    //  (maphash f table): (f key value) for each entry.  f may change
+    //  the table; it sees the entries as they were when we started.
+    //
+    variant maphash::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      function f = get<function>(eval(c, v >> car));
+      hash_table_ptr table = as_table(eval(c, v >> cdr >> car), "maphash");
+      std::vector<std::pair<variant, variant> > entries;
+      table->entries(entries);
+      for (unsigned u = 0; u < entries.size(); u++)
+	{
+	  variant args =
+	    cons_ptr(new lisp::cons(special<quoted_>(entries[u].first),
+				    cons_ptr(new lisp::cons(special<quoted_>(entries[u].second)))));
+	  f(c, args);
+	}
+      return nil;
+    }
+
+    variant hash_table_count::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      return double(as_table(eval(c, v >> car), "hash-table-count")->size());
+    }
+
+    variant eq::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant lhs = eval(c, v >> car);
+      variant rhs = eval(c, v >> cdr >> car);
+      return identical(lhs, rhs) ? t : nil;
+    }
+  }
+}
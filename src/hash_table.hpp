@@ -0,0 +1,61 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_HASH_TABLE_HPP_INCLUDED
+#define LISP_HASH_TABLE_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace lisp {
+
+  //
+  //  make-hash-table.  Open addressing with linear probing; the hash
+  //  of each slot lives in an array of its own, apart from the keys
+  //  and values, so a probe mostly walks that one small array.  Keys
+  //  are the same if eq says so, or equal for an equal table.
+  //
+  class hash_table : boost::noncopyable
+  {
+  public:
+    enum test { eq_test, equal_test };
+
+    hash_table(test t);
+
+    test kind() const { return test_; }
+    std::size_t size() const { return size_; }
+
+    const variant* find(const variant& key) const;
+    void put(const variant& key, const variant& value);
+    bool remove(const variant& key);
+
+    // every key and value, in no particular order
+    void entries(std::vector<std::pair<variant, variant> >& out) const;
+
+    unsigned count;
+
+  private:
+    // in hashes_, besides real hashes, which are never below 2
+    enum { empty = 0, removed = 1 };
+
+    test test_;
+    std::vector<std::size_t> hashes_;
+    std::vector<std::pair<variant, variant> > slots_;
+    std::size_t size_, occupied_;
+
+    std::size_t hash(const variant& key) const;
+    bool same(const variant& lhs, const variant& rhs) const;
+    std::size_t probe(const variant& key, std::size_t h) const;
+    void rehash(std::size_t capacity);
+  };
+}
+
+#endif
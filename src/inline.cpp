@@ -0,0 +1,328 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "context.hpp"
+#include "ops.hpp"
+#include "dispatch.hpp"
+#include "inline.hpp"
+#include "analysis.hpp"
+#include "structure.hpp"
+#include "format.hpp"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using boost::get;
+
+namespace lisp {
+
+  unsigned inline_max_size = 16;
+
+  namespace {
+
+    const symbol* head_symbol(const cons_ptr& p)
+    {
+      return get<symbol>(&p->car);
+    }
+
+    // number of atoms in v, not counting quoted data
+    unsigned size(const variant& v)
+    {
+      const cons_ptr* p = get<cons_ptr>(&v);
+      if (!p)
+	return 1;
+      if (!*p)
+	return 0;
+      return size((*p)->car) + size((*p)->cdr);
+    }
+
+    //
+    //  A body we are willing to paste elsewhere: no binding forms, no
+    //  assignments, no macros and no reference to itself.
+    //
+    bool pasteable(const procedure& callee, const variant& v)
+    {
+      if (const symbol* s = get<symbol>(&v))
+	return *s != callee.name;
+
+      if (get<special<backquoted_> >(&v)
+	  || get<special<comma_> >(&v)
+	  || get<special<comma_at_> >(&v))
+	return false;
+
+      const cons_ptr* p = get<cons_ptr>(&v);
+      if (!p || !*p)
+	return true;
+
+      if (const symbol* s = head_symbol(*p))
+	{
+	  static const char* forbidden[] = { "let", "lambda", "defun", "defmacro",
+					     "defvar", "setf", "eval", 0 };
+	  for (const char** f = forbidden; *f; f++)
+	    if (*s == *f)
+	      return false;
+	  if (names_macro(*callee.ctx, *s))
+	    return false;
+	}
+
+      for (cons_ptr l = *p; l; l = get<cons_ptr>(l->cdr))
+	if (!pasteable(callee, l->car))
+	  return false;
+      return true;
+    }
+
+    // the single body form of callee, if it is small enough to inline
+    bool inlinable(const procedure& callee, variant& form)
+    {
+      if (callee.redefinition || callee.name.empty())
+	return false;
+      const cons_ptr* body = get<cons_ptr>(&callee.source);
+      if (!body || !*body || !is_nil((*body)->cdr))
+	return false;
+      form = (*body)->car;
+      return size(form) <= inline_max_size && pasteable(callee, form);
+    }
+
+    bool trivial(const variant& v)
+    {
+      if (const cons_ptr* p = get<cons_ptr>(&v))
+	return !*p;
+      return !get<special<backquoted_> >(&v)
+	&& !get<special<comma_> >(&v)
+	&& !get<special<comma_at_> >(&v);
+    }
+
+    // the second of args, if there is one and it is a T
+    template <typename T>
+    const T* second_arg(const variant& args)
+    {
+      const cons_ptr* l = get<cons_ptr>(&args);
+      if (!l || !*l)
+	return 0;
+      l = get<cons_ptr>(&(*l)->cdr);
+      return l && *l ? get<T>(&(*l)->car) : 0;
+    }
+
+    // v with the symbols in env replaced, quoted data left alone
+    variant substitute(const variant& v, const std::map<std::string, variant>& env)
+    {
+      if (const symbol* s = get<symbol>(&v))
+	{
+	  std::map<std::string, variant>::const_iterator it = env.find(*s);
+	  return it == env.end() ? v : it->second;
+	}
+      if (get<special<quoted_> >(&v))
+	return v;
+      const cons_ptr* p = get<cons_ptr>(&v);
+      if (!p || !*p)
+	return v;
+      const symbol* head = head_symbol(*p);
+      if (head && *head == "quote")
+	return v;
+      return cons_ptr(new cons(substitute((*p)->car, env),
+			       substitute((*p)->cdr, env)));
+    }
+
+    struct inliner
+    {
+      procedure& caller;
+      std::set<std::string> bound;
+      std::vector<std::string> used;
+
+      inliner(procedure& _caller) : caller(_caller)
+      {
+	bound.insert(caller.args.begin(), caller.args.end());
+	setf_targets(caller.source, bound);
+      }
+
+      variant walk_list(const variant& v)
+      {
+	const cons_ptr* p = get<cons_ptr>(&v);
+	if (!p || !*p)
+	  return v;
+	return cons_ptr(new cons(walk((*p)->car), walk_list((*p)->cdr)));
+      }
+
+      // walk body forms with names added to the locally bound set
+      variant walk_scoped(const variant& body, const std::vector<std::string>& names)
+      {
+	std::set<std::string> saved = bound;
+	bound.insert(names.begin(), names.end());
+	variant result = walk_list(body);
+	bound.swap(saved);
+	return result;
+      }
+
+      variant walk(const variant& v)
+      {
+	const cons_ptr* pp = get<cons_ptr>(&v);
+	if (!pp || !*pp)
+	  return v;
+	const cons_ptr& p = *pp;
+
+	const symbol* s = head_symbol(p);
+	if (!s)
+	  return walk_list(v);
+
+	if (*s == "quote" || *s == "defun" || *s == "defmacro")
+	  return v;
+
+	if (*s == "let" && get<cons_ptr>(&p->cdr))
+	  {
+	    cons_ptr rest = get<cons_ptr>(p->cdr);
+	    std::vector<std::string> names;
+	    cons_ptr head = 0, tail = 0;
+	    for (cons_ptr l = get<cons_ptr>(rest->car); l; l = get<cons_ptr>(l->cdr))
+	      {
+		cons_ptr pair = get<cons_ptr>(l->car);
+		names.push_back(get<symbol>(pair->car));
+		cons_ptr nc = new cons(cons_ptr(new cons(pair->car, walk_list(pair->cdr))));
+		if (tail)
+		  tail->cdr = nc;
+		else
+		  head = nc;
+		tail = nc;
+	      }
+	    return cons_ptr(new cons(p->car,
+				     cons_ptr(new cons(head, walk_scoped(rest->cdr, names)))));
+	  }
+
+	if (*s == "lambda" && get<cons_ptr>(&p->cdr))
+	  {
+	    cons_ptr rest = get<cons_ptr>(p->cdr);
+	    std::vector<std::string> names;
+	    for (cons_ptr l = get<cons_ptr>(rest->car); l; l = get<cons_ptr>(l->cdr))
+	      names.push_back(get<symbol>(l->car));
+	    return cons_ptr(new cons(p->car,
+				     cons_ptr(new cons(rest->car, walk_scoped(rest->cdr, names)))));
+	  }
+
+	if (bound.count(*s))
+	  return walk_list(v);
+
+	variant fn;
+	try {
+	  fn = caller.ctx->get<variant>(*s);
+	} catch (const std::exception&) {
+	  return walk_list(v);
+	}
+
+	// macro arguments are data, leave them alone
+	if (is_macro(fn))
+	  return v;
+
+	// a structure accessor: no need to look it up at every call
+	if (const function* f = get<function>(&fn))
+	  if (f->f.target<ops::slot_ref>())
+	    {
+	      if (std::find(used.begin(), used.end(), *s) == used.end())
+		used.push_back(*s);
+	      return cons_ptr(new cons(embed(*f, s->c_str()), walk_list(p->cdr)));
+	    }
+
+	variant args = walk_list(p->cdr);
+
+	// format with a literal control string: compile it here, once
+	if (const function* f = get<function>(&fn))
+	  if (f->f.target<ops::format>())
+	    if (const string_ptr* control = second_arg<string_ptr>(args))
+	      try {
+		ops::compiled_format cf;
+		cf.program = compile_format((*control)->chars);
+		if (std::find(used.begin(), used.end(), *s) == used.end())
+		  used.push_back(*s);
+		return cons_ptr(new cons(embed(function(cf), s->c_str()), args));
+	      } catch (const std::exception&) {
+		// it will say what's wrong with it when it's called
+	      }
+
+	variant pasted;
+	if (paste(*s, fn, args, pasted))
+	  return pasted;
+	return cons_ptr(new cons(p->car, args));
+      }
+
+      bool paste(const std::string& name, const variant& fn, const variant& args, variant& result)
+      {
+	procedure_ptr callee = as_procedure(fn);
+	variant form;
+	if (!callee || callee.get() == &caller || callee->ctx != caller.ctx
+	    || !inlinable(*callee, form))
+	  return false;
+
+	std::vector<variant> actuals;
+	bool all_trivial = true;
+	for (const cons_ptr* l = get<cons_ptr>(&args); l && *l; l = get<cons_ptr>(&(*l)->cdr))
+	  {
+	    actuals.push_back((*l)->car);
+	    all_trivial = all_trivial && trivial((*l)->car);
+	  }
+	if (actuals.size() != callee->args.size())
+	  return false;
+
+	// the callee's free names must mean the same thing here
+	std::set<std::string> syms;
+	symbols(form, syms);
+	for (std::set<std::string>::const_iterator it = syms.begin(); it != syms.end(); it++)
+	  if (bound.count(*it)
+	      && std::find(callee->args.begin(), callee->args.end(), *it) == callee->args.end())
+	    return false;
+
+	if (all_trivial)
+	  {
+	    std::map<std::string, variant> env;
+	    for (unsigned u = 0; u < actuals.size(); u++)
+	      env[callee->args[u]] = actuals[u];
+	    result = substitute(form, env);
+	  }
+	else
+	  {
+	    // evaluate each argument exactly once, as the call would have
+	    variant bindings = nil;
+	    for (unsigned u = actuals.size(); u > 0; u--)
+	      {
+		variant pair = cons_ptr(new cons(callee->args[u-1],
+						 cons_ptr(new cons(actuals[u-1]))));
+		bindings = cons_ptr(new cons(pair, bindings));
+	      }
+	    result = cons_ptr(new cons(symbol("let"),
+				       cons_ptr(new cons(bindings,
+							 cons_ptr(new cons(form))))));
+	  }
+
+	if (std::find(used.begin(), used.end(), name) == used.end())
+	  used.push_back(name);
+	return true;
+      }
+    };
+  }
+
+  void inline_calls(const procedure_ptr& proc)
+  {
+    proc->inlined.clear();
+    inliner i(*proc);
+    variant code;
+    try {
+      code = i.walk_list(proc->code);
+    } catch (const std::exception&) {
+      // malformed code: leave it for eval to complain about
+      return;
+    }
+    if (i.used.empty())
+      return;
+
+    proc->set_code(code);
+    proc->inlined = i.used;
+    for (unsigned u = 0; u < i.used.size(); u++)
+      depends(proc, i.used[u]);
+  }
+}
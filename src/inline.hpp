@@ -0,0 +1,28 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_INLINE_HPP_INCLUDED
+#define LISP_INLINE_HPP_INCLUDED
+
+#include "dispatch.hpp"
+
+#include <string>
+
+namespace lisp {
+
+  // biggest body (in atoms) that we will paste into a caller
+  extern unsigned inline_max_size;
+
+  //
+  //  Rewrite proc's code, substituting the bodies of small,
+  //  non-recursive, never-redefined functions at their call sites.
+  //  proc then depends on each callee so used, see invalidate().
+  //
+  void inline_calls(const procedure_ptr& proc);
+}
+
+#endif
@@ -0,0 +1,336 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "numeric.hpp"
+#include "jit.hpp"
+#include "stack.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef USE_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace lisp {
+
+  bool jit_enabled = false;
+
+  namespace {
+
+    double eval_node(const numeric_node* node, double* frame)
+    {
+      return node->eval(frame);
+    }
+
+    // room for the frame of a callee, which keeps rsp 16 byte aligned
+    const int call_area = numeric_code::max_frame * sizeof(double);
+  }
+
+  void jit_emitter::bytes(const char* b, std::size_t n)
+  {
+    code_.insert(code_.end(), b, b + n);
+  }
+
+  void jit_emitter::imm32(int i)
+  {
+    bytes(reinterpret_cast<const char*>(&i), 4);
+  }
+
+  void jit_emitter::imm64(const void* p, std::size_t n)
+  {
+    char b[8] = { 0 };
+    std::memcpy(b, p, n);
+    bytes(b, 8);
+  }
+
+  void jit_emitter::constant(double d)
+  {
+    bytes("\x48\xb8", 2);                   // mov rax, d
+    imm64(&d, sizeof d);
+    bytes("\x66\x48\x0f\x6e\xc0", 5);       // movq xmm0, rax
+  }
+
+  void jit_emitter::load(unsigned slot)
+  {
+    bytes("\xf2\x0f\x10\x83", 4);           // movsd xmm0, [rbx + 8 slot]
+    imm32(slot * sizeof(double));
+  }
+
+  void jit_emitter::store(unsigned slot)
+  {
+    bytes("\xf2\x0f\x11\x83", 4);           // movsd [rbx + 8 slot], xmm0
+    imm32(slot * sizeof(double));
+  }
+
+  void jit_emitter::push()
+  {
+    bytes("\x48\x81\xec", 3);               // sub rsp, 16
+    imm32(16);
+    bytes("\xf2\x0f\x11\x04\x24", 5);       // movsd [rsp], xmm0
+  }
+
+  void jit_emitter::pop_rhs()
+  {
+    bytes("\x66\x0f\x28\xc8", 4);           // movapd xmm1, xmm0
+    bytes("\xf2\x0f\x10\x04\x24", 5);       // movsd xmm0, [rsp]
+    bytes("\x48\x81\xc4", 3);               // add rsp, 16
+    imm32(16);
+  }
+
+  void jit_emitter::arith(char op)
+  {
+    bytes("\xf2\x0f", 2);
+    switch (op)
+      {
+      case '+': bytes("\x58", 1); break;    // addsd
+      case '-': bytes("\x5c", 1); break;    // subsd
+      case '*': bytes("\x59", 1); break;    // mulsd
+      default:  bytes("\x5e", 1); break;    // divsd
+      }
+    bytes("\xc1", 1);                       // xmm0, xmm1
+  }
+
+  void jit_emitter::negate()
+  {
+    unsigned long long sign = 1ULL << 63;
+    bytes("\x48\xb8", 2);                   // mov rax, sign bit
+    imm64(&sign, sizeof sign);
+    bytes("\x66\x48\x0f\x6e\xc8", 5);       // movq xmm1, rax
+    bytes("\x66\x0f\x57\xc1", 4);           // xorpd xmm0, xmm1
+  }
+
+  //
+  //  ucomisd leaves "unordered" looking like "less" and "equal" at
+  //  once, so ask above/above-or-equal the right way round: a NaN
+  //  makes every comparison false, as it does in C++.
+  //
+  void jit_emitter::compare(comparison c)
+  {
+    switch (c)
+      {
+      case less:
+	bytes("\x66\x0f\x2e\xc8", 4);       // ucomisd xmm1, xmm0
+	bytes("\x0f\x97\xc0", 3);           // seta al
+	break;
+      case greater:
+	bytes("\x66\x0f\x2e\xc1", 4);       // ucomisd xmm0, xmm1
+	bytes("\x0f\x97\xc0", 3);           // seta al
+	break;
+      case less_equal:
+	bytes("\x66\x0f\x2e\xc8", 4);       // ucomisd xmm1, xmm0
+	bytes("\x0f\x93\xc0", 3);           // setae al
+	break;
+      case greater_equal:
+	bytes("\x66\x0f\x2e\xc1", 4);       // ucomisd xmm0, xmm1
+	bytes("\x0f\x93\xc0", 3);           // setae al
+	break;
+      case equal:
+	bytes("\x66\x0f\x2e\xc1", 4);       // ucomisd xmm0, xmm1
+	bytes("\x0f\x94\xc0", 3);           // sete al
+	bytes("\x0f\x9b\xc1", 3);           // setnp cl
+	bytes("\x20\xc8", 2);               // and al, cl
+	break;
+      }
+    bytes("\x0f\xb6\xc0", 3);               // movzx eax, al
+    bytes("\xf2\x0f\x2a\xc0", 4);           // cvtsi2sd xmm0, eax
+  }
+
+  std::size_t jit_emitter::jump_if_false()
+  {
+    bytes("\x66\x0f\x57\xc9", 4);           // xorpd xmm1, xmm1
+    bytes("\x66\x0f\x2e\xc1", 4);           // ucomisd xmm0, xmm1
+    bytes("\x0f\x84", 2);                   // je
+    std::size_t at = code_.size();
+    imm32(0);
+    return at;
+  }
+
+  std::size_t jit_emitter::jump()
+  {
+    bytes("\xe9", 1);                       // jmp
+    std::size_t at = code_.size();
+    imm32(0);
+    return at;
+  }
+
+  void jit_emitter::land(std::size_t jump)
+  {
+    int offset = code_.size() - (jump + 4);
+    std::memcpy(&code_[jump], &offset, 4);
+  }
+
+  void jit_emitter::begin_call()
+  {
+    bytes("\x48\x81\xec", 3);               // sub rsp, call_area
+    imm32(call_area);
+  }
+
+  void jit_emitter::arg(unsigned i)
+  {
+    bytes("\xf2\x0f\x11\x84\x24", 5);       // movsd [rsp + 8 i], xmm0
+    imm32(i * sizeof(double));
+  }
+
+  //
+  //  before each call, make sure the stack has room for it, or bail
+  //  out through stack_overflow_jump
+  //
+  void jit_emitter::check_stack()
+  {
+    char** limit = &stack_limit;
+    void (*overflow)() = &stack_overflow_jump;
+    bytes("\x48\xb8", 2);                   // mov rax, &stack_limit
+    imm64(&limit, sizeof limit);
+    bytes("\x48\x3b\x20", 3);               // cmp rsp, [rax]
+    bytes("\x73\x0c", 2);                   // jae past the next two
+    bytes("\x48\xb8", 2);                   // mov rax, stack_overflow_jump
+    imm64(&overflow, sizeof overflow);
+    bytes("\xff\xd0", 2);                   // call rax
+  }
+
+  void jit_emitter::call_self()
+  {
+    bytes("\x48\x89\xe7", 3);               // mov rdi, rsp
+    bytes("\xe8", 1);                       // call entry
+    imm32(-int(code_.size() + 4));
+    bytes("\x48\x81\xc4", 3);               // add rsp, call_area
+    imm32(call_area);
+  }
+
+  void jit_emitter::call(double (*native)(double*))
+  {
+    bytes("\x48\x89\xe7", 3);               // mov rdi, rsp
+    bytes("\x48\xb8", 2);                   // mov rax, native
+    imm64(&native, sizeof native);
+    bytes("\xff\xd0", 2);                   // call rax
+    bytes("\x48\x81\xc4", 3);               // add rsp, call_area
+    imm32(call_area);
+  }
+
+  void jit_emitter::begin_loop()
+  {
+    loop_ = code_.size();
+  }
+
+  void jit_emitter::repeat(unsigned nargs)
+  {
+    for (unsigned u = 0; u < nargs; u++)
+      {
+	bytes("\xf2\x0f\x10\x84\x24", 5);   // movsd xmm0, [rsp + 8 u]
+	imm32(u * sizeof(double));
+	store(u);
+      }
+    bytes("\x48\x81\xc4", 3);               // add rsp, call_area
+    imm32(call_area);
+    bytes("\xe9", 1);                       // jmp loop
+    imm32(int(loop_) - int(code_.size() + 4));
+  }
+
+  void jit_emitter::end_loop(const bool* again)
+  {
+    bytes("\x48\xb8", 2);                   // mov rax, again
+    imm64(&again, sizeof again);
+    bytes("\x80\x38\x00", 3);               // cmp byte [rax], 0
+    bytes("\x74\x08", 2);                   // je past the next two
+    bytes("\xc6\x00\x00", 3);               // mov byte [rax], 0
+    bytes("\xe9", 1);                       // jmp loop
+    imm32(int(loop_) - int(code_.size() + 4));
+  }
+
+  void jit_emitter::fallback(const numeric_node* node)
+  {
+    double (*f)(const numeric_node*, double*) = &eval_node;
+    bytes("\x48\xbf", 2);                   // mov rdi, node
+    imm64(&node, sizeof node);
+    bytes("\x48\x89\xde", 3);               // mov rsi, rbx
+    bytes("\x48\xb8", 2);                   // mov rax, eval_node
+    imm64(&f, sizeof f);
+    bytes("\xff\xd0", 2);                   // call rax
+  }
+
+  //
+  //  rbx is callee saved, and pushing it leaves the stack 16 byte
+  //  aligned; everything after moves rsp in multiples of 16.
+  //
+  void jit_emitter::prologue()
+  {
+    bytes("\x53", 1);                       // push rbx
+    bytes("\x48\x89\xfb", 3);               // mov rbx, rdi
+  }
+
+  void jit_emitter::epilogue()
+  {
+    bytes("\x5b", 1);                       // pop rbx
+    bytes("\xc3", 1);                       // ret
+  }
+
+#ifdef USE_JIT
+
+  namespace {
+
+    struct unmap
+    {
+      std::size_t size;
+      unmap(std::size_t _size) : size(_size) { }
+      void operator()(void* p) const { munmap(p, size); }
+    };
+
+    std::FILE* perf_map()
+    {
+      static std::FILE* f = 0;
+      if (!f)
+	{
+	  char name[64];
+	  std::sprintf(name, "/tmp/perf-%d.map", int(getpid()));
+	  f = std::fopen(name, "w");
+	}
+      return f;
+    }
+  }
+
+  void jit_compile(numeric_code& code, const std::string& name)
+  {
+    jit_emitter e;
+    e.prologue();
+    code.body->emit(e);
+    e.epilogue();
+
+    const std::vector<unsigned char>& bytes = e.code();
+    std::size_t page = sysconf(_SC_PAGESIZE);
+    std::size_t size = (bytes.size() + page - 1) / page * page;
+    void* p = mmap(0, size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      return;
+    std::memcpy(p, &bytes[0], bytes.size());
+    if (mprotect(p, size, PROT_READ | PROT_EXEC) != 0)
+      {
+	munmap(p, size);
+	return;
+      }
+
+    code.native_memory.reset(p, unmap(size));
+    code.native = reinterpret_cast<double (*)(double*)>(p);
+
+    if (std::FILE* f = perf_map())
+      {
+	std::fprintf(f, "%lx %lx lisp::%s\n", (unsigned long)p,
+		     (unsigned long)bytes.size(),
+		     name.empty() ? "lambda" : name.c_str());
+	std::fflush(f);
+      }
+  }
+
+#else
+
+  void jit_compile(numeric_code&, const std::string&) { }
+
+#endif
+}
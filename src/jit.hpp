@@ -0,0 +1,94 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_JIT_HPP_INCLUDED
+#define LISP_JIT_HPP_INCLUDED
+
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace lisp {
+
+  struct numeric_node;
+  struct numeric_code;
+
+  // set by --jit
+  extern bool jit_enabled;
+
+  //
+  //  Translate code's body to x86-64 machine code and point
+  //  code.native at it.  Nodes that have no template of their own are
+  //  called back into, so anything numeric_analysis accepts works.
+  //  Each function is listed in /tmp/perf-PID.map for perf.
+  //
+  void jit_compile(numeric_code& code, const std::string& name);
+
+  //
+  //  Emits the templates numeric nodes are made of.  The value of a
+  //  node ends up in xmm0; the frame of doubles is kept in rbx.
+  //
+  class jit_emitter : boost::noncopyable
+  {
+  public:
+    enum comparison { less, greater, less_equal, greater_equal, equal };
+
+    void constant(double d);
+    void load(unsigned slot);            // xmm0 = frame[slot]
+    void store(unsigned slot);           // frame[slot] = xmm0
+
+    void push();                         // put xmm0 aside
+    void pop_rhs();                      // xmm1 = xmm0, xmm0 = what was put aside
+
+    void arith(char op);                 // xmm0 = xmm0 op xmm1, op in + - * /
+    void negate();
+    void compare(comparison c);          // xmm0 = xmm0 c xmm1 ? 1 : 0
+
+    std::size_t jump_if_false();         // if xmm0 == 0 go to where land() is called
+    std::size_t jump();
+    void land(std::size_t jump);
+
+    //
+    //  calls of numeric functions: begin_call, evaluate each argument
+    //  and pass it with arg(), then call_self or call
+    //
+    void begin_call();
+    void check_stack();
+    void arg(unsigned i);
+    void call_self();
+    void call(double (*native)(double*));
+
+    //
+    //  self calls in tail position: between begin_loop and end_loop,
+    //  repeat takes the arguments of a call begun with begin_call as
+    //  the new frame and jumps back to the top.  end_loop goes round
+    //  again if the tree walker did the same by setting *again.
+    //
+    void begin_loop();
+    void repeat(unsigned nargs);
+    void end_loop(const bool* again);
+
+    // have the tree walker evaluate node
+    void fallback(const numeric_node* node);
+
+    void prologue();
+    void epilogue();
+
+    const std::vector<unsigned char>& code() const { return code_; }
+
+  private:
+    std::vector<unsigned char> code_;
+    std::size_t loop_;
+
+    void bytes(const char* b, std::size_t n);
+    void imm32(int i);
+    void imm64(const void* p, std::size_t n);
+  };
+}
+
+#endif
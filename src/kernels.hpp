@@ -0,0 +1,94 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_KERNELS_HPP_INCLUDED
+#define LISP_KERNELS_HPP_INCLUDED
+
+#include "config.hpp"
+#include "types.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef USE_SIMD
+#include <immintrin.h>
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace lisp {
+
+  // v as an index into something of the given size
+  inline std::size_t as_index(const variant& v, std::size_t size, const char* fn)
+  {
+    const double* d = boost::get<double>(&v);
+    if (!d)
+      throw std::runtime_error(std::string(fn) + ": not a number");
+    if (*d < 0 || *d >= size || *d != std::floor(*d))
+      throw std::runtime_error(std::string(fn) + ": index out of range");
+    return std::size_t(*d);
+  }
+
+  // C++03 vectors have no data()
+  template <typename T>
+  T* data(std::vector<T>& v)
+  {
+    return v.empty() ? 0 : &v[0];
+  }
+
+  // for the set of plain loops, which run anywhere
+  inline bool always() { return true; }
+
+  //
+  //  The loops behind a family of builtins, from whichever of its
+  //  kernel sets, one per instruction set, is in use.  A Kernels has
+  //  a name and a supported() saying whether this CPU runs it; all
+  //  lists them widest first, ends in 0, and has a set that is
+  //  always supported just before that.  The widest set the CPU runs
+  //  is used unless use() picks another, to compare or to check one
+  //  against another.
+  //
+  template <typename Kernels>
+  class kernel_choice
+  {
+  public:
+    explicit kernel_choice(const Kernels* const* all)
+      : all_(all), current_(best(all))
+    { }
+
+    const Kernels* operator->() const { return current_; }
+
+    // switches to the set called name, if this CPU has it
+    void use(const variant& name, const char* fn)
+    {
+      const symbol* s = boost::get<symbol>(&name);
+      const Kernels* const* k = all_;
+      while (*k && !(s && *s == (*k)->name))
+	k++;
+      if (!*k || !(*k)->supported())
+	throw std::runtime_error(std::string(fn) + ": not available here");
+      current_ = *k;
+    }
+
+  private:
+    static const Kernels* best(const Kernels* const* all)
+    {
+#ifdef USE_SIMD
+      __builtin_cpu_init();
+#endif
+      for (const Kernels* const* k = all; ; k++)
+	if ((*k)->supported())
+	  return *k;
+    }
+
+    const Kernels* const* all_;
+    const Kernels* current_;
+  };
+}
+
+#endif
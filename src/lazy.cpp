@@ -0,0 +1,387 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "callback.hpp"
+#include "f64vector.hpp"
+#include "persistent.hpp"
+#include "lazy.hpp"
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using boost::get;
+
+namespace lisp {
+
+  void intrusive_ptr_add_ref(lazy_seq* s)
+  {
+    s->count++;
+  }
+
+  void intrusive_ptr_release(lazy_seq* s)
+  {
+    s->count--;
+    if (s->count == 0)
+      delete s;
+  }
+
+  namespace {
+
+    class list_cursor : public cursor
+    {
+    public:
+      list_cursor(const cons_ptr& l, const char* fn) : l_(l), fn_(fn) { }
+
+      bool next(context_ptr&, variant& out)
+      {
+	if (!l_)
+	  return false;
+	out = l_->car;
+	const cons_ptr* rest = get<cons_ptr>(&l_->cdr);
+	if (!rest)
+	  throw std::runtime_error(std::string(fn_) + ": not a proper list");
+	l_ = *rest;
+	return true;
+      }
+
+    private:
+      cons_ptr l_;
+      const char* fn_;
+    };
+
+    class array_cursor : public cursor
+    {
+    public:
+      array_cursor(const array_ptr& a) : a_(a), i_(0) { }
+
+      bool next(context_ptr&, variant& out)
+      {
+	if (i_ == a_->items.size())
+	  return false;
+	out = a_->items[i_++];
+	return true;
+      }
+
+    private:
+      array_ptr a_;
+      std::size_t i_;
+    };
+
+    class f64vector_cursor : public cursor
+    {
+    public:
+      f64vector_cursor(const f64vector_ptr& f) : f_(f), i_(0) { }
+
+      bool next(context_ptr&, variant& out)
+      {
+	if (i_ == f_->items.size())
+	  return false;
+	out = f_->items[i_++];
+	return true;
+      }
+
+    private:
+      f64vector_ptr f_;
+      std::size_t i_;
+    };
+
+    class pvector_cursor : public cursor
+    {
+    public:
+      pvector_cursor(const pvector_ptr& p) : p_(p), i_(0) { }
+
+      bool next(context_ptr&, variant& out)
+      {
+	if (i_ == p_->size)
+	  return false;
+	out = p_->nth(i_++);
+	return true;
+      }
+
+    private:
+      pvector_ptr p_;
+      std::size_t i_;
+    };
+
+    //
+    //  Each element is worked out from its index rather than by adding
+    //  step over and over, so long ranges of fractions don't drift.
+    //
+    class range_cursor : public cursor
+    {
+    public:
+      range_cursor(double from, double to, double step)
+	: from_(from), to_(to), step_(step), i_(0)
+      { }
+
+      bool next(context_ptr&, variant& out)
+      {
+	double x = from_ + i_ * step_;
+	if (step_ > 0 ? x >= to_ : step_ < 0 && x <= to_)
+	  return false;
+	out = x;
+	i_++;
+	return true;
+      }
+
+    private:
+      double from_, to_, step_, i_;
+    };
+
+    struct range_seq : lazy_seq
+    {
+      double from, to, step;
+
+      range_seq(double f, double t, double s) : from(f), to(t), step(s) { }
+
+      cursor_ptr start() const { return cursor_ptr(new range_cursor(from, to, step)); }
+      const char* name() const { return "range"; }
+    };
+
+    class map_cursor : public cursor
+    {
+    public:
+      map_cursor(const variant& f, const variant& from)
+	: call_(f, 1, "lazy-map"), from_(iterate(from, "lazy-map"))
+      { }
+
+      bool next(context_ptr& c, variant& out)
+      {
+	if (!from_->next(c, x_))
+	  return false;
+	out = call_(c, x_);
+	return true;
+      }
+
+    private:
+      callback call_;
+      cursor_ptr from_;
+      variant x_;
+    };
+
+    struct map_seq : lazy_seq
+    {
+      variant f, from;
+
+      map_seq(const variant& _f, const variant& _from) : f(_f), from(_from) { }
+
+      cursor_ptr start() const { return cursor_ptr(new map_cursor(f, from)); }
+      const char* name() const { return "lazy-map"; }
+    };
+
+    class filter_cursor : public cursor
+    {
+    public:
+      filter_cursor(const variant& f, const variant& from)
+	: call_(f, 1, "lazy-filter"), from_(iterate(from, "lazy-filter"))
+      { }
+
+      bool next(context_ptr& c, variant& out)
+      {
+	while (from_->next(c, out))
+	  if (call_(c, out) == t)
+	    return true;
+	return false;
+      }
+
+    private:
+      callback call_;
+      cursor_ptr from_;
+    };
+
+    struct filter_seq : lazy_seq
+    {
+      variant f, from;
+
+      filter_seq(const variant& _f, const variant& _from) : f(_f), from(_from) { }
+
+      cursor_ptr start() const { return cursor_ptr(new filter_cursor(f, from)); }
+      const char* name() const { return "lazy-filter"; }
+    };
+
+    // stops without asking from for another once it has n
+    class take_cursor : public cursor
+    {
+    public:
+      take_cursor(double n, const variant& from)
+	: left_(n), from_(iterate(from, "take"))
+      { }
+
+      bool next(context_ptr& c, variant& out)
+      {
+	if (left_ <= 0 || !from_->next(c, out))
+	  return false;
+	left_--;
+	return true;
+      }
+
+    private:
+      double left_;
+      cursor_ptr from_;
+    };
+
+    struct take_seq : lazy_seq
+    {
+      double n;
+      variant from;
+
+      take_seq(double _n, const variant& _from) : n(_n), from(_from) { }
+
+      cursor_ptr start() const { return cursor_ptr(new take_cursor(n, from)); }
+      const char* name() const { return "take"; }
+    };
+
+    double as_number(const variant& v, const char* fn)
+    {
+      const double* d = get<double>(&v);
+      if (!d)
+	throw std::runtime_error(std::string(fn) + ": not a number");
+      return *d;
+    }
+
+    // f, having made sure it's a function
+    const variant& as_function(const variant& f, const char* fn)
+    {
+      if (!get<function>(&f))
+	throw std::runtime_error(std::string(fn) + ": not a function");
+      return f;
+    }
+
+    // seq, having made sure iterate() takes it
+    const variant& as_sequence(const variant& seq, const char* fn)
+    {
+      if (!get<cons_ptr>(&seq) && !get<array_ptr>(&seq) && !get<f64vector_ptr>(&seq)
+	  && !get<pvector_ptr>(&seq) && !get<lazy_seq_ptr>(&seq))
+	throw std::runtime_error(std::string(fn) + ": not a sequence");
+      return seq;
+    }
+  }
+
+  cursor_ptr iterate(const variant& seq, const char* fn)
+  {
+    if (const cons_ptr* p = get<cons_ptr>(&seq))
+      return cursor_ptr(new list_cursor(*p, fn));
+    if (const array_ptr* a = get<array_ptr>(&seq))
+      return cursor_ptr(new array_cursor(*a));
+    if (const f64vector_ptr* f = get<f64vector_ptr>(&seq))
+      return cursor_ptr(new f64vector_cursor(*f));
+    if (const pvector_ptr* p = get<pvector_ptr>(&seq))
+      return cursor_ptr(new pvector_cursor(*p));
+    if (const lazy_seq_ptr* l = get<lazy_seq_ptr>(&seq))
+      return (*l)->start();
+    throw std::runtime_error(std::string(fn) + ": not a sequence");
+  }
+
+  namespace ops {
+
+    //
+    //  (range), (range end), (range start end) or (range start end
+    //  step): the numbers from start, or 0, up to but not including
+    //  end, or without end if there is none
+    //
+    variant range::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      std::vector<double> args;
+      for (; !is_nil(v); v = v >> cdr)
+	args.push_back(as_number(eval(c, v >> car), "range"));
+      double forever = std::numeric_limits<double>::infinity();
+      switch (args.size())
+	{
+	case 0:
+	  return lazy_seq_ptr(new range_seq(0, forever, 1));
+	case 1:
+	  return lazy_seq_ptr(new range_seq(0, args[0], 1));
+	case 2:
+	  return lazy_seq_ptr(new range_seq(args[0], args[1], 1));
+	case 3:
+	  return lazy_seq_ptr(new range_seq(args[0], args[1], args[2]));
+	}
+      throw std::runtime_error("range: too many arguments");
+    }
+
+    // (lazy-map f seq): (f x) for each x of seq, as they're asked for
+    variant lazy_map::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant f = as_function(eval(c, v >> car), "lazy-map");
+      variant from = as_sequence(eval(c, v >> cdr >> car), "lazy-map");
+      return lazy_seq_ptr(new map_seq(f, from));
+    }
+
+    // (lazy-filter f seq): the elements of seq f is true of
+    variant lazy_filter::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant f = as_function(eval(c, v >> car), "lazy-filter");
+      variant from = as_sequence(eval(c, v >> cdr >> car), "lazy-filter");
+      return lazy_seq_ptr(new filter_seq(f, from));
+    }
+
+    // (take n seq): the first n elements of seq, or all if it's shorter
+    variant take::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      double n = as_number(eval(c, v >> car), "take");
+      variant from = as_sequence(eval(c, v >> cdr >> car), "take");
+      return lazy_seq_ptr(new take_seq(n, from));
+    }
+
+    //
+    //  (into coll seq): a new collection like coll with the elements
+    //  of seq added, at the end of a list, simple vector or f64vector,
+    //  or by pvector-conj to a pvector.  (into nil seq) makes a list.
+    //
+    variant into::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant coll = eval(c, v >> car);
+      cursor_ptr items = iterate(eval(c, v >> cdr >> car), "into");
+      variant x;
+      if (const cons_ptr* p = get<cons_ptr>(&coll))
+	{
+	  list_builder result;
+	  for (cursor_ptr old = iterate(*p, "into"); old->next(c, x); )
+	    result.push(x);
+	  while (items->next(c, x))
+	    result.push(x);
+	  return result.head;
+	}
+      if (const array_ptr* a = get<array_ptr>(&coll))
+	{
+	  array_ptr result(new array((*a)->items));
+	  while (items->next(c, x))
+	    result->items.push_back(x);
+	  return result;
+	}
+      if (const f64vector_ptr* f = get<f64vector_ptr>(&coll))
+	{
+	  f64vector_ptr result(new f64vector(0, 0));
+	  result->items = (*f)->items;
+	  while (items->next(c, x))
+	    result->items.push_back(as_number(x, "into"));
+	  return result;
+	}
+      if (const pvector_ptr* p = get<pvector_ptr>(&coll))
+	{
+	  pvector_transient result(**p);
+	  while (items->next(c, x))
+	    result.conj(x);
+	  return result.persistent();
+	}
+      throw std::runtime_error("into: can't add to that");
+    }
+  }
+}
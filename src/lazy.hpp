@@ -0,0 +1,59 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_LAZY_HPP_INCLUDED
+#define LISP_LAZY_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace lisp {
+
+  //
+  //  Hands out the elements of a sequence one at a time.
+  //
+  class cursor : boost::noncopyable
+  {
+  public:
+    virtual ~cursor() { }
+
+    // the next element in out, or false at the end
+    virtual bool next(context_ptr& c, variant& out) = 0;
+  };
+
+  typedef boost::shared_ptr<cursor> cursor_ptr;
+
+  //
+  //  range, lazy-map, lazy-filter and take: a sequence whose elements
+  //  are worked out only as they are asked for.  Each is the recipe
+  //  for its elements rather than the elements themselves, and each
+  //  start() begins again from the first; a pipeline of them hands
+  //  each element all the way through before asking for the next, so
+  //  there are no lists in between, and the sequence needn't end.
+  //
+  struct lazy_seq : boost::noncopyable
+  {
+    unsigned count;
+
+    lazy_seq() : count(0) { }
+    virtual ~lazy_seq() { }
+
+    virtual cursor_ptr start() const = 0;
+    // for printing
+    virtual const char* name() const = 0;
+  };
+
+  //
+  //  the elements of a list, simple vector, f64vector, pvector or
+  //  lazy sequence; throws for anything else.  fn is who's asking.
+  //
+  cursor_ptr iterate(const variant& seq, const char* fn);
+}
+
+#endif
@@ -24,6 +24,7 @@
 #include <fstream>
 #include <string>
 #include <map>
+#include <vector>
 
 #include "config.hpp"
 #include "types.hpp"
@@ -34,6 +35,12 @@
 #include "print.hpp"
 #include "dot.hpp"
 #include "grammar.hpp"
+#include "inline.hpp"
+#include "jit.hpp"
+#include "runtime.hpp"
+#include "compile.hpp"
+#include "tier.hpp"
+#include "stack.hpp"
 
 #ifdef USE_READLINE
 #include <readline/readline.h>
@@ -42,31 +49,6 @@
 
 using namespace lisp;
 
-void add_builtins()
-{
-  global->put("+", lisp::function(lisp::ops::op<std::plus<double> >(0)));
-  global->put("*", lisp::function(lisp::ops::op<std::multiplies<double> >(1)));
-  global->put("-", lisp::function(lisp::ops::minus()));
-  global->put("/", lisp::function(lisp::ops::divides()));
-  global->put("cons", lisp::function(lisp::ops::cons()));
-  global->put("list", lisp::function(lisp::ops::list()));
-  global->put("defvar", lisp::function(lisp::ops::defvar()));
-  global->put("print", lisp::function(lisp::ops::print()));
-  global->put("eval", lisp::function(lisp::ops::evaluate()));
-  global->put("funcall", lisp::function(lisp::ops::funcall()));
-  global->put("defun", lisp::function(lisp::ops::defun()));
-  global->put("progn", lisp::function(lisp::ops::progn()));
-  global->put("equal", lisp::function(lisp::ops::equal()));
-  global->put("if", lisp::function(lisp::ops::if_clause()));
-  global->put("setf", lisp::function(lisp::ops::setf()));
-  global->put("defmacro", lisp::function(lisp::ops::defmacro()));
-  global->put("lambda", lisp::function(lisp::ops::lambda()));
-  global->put("let", lisp::function(lisp::ops::let()));
-
-  global->put("t", t);
-  global->put("nil",  nil);
-}
-
 skipper_t skipper;
 
 #ifdef USE_READLINE
@@ -110,7 +92,7 @@ int repl(bool debug, std::istream& is)
 
   unsigned i = 0;
 
-  context_ptr scope = global->scope();
+  context_ptr scope = global->toplevel();
 
   while (true)
     {
@@ -165,7 +147,7 @@ int repl(bool debug, std::istream& is)
 		}
 
 	      try {
-		variant out = eval(scope, result);
+		variant out = eval_toplevel(scope, result);
 		if (debug)
 		  {
 		    std::cout << "\nevalled to> ";
@@ -203,7 +185,7 @@ int offline(bool debug, std::istream& is)
 
   std::string::const_iterator pos = code.begin(), end = code.end();
 
-  context_ptr scope = global->scope();
+  context_ptr scope = global->toplevel();
 
   // if there's a hashbang,  strip her
   if (*pos == '#')
@@ -235,7 +217,7 @@ int offline(bool debug, std::istream& is)
 	    }
 
 	  try {
-	    variant out = eval(scope, result);
+	    variant out = eval_toplevel(scope, result);
 	    if (debug)
 	      {
 		std::cout << "\nevalled to> ";
@@ -256,6 +238,41 @@ int offline(bool debug, std::istream& is)
   return 0;
 }
 
+//
+//  read all of is and write it out as a C++ program, see compile.hpp
+//
+int compile(bool debug, std::istream& is, const std::string& source,
+	    std::ostream& os)
+{
+  interpreter_t lispi(debug);
+
+  std::string code;
+
+  do {
+    char c = is.get();
+    if (! is.eof())
+      code += c;
+  } while (! is.eof());
+
+  std::string::const_iterator pos = code.begin(), end = code.end();
+
+  if (*pos == '#')
+    while (*pos != '\n')
+      pos++;
+
+  std::vector<variant> forms;
+  while (pos < end)
+    {
+      lisp::variant result;
+      if (!phrase_parse(pos, end, lispi, skipper, result))
+	throw std::runtime_error("parsing failed");
+      forms.push_back(result);
+    }
+
+  compile_to_cpp(forms, source, os);
+  return 0;
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////
 //  Main program
@@ -263,10 +280,6 @@ int offline(bool debug, std::istream& is)
 
 namespace opts = boost::program_options;
 
-namespace lisp 
-{
-  bool debug_contexts, debug_all;
-}
 
 int
 main(int argc, char* argv[])
@@ -278,6 +291,18 @@ main(int argc, char* argv[])
     ("contexts,c", "dump contexts")
     ("help,h", "show this help")
     ("input,i", "input file")
+    ("jit", "compile hot numeric functions to machine code")
+    ("compile-to-cpp", "translate the input file to a C++ program")
+    ("output,o", opts::value<std::string>(), "where --compile-to-cpp writes, default stdout")
+    ("hot-calls", opts::value<unsigned>(&lisp::tier_hot_calls)
+     ->default_value(lisp::tier_hot_calls),
+     "calls before a function is analyzed, 0 for right away")
+    ("max-depth", opts::value<unsigned>(&lisp::max_depth)
+     ->default_value(lisp::max_depth),
+     "deepest nesting of calls before a stack-overflow error")
+    ("inline-size", opts::value<unsigned>(&lisp::inline_max_size)
+     ->default_value(lisp::inline_max_size),
+     "largest function body, in conses, that is inlined")
     ;
   opts::variables_map vm;
 
@@ -298,9 +323,25 @@ main(int argc, char* argv[])
 
   lisp::debug_all = vm.count("debug") > 0;
   lisp::debug_contexts = vm.count("contexts") > 0;
+  lisp::jit_enabled = vm.count("jit") > 0;
 
   add_builtins();
 
+  if (vm.count("compile-to-cpp"))
+    {
+      if (!vm.count("input"))
+	{
+	  std::cerr << "--compile-to-cpp needs an input file\n";
+	  return 1;
+	}
+      std::string fname = vm["input"].as<std::string>();
+      std::ifstream is(fname.c_str());
+      if (!vm.count("output"))
+	return compile(debug_all, is, fname, std::cout);
+      std::ofstream os(vm["output"].as<std::string>().c_str());
+      return compile(debug_all, is, fname, os);
+    }
+
   if (vm.count("input"))
     {
       std::string fname = vm["input"].as<std::string>();
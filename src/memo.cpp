@@ -0,0 +1,299 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "dispatch.hpp"
+#include "analysis.hpp"
+#include "equal.hpp"
+#include "memo.hpp"
+
+#include <boost/functional/hash.hpp>
+
+#include <cmath>
+#include <stdexcept>
+
+using boost::get;
+
+namespace lisp {
+
+  memo_table::memo_table(std::size_t limit)
+    : hits(0), misses(0), evictions(0), size_(0), occupied_(0), limit_(limit),
+      newest_(-1), oldest_(-1)
+  {
+    slots_.assign(16, empty);
+  }
+
+  std::size_t memo_table::hash(const key_type& key) const
+  {
+    std::size_t h = key.size();
+    for (unsigned u = 0; u < key.size(); u++)
+      boost::hash_combine(h, structural_hash(key[u]));
+    return h;
+  }
+
+  bool memo_table::same(const key_type& lhs, const key_type& rhs) const
+  {
+    if (lhs.size() != rhs.size())
+      return false;
+    for (unsigned u = 0; u < lhs.size(); u++)
+      if (!structurally_equal(lhs[u], rhs[u]))
+	return false;
+    return true;
+  }
+
+  const variant* memo_table::find(const key_type& key)
+  {
+    std::size_t h = hash(key), mask = slots_.size() - 1;
+    for (std::size_t i = h & mask; slots_[i] != empty; i = (i + 1) & mask)
+      {
+	int e = slots_[i];
+	if (e == removed || entries_[e].hash != h || !same(entries_[e].key, key))
+	  continue;
+	hits++;
+	if (e != newest_)
+	  {
+	    unlink(e);
+	    link(e);
+	  }
+	return &entries_[e].value;
+      }
+    misses++;
+    return 0;
+  }
+
+  void memo_table::insert(const key_type& key, const variant& value)
+  {
+    std::size_t h = hash(key), mask = slots_.size() - 1;
+    std::size_t i = h & mask;
+    for (; slots_[i] != empty; i = (i + 1) & mask)
+      {
+	int e = slots_[i];
+	if (e != removed && entries_[e].hash == h && same(entries_[e].key, key))
+	  {
+	    // computing it put it there already: a recursive call
+	    entries_[e].value = value;
+	    return;
+	  }
+      }
+
+    int e;
+    if (unused_.empty())
+      {
+	e = entries_.size();
+	entries_.push_back(entry());
+      }
+    else
+      {
+	e = unused_.back();
+	unused_.pop_back();
+      }
+    entries_[e].key = key;
+    entries_[e].value = value;
+    entries_[e].hash = h;
+    link(e);
+    slots_[i] = e;
+    size_++;
+    occupied_++;
+
+    while (limit_ && size_ > limit_)
+      evict();
+    // keep the load, removed slots included, under 3/4
+    if (occupied_ * 4 > slots_.size() * 3)
+      rehash(size_ * 2 > slots_.size() ? slots_.size() * 2 : slots_.size());
+  }
+
+  void memo_table::clear()
+  {
+    entries_.clear();
+    unused_.clear();
+    slots_.assign(16, empty);
+    size_ = occupied_ = 0;
+    newest_ = oldest_ = -1;
+  }
+
+  void memo_table::limit(std::size_t n)
+  {
+    limit_ = n;
+    while (limit_ && size_ > limit_)
+      evict();
+  }
+
+  std::size_t memo_table::slot_of(int e) const
+  {
+    std::size_t mask = slots_.size() - 1;
+    std::size_t i = entries_[e].hash & mask;
+    while (slots_[i] != e)
+      i = (i + 1) & mask;
+    return i;
+  }
+
+  void memo_table::link(int e)
+  {
+    entries_[e].prev = -1;
+    entries_[e].next = newest_;
+    if (newest_ >= 0)
+      entries_[newest_].prev = e;
+    newest_ = e;
+    if (oldest_ < 0)
+      oldest_ = e;
+  }
+
+  void memo_table::unlink(int e)
+  {
+    entry& x = entries_[e];
+    if (x.prev >= 0)
+      entries_[x.prev].next = x.next;
+    else
+      newest_ = x.next;
+    if (x.next >= 0)
+      entries_[x.next].prev = x.prev;
+    else
+      oldest_ = x.prev;
+  }
+
+  void memo_table::evict()
+  {
+    int e = oldest_;
+    slots_[slot_of(e)] = removed;
+    unlink(e);
+    entries_[e].key.clear();
+    entries_[e].value = nil;
+    unused_.push_back(e);
+    size_--;
+    evictions++;
+  }
+
+  void memo_table::rehash(std::size_t capacity)
+  {
+    slots_.assign(capacity, empty);
+    std::size_t mask = capacity - 1;
+    for (int e = newest_; e >= 0; e = entries_[e].next)
+      {
+	std::size_t i = entries_[e].hash & mask;
+	while (slots_[i] != empty)
+	  i = (i + 1) & mask;
+	slots_[i] = e;
+      }
+    occupied_ = size_;
+  }
+
+  namespace ops {
+
+    variant memoized::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      memo_table::key_type key;
+      for (; !is_nil(v); v = v >> cdr)
+	key.push_back(eval(c, v >> car));
+
+      if (const variant* found = table->find(key))
+	return *found;
+
+      variant args = nil;
+      for (unsigned u = key.size(); u > 0; u--)
+	args = cons_ptr(new lisp::cons(special<quoted_>(key[u-1]), args));
+      variant result = f(c, args);
+      table->insert(key, result);
+      return result;
+    }
+
+    namespace {
+
+      const memoized* memo_of(const variant& v)
+      {
+	const function* f = get<function>(&v);
+	return f ? f->f.target<memoized>() : 0;
+      }
+
+      //
+      //  Put a memoized version of the function called name in its
+      //  place, or change the limit of the one that is there.  Code
+      //  that called it directly has to find it again.
+      //
+      void memoize_function(context_ptr& c, const symbol& name, std::size_t limit)
+      {
+	variant& binding = c->get<variant>(name);
+	if (const memoized* m = memo_of(binding))
+	  {
+	    m->table->limit(limit);
+	    return;
+	  }
+	const function* f = get<function>(&binding);
+	if (!f)
+	  throw std::runtime_error(name + " is not a function");
+
+	memoized m;
+	m.f = *f;
+	m.table.reset(new memo_table(limit));
+	function memo = function(m);
+	memo.name = name;
+	binding = memo;
+
+	invalidate(name);
+	// its own calls to itself may have been bound to the procedure
+	procedure_ptr proc = as_procedure(m.f);
+	if (proc && proc->tier == hot_tier)
+	  analyze(proc);
+      }
+
+      variant entry(const char* name, double value)
+      {
+	return cons_ptr(new lisp::cons(symbol(name), cons_ptr(new lisp::cons(value))));
+      }
+    }
+
+    variant defun_memo::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant name = defun()(c, v);
+      memoize_function(c, get<symbol>(name), 0);
+      return name;
+    }
+
+    variant memoize::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant name = eval(c, v >> car);
+      std::size_t limit = 0;
+      if (!is_nil(v >> cdr))
+	{
+	  variant n = eval(c, v >> cdr >> car);
+	  const double* d = get<double>(&n);
+	  // !(x >= 0) catches NaN as well
+	  if (!d || !(*d >= 0) || *d != std::floor(*d) || *d > 1e15)
+	    throw std::runtime_error("memoize: the limit must be a non-negative integer");
+	  limit = std::size_t(*d);
+	}
+      memoize_function(c, get<symbol>(name), limit);
+      return name;
+    }
+
+    //
+    //  ((hits n) (misses n) (evictions n) (size n) (limit n))
+    //
+    variant memo_stats::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      symbol name = get<symbol>(eval(c, v >> car));
+      const memoized* m = memo_of(c->get<variant>(name));
+      if (!m)
+	throw std::runtime_error(name + " is not memoized");
+      const memo_table& table = *m->table;
+      variant stats = nil;
+      stats = cons_ptr(new lisp::cons(entry("limit", table.limit()), stats));
+      stats = cons_ptr(new lisp::cons(entry("size", table.size()), stats));
+      stats = cons_ptr(new lisp::cons(entry("evictions", table.evictions), stats));
+      stats = cons_ptr(new lisp::cons(entry("misses", table.misses), stats));
+      stats = cons_ptr(new lisp::cons(entry("hits", table.hits), stats));
+      return stats;
+    }
+  }
+}
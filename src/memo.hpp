@@ -0,0 +1,88 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_MEMO_HPP_INCLUDED
+#define LISP_MEMO_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstddef>
+#include <vector>
+
+namespace lisp {
+
+  //
+  //  Results of a function, by argument list.  An open addressing
+  //  table (linear probing) of indices into a pool of entries, which
+  //  are also kept in a list from most to least recently used.  With
+  //  a limit, the least recently used entry goes once there are more.
+  //  Arguments match as they would for equal, see equal.hpp.
+  //
+  class memo_table : boost::noncopyable
+  {
+  public:
+    typedef std::vector<variant> key_type;
+
+    memo_table(std::size_t limit);
+
+    // the value stored for key, if any, which is now the most recent
+    const variant* find(const key_type& key);
+    void insert(const key_type& key, const variant& value);
+    void clear();
+
+    // 0 for no limit
+    void limit(std::size_t n);
+    std::size_t limit() const { return limit_; }
+    std::size_t size() const { return size_; }
+
+    unsigned long hits, misses, evictions;
+
+  private:
+    struct entry
+    {
+      key_type key;
+      variant value;
+      std::size_t hash;
+      int prev, next;
+    };
+
+    enum { empty = -1, removed = -2 };
+
+    std::vector<entry> entries_;
+    std::vector<int> unused_;            // entries free for reuse
+    std::vector<int> slots_;             // entry, empty or removed
+    std::size_t size_, occupied_, limit_;
+    int newest_, oldest_;
+
+    std::size_t hash(const key_type& key) const;
+    bool same(const key_type& lhs, const key_type& rhs) const;
+    std::size_t slot_of(int e) const;
+
+    void link(int e);
+    void unlink(int e);
+    void evict();
+    void rehash(std::size_t capacity);
+  };
+
+  namespace ops {
+
+    //
+    //  f with a memo_table in front.  A miss calls f with the
+    //  evaluated arguments quoted.
+    //
+    struct memoized
+    {
+      function f;
+      boost::shared_ptr<memo_table> table;
+      variant operator()(context_ptr, variant);
+    };
+  }
+}
+
+#endif
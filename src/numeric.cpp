@@ -0,0 +1,648 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "dispatch.hpp"
+#include "analysis.hpp"
+#include "numeric.hpp"
+#include "declare.hpp"
+#include "jit.hpp"
+#include "stack.hpp"
+#include "tail.hpp"
+
+#include <algorithm>
+#include <csetjmp>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+using boost::get;
+
+namespace lisp {
+
+  namespace {
+
+    struct constant : numeric_node
+    {
+      double d;
+      constant(double _d) : d(_d) { }
+      double eval(double*) const { return d; }
+      void emit(jit_emitter& e) const { e.constant(d); }
+    };
+
+    struct slot : numeric_node
+    {
+      unsigned index;
+      slot(unsigned _index) : index(_index) { }
+      double eval(double* frame) const { return frame[index]; }
+      void emit(jit_emitter& e) const { e.load(index); }
+    };
+
+    typedef std::vector<numeric_node_ptr> nodes_t;
+
+    char op_char(std::plus<double>) { return '+'; }
+    char op_char(std::minus<double>) { return '-'; }
+    char op_char(std::multiplies<double>) { return '*'; }
+    char op_char(std::divides<double>) { return '/'; }
+
+    jit_emitter::comparison op_comparison(std::less<double>) { return jit_emitter::less; }
+    jit_emitter::comparison op_comparison(std::greater<double>) { return jit_emitter::greater; }
+    jit_emitter::comparison op_comparison(std::less_equal<double>) { return jit_emitter::less_equal; }
+    jit_emitter::comparison op_comparison(std::greater_equal<double>) { return jit_emitter::greater_equal; }
+    jit_emitter::comparison op_comparison(std::equal_to<double>) { return jit_emitter::equal; }
+
+    // + and *: fold the arguments into an initial value, like ops::op
+    template <typename Op>
+    struct fold : numeric_node
+    {
+      double initial;
+      nodes_t args;
+      Op op_;
+      fold(double _initial, const nodes_t& _args)
+	: initial(_initial), args(_args) { }
+      double eval(double* frame) const
+      {
+	double r = initial;
+	for (unsigned u = 0; u < args.size(); u++)
+	  r = op_(r, args[u]->eval(frame));
+	return r;
+      }
+      void emit(jit_emitter& e) const
+      {
+	e.constant(initial);
+	for (unsigned u = 0; u < args.size(); u++)
+	  {
+	    e.push();
+	    args[u]->emit(e);
+	    e.pop_rhs();
+	    e.arith(op_char(op_));
+	  }
+      }
+    };
+
+    // - and / of two or more: fold the rest into the first
+    template <typename Op>
+    struct reduce : numeric_node
+    {
+      nodes_t args;
+      Op op_;
+      reduce(const nodes_t& _args) : args(_args) { }
+      double eval(double* frame) const
+      {
+	double r = args[0]->eval(frame);
+	for (unsigned u = 1; u < args.size(); u++)
+	  r = op_(r, args[u]->eval(frame));
+	return r;
+      }
+      void emit(jit_emitter& e) const
+      {
+	args[0]->emit(e);
+	for (unsigned u = 1; u < args.size(); u++)
+	  {
+	    e.push();
+	    args[u]->emit(e);
+	    e.pop_rhs();
+	    e.arith(op_char(op_));
+	  }
+      }
+    };
+
+    struct negate : numeric_node
+    {
+      numeric_node_ptr arg;
+      negate(numeric_node_ptr _arg) : arg(_arg) { }
+      double eval(double* frame) const { return -arg->eval(frame); }
+      void emit(jit_emitter& e) const
+      {
+	arg->emit(e);
+	e.negate();
+      }
+    };
+
+    struct reciprocal : numeric_node
+    {
+      numeric_node_ptr arg;
+      reciprocal(numeric_node_ptr _arg) : arg(_arg) { }
+      double eval(double* frame) const { return 1.0 / arg->eval(frame); }
+      void emit(jit_emitter& e) const
+      {
+	e.constant(1.0);
+	e.push();
+	arg->emit(e);
+	e.pop_rhs();
+	e.arith('/');
+      }
+    };
+
+    // < > <= >= = and equal: every argument is evaluated, as in ops::compare
+    template <typename Op>
+    struct chain : numeric_node
+    {
+      nodes_t args;
+      Op op_;
+      chain(const nodes_t& _args) : args(_args) { }
+      double eval(double* frame) const
+      {
+	bool result = true;
+	double prev = 0;
+	for (unsigned u = 0; u < args.size(); u++)
+	  {
+	    double d = args[u]->eval(frame);
+	    if (u > 0 && !op_(prev, d))
+	      result = false;
+	    prev = d;
+	  }
+	return result;
+      }
+      // longer chains are rare enough to leave to eval
+      void emit(jit_emitter& e) const
+      {
+	if (args.size() != 2)
+	  return e.fallback(this);
+	args[0]->emit(e);
+	e.push();
+	args[1]->emit(e);
+	e.pop_rhs();
+	e.compare(op_comparison(op_));
+      }
+    };
+
+    struct choose : numeric_node
+    {
+      numeric_node_ptr cond, then, otherwise;
+      choose(numeric_node_ptr _cond, numeric_node_ptr _then,
+	     numeric_node_ptr _otherwise)
+	: cond(_cond), then(_then), otherwise(_otherwise) { }
+      double eval(double* frame) const
+      {
+	return cond->eval(frame) != 0
+	  ? then->eval(frame)
+	  : otherwise->eval(frame);
+      }
+      void emit(jit_emitter& e) const
+      {
+	cond->emit(e);
+	std::size_t to_otherwise = e.jump_if_false();
+	then->emit(e);
+	std::size_t to_end = e.jump();
+	e.land(to_otherwise);
+	otherwise->emit(e);
+	e.land(to_end);
+      }
+    };
+
+    struct sequence : numeric_node
+    {
+      nodes_t forms;
+      sequence(const nodes_t& _forms) : forms(_forms) { }
+      double eval(double* frame) const
+      {
+	for (unsigned u = 0; u + 1 < forms.size(); u++)
+	  forms[u]->eval(frame);
+	return forms.back()->eval(frame);
+      }
+      void emit(jit_emitter& e) const
+      {
+	for (unsigned u = 0; u < forms.size(); u++)
+	  forms[u]->emit(e);
+      }
+    };
+
+    //
+    //  let: every variable gets a slot of its own, so the values can
+    //  go straight in; the initial forms can't see them anyway.
+    //
+    struct bind : numeric_node
+    {
+      std::vector<unsigned> slots;
+      nodes_t inits;
+      numeric_node_ptr body;
+      bind(const std::vector<unsigned>& _slots, const nodes_t& _inits,
+	   numeric_node_ptr _body)
+	: slots(_slots), inits(_inits), body(_body) { }
+      double eval(double* frame) const
+      {
+	for (unsigned u = 0; u < slots.size(); u++)
+	  frame[slots[u]] = inits[u]->eval(frame);
+	return body->eval(frame);
+      }
+      void emit(jit_emitter& e) const
+      {
+	for (unsigned u = 0; u < slots.size(); u++)
+	  {
+	    inits[u]->emit(e);
+	    e.store(slots[u]);
+	  }
+	body->emit(e);
+      }
+    };
+
+    //
+    //  a call to a numeric function, ourselves included, that never
+    //  leaves the world of doubles
+    //
+    struct call : numeric_node
+    {
+      numeric_code_ptr keep;     // empty for calls to ourselves
+      const numeric_code* code;
+      nodes_t args;
+      call(numeric_code_ptr _keep, const numeric_code* _code, const nodes_t& _args)
+	: keep(_keep), code(_code), args(_args) { }
+      double eval(double* frame) const
+      {
+	double callee[numeric_code::max_frame];
+	if (stack_low())
+	  stack_overflow_jump();
+	for (unsigned u = 0; u < args.size(); u++)
+	  callee[u] = args[u]->eval(frame);
+	return code->run(callee);
+      }
+      void emit(jit_emitter& e) const
+      {
+	if (keep && !code->native)
+	  return e.fallback(this);
+	e.check_stack();
+	e.begin_call();
+	for (unsigned u = 0; u < args.size(); u++)
+	  {
+	    args[u]->emit(e);
+	    e.arg(u);
+	  }
+	if (keep)
+	  e.call(code->native);
+	else
+	  e.call_self();
+      }
+    };
+
+    //
+    //  Self calls in tail position, see tail.hpp: the body is run in
+    //  a loop, and a repeat puts the new arguments in the frame and
+    //  has it go round again.  Only returns happen between the two.
+    //
+    bool again = false;
+
+    struct loop : numeric_node
+    {
+      numeric_node_ptr body;
+      loop(numeric_node_ptr _body) : body(_body) { }
+      double eval(double* frame) const
+      {
+	for (;;)
+	  {
+	    double result = body->eval(frame);
+	    if (!again)
+	      return result;
+	    again = false;
+	  }
+      }
+      // a repeat that was left to eval gets here through again
+      void emit(jit_emitter& e) const
+      {
+	e.begin_loop();
+	body->emit(e);
+	e.end_loop(&again);
+      }
+    };
+
+    struct repeat : numeric_node
+    {
+      nodes_t args;
+      repeat(const nodes_t& _args) : args(_args) { }
+      double eval(double* frame) const
+      {
+	double next[numeric_code::max_frame];
+	for (unsigned u = 0; u < args.size(); u++)
+	  next[u] = args[u]->eval(frame);
+	std::copy(next, next + args.size(), frame);
+	again = true;
+	return 0;
+      }
+      void emit(jit_emitter& e) const
+      {
+	e.begin_call();
+	for (unsigned u = 0; u < args.size(); u++)
+	  {
+	    args[u]->emit(e);
+	    e.arg(u);
+	  }
+	e.repeat(args.size());
+      }
+    };
+
+    // the form can't be shown to be numeric
+    struct not_numeric { };
+
+    enum kind { number, truth };
+
+    typedef std::map<std::string, unsigned> env_t;
+
+    struct compiler
+    {
+      const procedure_ptr& proc;
+      const numeric_code* self;
+      kind self_kind;
+      unsigned frame_size;
+      bool looping;
+
+      compiler(const procedure_ptr& _proc, const numeric_code* _self, kind _self_kind)
+	: proc(_proc), self(_self), self_kind(_self_kind),
+	  frame_size(_proc->args.size()), looping(false)
+      { }
+
+      numeric_node_ptr compile(const variant& v, const env_t& env, kind& k)
+      {
+	if (const double* d = get<double>(&v))
+	  {
+	    k = number;
+	    return numeric_node_ptr(new constant(*d));
+	  }
+	if (const symbol* s = get<symbol>(&v))
+	  {
+	    env_t::const_iterator it = env.find(*s);
+	    if (it == env.end())
+	      throw not_numeric();
+	    k = number;
+	    return numeric_node_ptr(new slot(it->second));
+	  }
+	const cons_ptr* p = get<cons_ptr>(&v);
+	if (!p || !*p)
+	  throw not_numeric();
+	return form(*p, env, k);
+      }
+
+      numeric_node_ptr expect(const variant& v, const env_t& env, kind want)
+      {
+	kind k;
+	numeric_node_ptr node = compile(v, env, k);
+	if (k != want)
+	  throw not_numeric();
+	return node;
+      }
+
+      nodes_t numbers(const std::vector<variant>& forms, const env_t& env)
+      {
+	nodes_t nodes;
+	for (unsigned u = 0; u < forms.size(); u++)
+	  nodes.push_back(expect(forms[u], env, number));
+	return nodes;
+      }
+
+      numeric_node_ptr progn(variant forms, const env_t& env, kind& k)
+      {
+	nodes_t nodes;
+	std::vector<variant> v = elements(forms);
+	for (unsigned u = 0; u < v.size(); u++)
+	  if (!declaration(v[u]))
+	    nodes.push_back(compile(v[u], env, k));
+	if (nodes.empty())
+	  throw not_numeric();
+	if (nodes.size() == 1)
+	  return nodes[0];
+	return numeric_node_ptr(new sequence(nodes));
+      }
+
+      static std::vector<variant> elements(variant l)
+      {
+	std::vector<variant> v;
+	while (!is_nil(l))
+	  {
+	    const cons_ptr* p = get<cons_ptr>(&l);
+	    if (!p)
+	      throw not_numeric();
+	    v.push_back((*p)->car);
+	    l = (*p)->cdr;
+	  }
+	return v;
+      }
+
+      bool declaration(const variant& form)
+      {
+	const cons_ptr* p = get<cons_ptr>(&form);
+	if (!p || !*p)
+	  return false;
+	const std::string* name = form_name(*p);
+	return name && *name == "declare";
+      }
+
+      // the function in the operator position of a form
+      function resolve(const variant& head, const env_t& env)
+      {
+	if (const function* f = get<function>(&head))
+	  return *f;
+	const symbol* s = get<symbol>(&head);
+	if (!s || env.count(*s))
+	  throw not_numeric();
+	depends(proc, *s);
+	try {
+	  if (const function* f = get<function>(&proc->ctx->get<variant>(*s)))
+	    return *f;
+	} catch (const std::exception&) { }
+	throw not_numeric();
+      }
+
+      template <typename Op>
+      bool is(const function& f)
+      {
+	return f.f.target<Op>() != 0;
+      }
+
+      numeric_node_ptr form(const cons_ptr& p, const env_t& env, kind& k)
+      {
+	function f = resolve(p->car, env);
+	std::vector<variant> args = elements(p->cdr);
+	k = number;
+
+	if (is<ops::op<std::plus<double> > >(f))
+	  return numeric_node_ptr(new fold<std::plus<double> >(0, numbers(args, env)));
+	if (is<ops::op<std::multiplies<double> > >(f))
+	  return numeric_node_ptr(new fold<std::multiplies<double> >(1, numbers(args, env)));
+	if (is<ops::minus>(f) || is<ops::divides>(f))
+	  {
+	    if (args.empty())
+	      throw not_numeric();
+	    nodes_t nodes = numbers(args, env);
+	    if (is<ops::minus>(f))
+	      return nodes.size() == 1
+		? numeric_node_ptr(new negate(nodes[0]))
+		: numeric_node_ptr(new reduce<std::minus<double> >(nodes));
+	    return nodes.size() == 1
+	      ? numeric_node_ptr(new reciprocal(nodes[0]))
+	      : numeric_node_ptr(new reduce<std::divides<double> >(nodes));
+	  }
+
+	k = truth;
+	if (is<ops::compare<std::less<double> > >(f))
+	  return numeric_node_ptr(new chain<std::less<double> >(numbers(args, env)));
+	if (is<ops::compare<std::greater<double> > >(f))
+	  return numeric_node_ptr(new chain<std::greater<double> >(numbers(args, env)));
+	if (is<ops::compare<std::less_equal<double> > >(f))
+	  return numeric_node_ptr(new chain<std::less_equal<double> >(numbers(args, env)));
+	if (is<ops::compare<std::greater_equal<double> > >(f))
+	  return numeric_node_ptr(new chain<std::greater_equal<double> >(numbers(args, env)));
+	if (is<ops::compare<std::equal_to<double> > >(f))
+	  return numeric_node_ptr(new chain<std::equal_to<double> >(numbers(args, env)));
+	if (is<ops::equal>(f))
+	  {
+	    if (args.size() != 2)
+	      throw not_numeric();
+	    return numeric_node_ptr(new chain<std::equal_to<double> >(numbers(args, env)));
+	  }
+
+	if (is<ops::if_clause>(f))
+	  {
+	    if (args.size() != 3)
+	      throw not_numeric();
+	    numeric_node_ptr cond = expect(args[0], env, truth);
+	    numeric_node_ptr then = compile(args[1], env, k);
+	    numeric_node_ptr otherwise = expect(args[2], env, k);
+	    return numeric_node_ptr(new choose(cond, then, otherwise));
+	  }
+
+	if (is<ops::progn>(f))
+	  return progn(p->cdr, env, k);
+
+	if (is<ops::let>(f) || is<ops::stack_let>(f))
+	  {
+	    if (args.empty())
+	      throw not_numeric();
+	    env_t inner(env);
+	    std::vector<unsigned> slots;
+	    nodes_t inits;
+	    std::vector<variant> pairs = elements(args[0]);
+	    declarations decls;
+	    parse_declarations(p->cdr >> cdr, decls);
+	    for (unsigned u = 0; u < pairs.size(); u++)
+	      {
+		std::vector<variant> pair = elements(pairs[u]);
+		const symbol* s = pair.size() == 2 ? get<symbol>(&pair[0]) : 0;
+		if (!s || frame_size == numeric_code::max_frame)
+		  throw not_numeric();
+		// declared to be something else: let the type check complain
+		lisp_type type = decls.type_of(*s);
+		if (type != any_type && type != number_type)
+		  throw not_numeric();
+		inits.push_back(expect(pair[1], env, number));
+		slots.push_back(frame_size);
+		inner[*s] = frame_size++;
+	      }
+	    numeric_node_ptr body = progn(p->cdr >> cdr, inner, k);
+	    return numeric_node_ptr(new bind(slots, inits, body));
+	  }
+
+	if (is<ops::self_call>(f))
+	  {
+	    if (args.size() != proc->args.size())
+	      throw not_numeric();
+	    k = self_kind;
+	    looping = true;
+	    return numeric_node_ptr(new repeat(numbers(args, env)));
+	  }
+
+	if (procedure_ptr callee = as_procedure(f))
+	  {
+	    if (callee == proc)
+	      {
+		if (args.size() != proc->args.size())
+		  throw not_numeric();
+		k = self_kind;
+		return numeric_node_ptr(new call(numeric_code_ptr(), self, numbers(args, env)));
+	      }
+	    numeric_code_ptr code = callee->numeric;
+	    if (!code || args.size() != code->nargs)
+	      throw not_numeric();
+	    k = code->predicate ? truth : number;
+	    return numeric_node_ptr(new call(code, code.get(), numbers(args, env)));
+	  }
+
+	throw not_numeric();
+      }
+    };
+  }
+
+  void numeric_node::emit(jit_emitter& e) const
+  {
+    e.fallback(this);
+  }
+
+  namespace {
+    sigjmp_buf* overflow = 0;
+  }
+
+  void stack_overflow_jump()
+  {
+    if (!overflow)
+      stack_overflow();
+    siglongjmp(*overflow, 1);
+  }
+
+  //
+  //  Nothing in numeric code has a destructor to skip, and it never
+  //  calls back into eval, so there is only ever one of these active.
+  //
+  double numeric_code::enter(double* frame) const
+  {
+    sigjmp_buf here;
+    if (sigsetjmp(here, 0))
+      {
+	overflow = 0;
+	stack_overflow();
+      }
+    overflow = &here;
+    double result = run(frame);
+    overflow = 0;
+    return result;
+  }
+
+  void numeric_analysis(const procedure_ptr& proc)
+  {
+    proc->numeric.reset();
+    if (proc->args.size() > numeric_code::max_frame)
+      return;
+    if (proc->declared)
+      for (unsigned u = 0; u < proc->args.size(); u++)
+	if (proc->declared->types[u] != any_type
+	    && proc->declared->types[u] != number_type)
+	  return;
+
+    env_t env;
+    for (unsigned u = 0; u < proc->args.size(); u++)
+      env[proc->args[u]] = u;
+
+    //
+    //  Recursive calls are typed by assuming what the function
+    //  returns; if the body disagrees, assume the other thing.
+    //
+    kind kinds[] = { number, truth };
+    for (unsigned u = 0; u < 2; u++)
+      {
+	boost::shared_ptr<numeric_code> code(new numeric_code);
+	compiler c(proc, code.get(), kinds[u]);
+	try {
+	  kind k;
+	  code->body = c.progn(proc->code, env, k);
+	  if (k != kinds[u])
+	    continue;
+	} catch (const not_numeric&) {
+	  continue;
+	}
+	if (c.looping)
+	  code->body.reset(new loop(code->body));
+	code->nargs = proc->args.size();
+	code->frame_size = c.frame_size;
+	code->predicate = kinds[u] == truth;
+	if (jit_enabled)
+	  jit_compile(*code, proc->name);
+	proc->numeric = code;
+	return;
+      }
+  }
+}
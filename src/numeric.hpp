@@ -0,0 +1,86 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_NUMERIC_HPP_INCLUDED
+#define LISP_NUMERIC_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace lisp {
+
+  struct procedure;
+  class jit_emitter;
+
+  //
+  //  A piece of a function body that type inference has proven works
+  //  on numbers only.  It runs on raw doubles kept in a frame of
+  //  slots (arguments first, then let variables) and never builds a
+  //  variant; truth values are 1 and 0.
+  //
+  struct numeric_node : boost::noncopyable
+  {
+    virtual ~numeric_node() { }
+    virtual double eval(double* frame) const = 0;
+
+    // machine code doing the same, see jit.hpp; by default, call eval
+    virtual void emit(jit_emitter& e) const;
+  };
+
+  typedef boost::shared_ptr<const numeric_node> numeric_node_ptr;
+
+  struct numeric_code
+  {
+    // no frame is bigger than this, so calls can keep it on the C stack
+    enum { max_frame = 16 };
+
+    unsigned nargs, frame_size;
+    bool predicate;              // the result is t or nil, not a number
+    numeric_node_ptr body;
+
+    double (*native)(double*);   // body, compiled by the jit
+    boost::shared_ptr<void> native_memory;
+
+    numeric_code() : nargs(0), frame_size(0), predicate(false), native(0) { }
+
+    double run(double* frame) const
+    {
+      return native ? native(frame) : body->eval(frame);
+    }
+
+    // run, from outside numeric code: turns stack_overflow_jump into an error
+    double enter(double* frame) const;
+
+    variant box(double d) const
+    {
+      if (predicate)
+	return d != 0 ? t : nil;
+      return d;
+    }
+  };
+
+  typedef boost::shared_ptr<const numeric_code> numeric_code_ptr;
+
+  //
+  //  Numeric code, machine code included, can't be unwound through by
+  //  an exception.  When a call in it finds the stack running out it
+  //  calls this, which jumps back out to enter().
+  //
+  void stack_overflow_jump();
+
+  //
+  //  Infer types in proc's code.  If, given numbers for arguments,
+  //  every form is certain to produce a number (or t/nil from a
+  //  comparison), set proc->numeric so dispatch can run it unboxed.
+  //  Calls to other such functions go straight from one to the other.
+  //
+  void numeric_analysis(const boost::shared_ptr<procedure>& proc);
+}
+
+#endif
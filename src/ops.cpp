@@ -14,9 +14,28 @@
 #include "dot.hpp"
 #include "debug.hpp"
 #include "backquote.hpp"
-
+#include "dispatch.hpp"
+#include "inline.hpp"
+#include "analysis.hpp"
+#include "closure.hpp"
+#include "declare.hpp"
+#include "tier.hpp"
+#include "equal.hpp"
+#include "memo.hpp"
+#include "hash_table.hpp"
+#include "f64vector.hpp"
+#include "structure.hpp"
+#include "persistent.hpp"
+#include "bitvector.hpp"
+#include "table.hpp"
+#include "callback.hpp"
+#include "lazy.hpp"
+
+#include <cmath>
 #include <iostream>
+#include <stdexcept>
 #include <vector>
+#include <time.h>
 
 using boost::get;
 
@@ -87,6 +106,57 @@ namespace lisp {
     template struct op<std::plus<double> >;
     template struct op<std::multiplies<double> >;
 
+    template <typename Op>
+    variant
+    compare<Op>::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      bool result = true, first = true;
+      double prev = 0;
+      while(!is_nil(v))
+	{
+	  variant evalled = eval(c, v >> car);
+	  double d = get<double>(evalled);
+	  if (!first && !op_(prev, d))
+	    result = false;
+	  prev = d;
+	  first = false;
+	  v = v >> cdr;
+	}
+      return result ? t : nil;
+    }
+
+    template struct compare<std::less<double> >;
+    template struct compare<std::greater<double> >;
+    template struct compare<std::less_equal<double> >;
+    template struct compare<std::greater_equal<double> >;
+    template struct compare<std::equal_to<double> >;
+
+    template <typename Op>
+    variant
+    string_compare<Op>::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      bool result = true, first = true;
+      std::string prev;
+      while(!is_nil(v))
+	{
+	  variant evalled = eval(c, v >> car);
+	  const std::string* s = string_chars(evalled);
+	  if (!s)
+	    throw std::runtime_error("string compare: not a string");
+	  if (!first && !op_(prev, *s))
+	    result = false;
+	  prev = *s;
+	  first = false;
+	  v = v >> cdr;
+	}
+      return result ? t : nil;
+    }
+
+    template struct string_compare<std::less<std::string> >;
+    template struct string_compare<std::greater<std::string> >;
+
     variant cons::operator()(context_ptr c, variant v)
     {
       SHOW;
@@ -132,39 +202,6 @@ namespace lisp {
       return head;
     }
 
-    struct equal_visitor
-    : public boost::static_visitor<bool>
-    {
-      template <typename T, typename U>
-      bool operator()( const T &, const U & ) const
-      {
-        return false; // cannot compare different types
-      }
-
-      template <typename T>
-      bool operator()( const T & lhs, const T & rhs ) const
-      {
-        return lhs == rhs;
-      }
-
-      template <typename T>
-      bool operator()( const lisp::function & lhs, const lisp::function & rhs ) const
-      {
-        return &lhs == &rhs;
-      }
-
-      bool operator()( const lisp::cons_ptr& lhs, const lisp::cons_ptr & rhs ) const
-      {
-	if (is_nil(lhs) && is_nil(rhs))
-	  return true;
-	if (is_nil(lhs) || is_nil(rhs))
-	  return false;
-
-        return boost::apply_visitor(*this, lhs->car, rhs->car)
-	  && boost::apply_visitor(*this, lhs->cdr, rhs->cdr);
-      }
-    };
-
     //
     // this is the one where they're equal if their printed representations
     // are the same
@@ -176,7 +213,7 @@ namespace lisp {
       variant lhs_evalled = eval(ctx, v >> car);
       variant rhs_evalled = eval(ctx, v >> cdr >> car);
 
-      return boost::apply_visitor(equal_visitor(), lhs_evalled, rhs_evalled) ? t : nil;
+      return structurally_equal(lhs_evalled, rhs_evalled) ? t : nil;
     }
 
     variant if_clause::operator()(context_ptr ctx, variant v)
@@ -196,12 +233,96 @@ namespace lisp {
       symbol s = get<symbol>(v >> car);
       variant result = eval(ctx, v >> cdr >> car);
       global->put(s, result);
+      invalidate(s);
       return s;
     }
 
+    namespace {
+
+      array_ptr as_array(const variant& v, const char* fn)
+      {
+	const array_ptr* a = get<array_ptr>(&v);
+	if (!a)
+	  throw std::runtime_error(std::string(fn) + ": not a vector");
+	return *a;
+      }
+
+      std::size_t as_index(const variant& v, std::size_t size, const char* fn)
+      {
+	const double* d = get<double>(&v);
+	if (!d || *d < 0 || *d >= size || *d != std::floor(*d))
+	  throw std::runtime_error(std::string(fn) + ": index out of range");
+	return std::size_t(*d);
+      }
+
+      //
+      //  (setf (aref v i) x), (setf (gethash k h) x), (setf (point-x p)
+      //  x): the place is a form naming where the value goes, rather
+      //  than a variable
+      //
+      variant set_place(context_ptr& ctx, const cons_ptr& place, const variant& value)
+      {
+	const symbol* s = get<symbol>(&place->car);
+	if (s && *s == "aref")
+	  {
+	    variant args = place->cdr;
+	    array_ptr a = as_array(eval(ctx, args >> car), "aref");
+	    std::size_t i = as_index(eval(ctx, args >> cdr >> car), a->items.size(), "aref");
+	    a->items[i] = value;
+	    return value;
+	  }
+	if (s && *s == "gethash")
+	  {
+	    variant args = place->cdr;
+	    variant key = eval(ctx, args >> car);
+	    variant table = eval(ctx, args >> cdr >> car);
+	    const hash_table_ptr* h = get<hash_table_ptr>(&table);
+	    if (!h)
+	      throw std::runtime_error("gethash: not a hash table");
+	    (*h)->put(key, value);
+	    return value;
+	  }
+	if (s && *s == "f64ref")
+	  {
+	    variant args = place->cdr;
+	    variant vec = eval(ctx, args >> car);
+	    const double* d = get<double>(&value);
+	    if (!d)
+	      throw std::runtime_error("f64ref: not a number");
+	    f64_place(vec, eval(ctx, args >> cdr >> car)) = *d;
+	    return value;
+	  }
+	if (s && *s == "sbit")
+	  {
+	    variant args = place->cdr;
+	    variant vec = eval(ctx, args >> car);
+	    set_bit_place(vec, eval(ctx, args >> cdr >> car), value);
+	    return value;
+	  }
+
+	// a defstruct accessor, by name or already put in place by analysis
+	variant head = place->car;
+	if (s)
+	  try {
+	    head = ctx->get<variant>(*s);
+	  } catch (const std::exception&) { }
+	if (const function* f = get<function>(&head))
+	  if (const slot_ref* ref = f->f.target<slot_ref>())
+	    {
+	      variant args = place->cdr;
+	      return ref->slot(eval(ctx, args >> car)) = value;
+	    }
+	throw std::runtime_error("setf: can't assign to that place");
+      }
+    }
+
     variant setf::operator()(context_ptr ctx, variant v)
     {
       SHOW;
+      if (const cons_ptr* place = get<cons_ptr>(&(v >> car)))
+	if (*place)
+	  return set_place(ctx, *place, eval(ctx, v >> cdr >> car));
+
       symbol s = get<symbol>(v >> car);
       variant result = eval(ctx, v >> cdr >> car);
       //      std::cout << "SETTING " << s << " to ";
@@ -209,7 +330,10 @@ namespace lisp {
 
       try {
 	variant& destination = ctx->get<variant>(s);
+	bool was_function = get<function>(&destination);
 	destination = result;
+	if (was_function)
+	  invalidate(s);
       } catch (const std::exception&) {
 	ctx->put(s, result);
       }
@@ -217,6 +341,244 @@ namespace lisp {
       return result;
     }
 
+    //
+    //  (make-array n [initial-element])
+    //
+    variant make_array::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      variant n = eval(ctx, v >> car);
+      variant initial = is_nil(v >> cdr) ? nil : eval(ctx, v >> cdr >> car);
+      const double* d = get<double>(&n);
+      if (!d || *d < 0 || *d != std::floor(*d))
+	throw std::runtime_error("make-array: bad size");
+      return array_ptr(new array(std::size_t(*d), initial));
+    }
+
+    variant vector::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      array_ptr a(new array);
+      for (; !is_nil(v); v = v >> cdr)
+	a->items.push_back(eval(ctx, v >> car));
+      return a;
+    }
+
+    variant aref::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      array_ptr a = as_array(eval(ctx, v >> car), "aref");
+      return a->items[as_index(eval(ctx, v >> cdr >> car), a->items.size(), "aref")];
+    }
+
+    // of a list, a string or a vector
+    variant length::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      variant x = eval(ctx, v >> car);
+      if (const array_ptr* a = get<array_ptr>(&x))
+	return double((*a)->items.size());
+      if (const f64vector_ptr* f = get<f64vector_ptr>(&x))
+	return double((*f)->items.size());
+      if (const pvector_ptr* p = get<pvector_ptr>(&x))
+	return double((*p)->size);
+      if (const bitvector_ptr* b = get<bitvector_ptr>(&x))
+	return double((*b)->size);
+      if (const table_ptr* t = get<table_ptr>(&x))
+	return double((*t)->rows);
+      if (const string_ptr* s = get<string_ptr>(&x))
+	return double((*s)->chars.size());
+      const cons_ptr* p = get<cons_ptr>(&x);
+      if (!p)
+	throw std::runtime_error("length: not a sequence");
+      double n = 0;
+      for (cons_ptr l = *p; l; n++)
+	{
+	  const cons_ptr* next = get<cons_ptr>(&l->cdr);
+	  if (!next)
+	    throw std::runtime_error("length: not a proper list");
+	  l = *next;
+	}
+      return n;
+    }
+
+    namespace {
+
+      // v as a list, 0 if it's nil; fn is who wants it
+      cons_ptr as_list(const variant& v, const char* fn)
+      {
+	const cons_ptr* p = get<cons_ptr>(&v);
+	if (!p)
+	  throw std::runtime_error(std::string(fn) + ": not a list");
+	return *p;
+      }
+
+      // the cons after p, or 0 at the end of the list
+      cons_ptr next_cons(const cons_ptr& p, const char* fn)
+      {
+	const cons_ptr* q = get<cons_ptr>(&p->cdr);
+	if (!q)
+	  throw std::runtime_error(std::string(fn) + ": not a proper list");
+	return *q;
+      }
+    }
+
+    //
+    //  (mapcar f list...): a list of (f x y ...) with x from the first
+    //  list, y from the second and so on, as long as the shortest
+    //
+    variant mapcar::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      variant f = eval(ctx, v >> car);
+      std::vector<cons_ptr> lists;
+      for (variant l = v >> cdr; !is_nil(l); l = l >> cdr)
+	lists.push_back(as_list(eval(ctx, l >> car), "mapcar"));
+      callback call(f, lists.size(), "mapcar");
+      list_builder result;
+      for (;;)
+	{
+	  for (unsigned u = 0; u < lists.size(); u++)
+	    {
+	      if (!lists[u])
+		return result.head;
+	      call.set(u, lists[u]->car);
+	      lists[u] = next_cons(lists[u], "mapcar");
+	    }
+	  if (lists.empty())
+	    return result.head;
+	  result.push(call.call(ctx));
+	}
+    }
+
+    //
+    //  (reduce f seq [initial]): (f (f (f initial a) b) c) and so on,
+    //  for a list, vector or lazy sequence.  Without initial, the
+    //  first element takes its place, and an empty sequence gives
+    //  (f).  + and * of numbers are worked out here rather than by
+    //  calling the builtin for each element.
+    //
+    variant reduce::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      variant f = eval(ctx, v >> car);
+      cursor_ptr items = iterate(eval(ctx, v >> cdr >> car), "reduce");
+      variant rest = v >> cdr >> cdr;
+      variant acc;
+      if (!is_nil(rest))
+	acc = eval(ctx, rest >> car);
+      else if (!items->next(ctx, acc))
+	{
+	  callback call(f, 0, "reduce");
+	  return call.call(ctx);
+	}
+
+      callback call(f, 2, "reduce");
+      const op<std::plus<double> >* plus = call.f().f.target<op<std::plus<double> > >();
+      const op<std::multiplies<double> >* times =
+	call.f().f.target<op<std::multiplies<double> > >();
+      for (variant x; items->next(ctx, x); )
+	{
+	  const double* a = get<double>(&acc);
+	  const double* b = get<double>(&x);
+	  if (a && b && plus)
+	    acc = *a + *b;
+	  else if (a && b && times)
+	    acc = *a * *b;
+	  else
+	    acc = call(ctx, acc, x);
+	}
+      return acc;
+    }
+
+    // (remove-if f list): a new list of the elements f isn't true of
+    variant remove_if::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      callback call(eval(ctx, v >> car), 1, "remove-if");
+      list_builder result;
+      for (cons_ptr p = as_list(eval(ctx, v >> cdr >> car), "remove-if"); p;
+	   p = next_cons(p, "remove-if"))
+	if (!(call(ctx, p->car) == t))
+	  result.push(p->car);
+      return result.head;
+    }
+
+    // (find x list): the first element equal to x, or nil
+    variant find::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      variant x = eval(ctx, v >> car);
+      for (cons_ptr p = as_list(eval(ctx, v >> cdr >> car), "find"); p;
+	   p = next_cons(p, "find"))
+	if (structurally_equal(x, p->car))
+	  return p->car;
+      return nil;
+    }
+
+    //
+    //  (assoc key alist): the first (k . value) in alist with k equal
+    //  to key, or nil
+    //
+    variant assoc::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      variant key = eval(ctx, v >> car);
+      for (cons_ptr p = as_list(eval(ctx, v >> cdr >> car), "assoc"); p;
+	   p = next_cons(p, "assoc"))
+	if (const cons_ptr* entry = get<cons_ptr>(&p->car))
+	  if (*entry && structurally_equal(key, (*entry)->car))
+	    return *entry;
+      return nil;
+    }
+
+    // (nth n list): element n, counting from 0, or nil past the end
+    variant nth::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      variant n = eval(ctx, v >> car);
+      const double* d = get<double>(&n);
+      if (!d || *d < 0 || *d != std::floor(*d))
+	throw std::runtime_error("nth: bad index");
+      cons_ptr p = as_list(eval(ctx, v >> cdr >> car), "nth");
+      for (double i = 0; p && i < *d; i++)
+	p = next_cons(p, "nth");
+      return p ? p->car : nil;
+    }
+
+    //
+    //  (append list...): the elements of each list in turn, in new
+    //  conses but for the last list, which is shared
+    //
+    variant append::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      std::vector<variant> lists;
+      for (; !is_nil(v); v = v >> cdr)
+	lists.push_back(eval(ctx, v >> car));
+      if (lists.empty())
+	return nil;
+      list_builder result;
+      for (unsigned u = 0; u + 1 < lists.size(); u++)
+	for (cons_ptr p = as_list(lists[u], "append"); p; p = next_cons(p, "append"))
+	  result.push(p->car);
+      if (!result.last)
+	return lists.back();
+      result.last->cdr = lists.back();
+      return result.head;
+    }
+
+    // (reverse list): a new list of its elements, last first
+    variant reverse::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      variant result = nil;
+      for (cons_ptr p = as_list(eval(ctx, v >> car), "reverse"); p;
+	   p = next_cons(p, "reverse"))
+	result = cons_ptr(new lisp::cons(p->car, result));
+      return result;
+    }
+
     variant print::operator()(context_ptr ctx, variant v)
     {
       SHOW;
@@ -240,6 +602,100 @@ namespace lisp {
       return eval(ctx, v);
     }
 
+    //
+    //  declarations are read by whoever owns the body they head, see
+    //  declare.hpp: evaluating one does nothing
+    //
+    variant declare::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      return nil;
+    }
+
+    variant tier_stats::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      return lisp::tier_stats();
+    }
+
+    //
+    //  (time form): the value of form, after saying on stderr how
+    //  long it took
+    //
+    variant time::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      timespec start, end;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      variant result = eval(ctx, v >> car);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      std::cerr << "; ";
+      lisp::print(std::cerr, v >> car);
+      std::cerr << ": " << ((end.tv_sec - start.tv_sec) * 1e3
+			    + (end.tv_nsec - start.tv_nsec) * 1e-6) << " ms\n";
+      return result;
+    }
+
+    //
+    //  print what a value is and, for functions, what analysis has
+    //  made of them
+    //
+    variant describe::operator()(context_ptr ctx, variant v)
+    {
+      SHOW;
+      variant what = eval(ctx, v >> car);
+      variant value = what;
+      if (const symbol* s = get<symbol>(&what))
+	value = ctx->get<variant>(*s);
+      const memoized* memo = 0;
+      if (const function* f = get<function>(&value))
+	if ((memo = f->f.target<memoized>()))
+	  value = memo->f;
+
+      lisp::print(std::cout, what);
+      procedure_ptr proc = as_procedure(value);
+      if (!proc)
+	{
+	  if (get<function>(&value))
+	    std::cout << " is a builtin\n";
+	  else
+	    {
+	      std::cout << " is ";
+	      lisp::print(std::cout, value);
+	      std::cout << "\n";
+	    }
+	  return nil;
+	}
+
+      const procedure& p = *proc;
+      std::cout << " is a function of (";
+      for (unsigned u = 0; u < p.args.size(); u++)
+	std::cout << (u ? " " : "") << p.args[u];
+      std::cout << ")\n";
+      if (memo)
+	std::cout << "  memoized: " << memo->table->size() << " results, "
+		  << memo->table->hits << " hits, " << memo->table->misses << " misses\n";
+
+      static const char* tiers[] = { "cold", "hot" };
+      std::cout << "  tier: " << tiers[p.tier] << ", " << p.calls << " calls\n";
+      if (p.tier == cold_tier)
+	return nil;
+
+      if (!p.inlined.empty())
+	{
+	  std::cout << "  inlined:";
+	  for (unsigned u = 0; u < p.inlined.size(); u++)
+	    std::cout << " " << p.inlined[u];
+	  std::cout << "\n";
+	}
+      std::cout << "  frame: " << (p.stack_frame ? "stack" : "heap") << "\n";
+      if (p.tail_loop)
+	std::cout << "  self tail calls: loop\n";
+      if (p.numeric)
+	std::cout << "  numeric: " << (p.numeric->native ? "native" : "unboxed") << "\n";
+      return nil;
+    }
+
     variant progn::operator()(context_ptr ctx, variant v)
     {
       SHOW;
@@ -253,52 +709,38 @@ namespace lisp {
       return last;
     }
 
+    namespace {
+      void bind_let(context_ptr& ctx, variant localpairlist, context_ptr& scope)
+      {
+	while (! is_nil(localpairlist))
+	  {
+	    variant pair = localpairlist >> car;
+	    scope->put(get<symbol>(pair >> car), eval(ctx, pair >> cdr >> car));
+	    localpairlist = localpairlist >> cdr;
+	  }
+      }
+    }
+
     variant let::operator()(context_ptr ctx, variant v)
     {
       SHOW;
       context_ptr scope = ctx->scope();
-      variant localpairlist = v >> car;
-      while (! is_nil(localpairlist))
-	{
-	  variant pair = localpairlist >> car;
-	  scope->put(get<symbol>(pair >> car), eval(ctx, pair >> cdr >> car));
-	  localpairlist = localpairlist >> cdr;
-	}
+      bind_let(ctx, v >> car, scope);
+      check_declarations(scope, v >> cdr);
       return progn()(scope, v >> cdr);
     }
 
-    template <typename Signature>
-    struct dispatch
+    //
+    //  a let that escape analysis has shown nobody can capture
+    //
+    variant stack_let::operator()(context_ptr ctx, variant v)
     {
-      variant code;
-      std::vector<symbol> args;
-      context_ptr ctx;
-
-      dispatch(variant _code) : code(_code) 
-      { 
-	dout("codeis", code);
-      }
-
-      variant operator()(context_ptr c, const variant v)
-      {
-	SHOW;
-	cons_ptr l = get<cons_ptr>(v);
-	context_ptr scope = ctx->scope();
-	for(unsigned u = 0; u<args.size(); u++)
-	  {
-	    variant evalled = eval(c, l->car);
-	    scope->put(args[u], evalled);
-	    l = get<cons_ptr>(l->cdr);
-	  }
-	
-	cons_ptr progn(new lisp::cons);
-	progn->car = symbol("progn");
-	progn->cdr = code;
-	variant v2(progn);
-	variant result = eval(scope, v2);
-	return result;
-      }
-    };
+      SHOW;
+      stack_scope scope(*ctx);
+      bind_let(ctx, v >> car, scope.get());
+      check_declarations(scope.get(), v >> cdr);
+      return progn()(scope.get(), v >> cdr);
+    }
 
     variant defun::operator()(context_ptr c, variant v)
     {
@@ -313,30 +755,51 @@ namespace lisp {
 	  args.push_back(s);
 	  l = l >> cdr;
 	}
-      dispatch<void> dispatcher(v >> cdr >> cdr);
-      dispatcher.args = args;
-      dispatcher.ctx = c;
-      c->put(s, function(dispatcher));
+      procedure_ptr proc(new procedure(v >> cdr >> cdr));
+      proc->name = s;
+      proc->args = args;
+      proc->declared = declare_args(args, proc->source);
+      proc->ctx = c->persistent();
+      try {
+	proc->redefinition = as_procedure(c->get<variant>(s)).get() != 0;
+      } catch (const std::exception&) { }
+      c->put(s, function(dispatch<void>(proc)));
+
+      if (tier_hot_calls == 0)
+	promote(proc);
+      else
+	invalidate(s);
 
       return s;
     }
 
+    namespace {
+      function make_lambda(context_ptr c, variant v, const closure_info& info,
+			   tier t)
+      {
+	procedure_ptr proc(new procedure(v >> cdr));
+	proc->tier = t;
+	proc->args = info.args;
+	proc->ctx = capture(c, info);
+	proc->stack_frame = info.stack_frame;
+	proc->declared = info.declared;
+	return function(dispatch<void>(proc));
+      }
+    }
+
     variant lambda::operator()(context_ptr c, variant v)
     {
       SHOW;
+      // nobody has seen the code around this one: share what it captures
+      closure_info_ptr info = analyze_closure(v, *c, 0);
+      return make_lambda(c, v, *info, cold_tier);
+    }
 
-      variant l = v >> car;
-      std::vector<symbol> args;
-      while (! is_nil(l))
-	{
-	  symbol s = get<symbol>(l >> car);
-	  args.push_back(s);
-	  l = l >> cdr;
-	}
-      dispatch<void> dispatcher(v >> cdr);
-      dispatcher.args = args;
-      dispatcher.ctx = c;
-      return function(dispatcher);
+    variant closure::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      // made by code that has been analyzed
+      return make_lambda(c, v, *info, hot_tier);
     }
 
     struct reexec 
@@ -401,6 +864,12 @@ namespace lisp {
       }
     };
 
+    variant native_macro::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      return eval(c, expand(v));
+    }
+
     variant defmacro::operator()(context_ptr c, variant v)
     {
       SHOW;
@@ -422,4 +891,33 @@ namespace lisp {
       return s;
     }
   }
+
+  procedure::procedure(const variant& _source)
+    : source(_source), redefinition(false), stack_frame(false), tail_loop(false),
+      tier(cold_tier), calls(0)
+  {
+    dout("codeis", source);
+    set_code(source);
+  }
+
+  void procedure::set_code(const variant& _code)
+  {
+    code = _code;
+    body = cons_ptr(new cons(symbol("progn"), code));
+  }
+
+  procedure_ptr as_procedure(const variant& v)
+  {
+    const function* f = get<function>(&v);
+    if (!f)
+      return procedure_ptr();
+    const ops::dispatch<void>* d = f->f.target<ops::dispatch<void> >();
+    return d ? d->proc : procedure_ptr();
+  }
+
+  bool is_macro(const variant& v)
+  {
+    const function* f = get<function>(&v);
+    return f && (f->f.target<ops::macroexec_dispatch>() || f->f.target<ops::native_macro>());
+  }
 }
@@ -8,12 +8,17 @@
 #ifndef LISP_OPS_HPP_INCLUDED
 #define LISP_OPS_HPP_INCLUDED
 
+#include <boost/shared_ptr.hpp>
+
 #define OP_FWD_DECL(T)					\
   struct T {						\
       variant operator()(context_ptr, variant);		\
   }; 
 
 namespace lisp {
+
+  struct closure_info;
+
   namespace ops {
 
     OP_FWD_DECL(cons);
@@ -34,7 +39,122 @@ namespace lisp {
     OP_FWD_DECL(defmacro);
     OP_FWD_DECL(lambda);
     OP_FWD_DECL(let);
+    OP_FWD_DECL(stack_let);
     OP_FWD_DECL(funcall);
+    OP_FWD_DECL(declare);
+    OP_FWD_DECL(tier_stats);
+    OP_FWD_DECL(describe);
+    OP_FWD_DECL(defun_memo);
+    OP_FWD_DECL(memoize);
+    OP_FWD_DECL(memo_stats);
+    OP_FWD_DECL(make_array);
+    OP_FWD_DECL(vector);
+    OP_FWD_DECL(aref);
+    OP_FWD_DECL(length);
+    OP_FWD_DECL(make_hash_table);
+    OP_FWD_DECL(gethash);
+    OP_FWD_DECL(puthash);
+    OP_FWD_DECL(remhash);
+    OP_FWD_DECL(maphash);
+    OP_FWD_DECL(hash_table_count);
+    OP_FWD_DECL(eq);
+    OP_FWD_DECL(time);
+    OP_FWD_DECL(make_f64vector);
+    OP_FWD_DECL(f64ref);
+    OP_FWD_DECL(f64_sum);
+    OP_FWD_DECL(f64_dot);
+    OP_FWD_DECL(f64_min);
+    OP_FWD_DECL(f64_max);
+    OP_FWD_DECL(f64_add);
+    OP_FWD_DECL(f64_mul);
+    OP_FWD_DECL(f64_scale);
+    OP_FWD_DECL(f64_prefix_sum);
+    OP_FWD_DECL(f64_kernels);
+    OP_FWD_DECL(defstruct);
+    OP_FWD_DECL(make_pmap);
+    OP_FWD_DECL(pmap_from_alist);
+    OP_FWD_DECL(pmap_get);
+    OP_FWD_DECL(pmap_assoc);
+    OP_FWD_DECL(pmap_dissoc);
+    OP_FWD_DECL(pmap_count);
+    OP_FWD_DECL(pmap_alist);
+    OP_FWD_DECL(make_pvector);
+    OP_FWD_DECL(pvector_from_list);
+    OP_FWD_DECL(pvector_nth);
+    OP_FWD_DECL(pvector_assoc);
+    OP_FWD_DECL(pvector_conj);
+    OP_FWD_DECL(pvector_pop);
+    OP_FWD_DECL(pvector_list);
+    OP_FWD_DECL(make_bit_vector);
+    OP_FWD_DECL(sbit);
+    OP_FWD_DECL(bit_and);
+    OP_FWD_DECL(bit_or);
+    OP_FWD_DECL(bit_xor);
+    OP_FWD_DECL(bit_not);
+    OP_FWD_DECL(popcount);
+    OP_FWD_DECL(find_first_set);
+    OP_FWD_DECL(map_set_bits);
+    OP_FWD_DECL(bit_positions);
+    OP_FWD_DECL(bit_kernels);
+    OP_FWD_DECL(make_table);
+    OP_FWD_DECL(table_rows);
+    OP_FWD_DECL(table_columns);
+    OP_FWD_DECL(table_column);
+    OP_FWD_DECL(table_select);
+    OP_FWD_DECL(table_where);
+    OP_FWD_DECL(table_filter);
+    OP_FWD_DECL(table_sort);
+    OP_FWD_DECL(table_group_by);
+    OP_FWD_DECL(table_join);
+    OP_FWD_DECL(mapcar);
+    OP_FWD_DECL(reduce);
+    OP_FWD_DECL(remove_if);
+    OP_FWD_DECL(find);
+    OP_FWD_DECL(assoc);
+    OP_FWD_DECL(nth);
+    OP_FWD_DECL(append);
+    OP_FWD_DECL(reverse);
+    OP_FWD_DECL(range);
+    OP_FWD_DECL(lazy_map);
+    OP_FWD_DECL(lazy_filter);
+    OP_FWD_DECL(take);
+    OP_FWD_DECL(into);
+    OP_FWD_DECL(make_generator);
+    OP_FWD_DECL(yield);
+    OP_FWD_DECL(next);
+    OP_FWD_DECL(sort);
+    OP_FWD_DECL(stable_sort);
+    OP_FWD_DECL(concatenate);
+    OP_FWD_DECL(make_string_output_stream);
+    OP_FWD_DECL(write_string);
+    OP_FWD_DECL(get_output_stream_string);
+    OP_FWD_DECL(regex_compile);
+    OP_FWD_DECL(regex_match);
+    OP_FWD_DECL(regex_search);
+    OP_FWD_DECL(regex_split);
+
+    //
+    //  a macro whose expansion is worked out in C++: expand gets the
+    //  arguments, unevaluated, and what it returns is evaluated in
+    //  place of the form
+    //
+    struct native_macro
+    {
+      variant (*expand)(const variant& args);
+      variant operator()(context_ptr, variant);
+    };
+
+    // with-output-to-string, see strings.cpp
+    variant with_output_to_string();
+
+    //
+    //  a lambda that closure_conversion has already looked at
+    //
+    struct closure
+    {
+      boost::shared_ptr<const closure_info> info;
+      variant operator()(context_ptr, variant);
+    };
 
     template <typename Op>
     struct op 
@@ -45,6 +165,28 @@ namespace lisp {
       op(double);
       variant operator()(context_ptr, variant); 
     };
+
+    //
+    //  < > <= >= =: t if every neighbouring pair of arguments is
+    //  in order
+    //
+    template <typename Op>
+    struct compare
+    {
+      Op op_;
+      variant operator()(context_ptr, variant);
+    };
+
+    //
+    //  string< string>: the same, for strings or symbols, by their
+    //  characters
+    //
+    template <typename Op>
+    struct string_compare
+    {
+      Op op_;
+      variant operator()(context_ptr, variant);
+    };
   }
 }
 
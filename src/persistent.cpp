@@ -0,0 +1,791 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "equal.hpp"
+#include "persistent.hpp"
+#include "kernels.hpp"
+
+#include <boost/cstdint.hpp>
+#include <stdexcept>
+#include <string>
+
+using boost::get;
+
+namespace lisp {
+
+  //
+  //  A bitmap node has an entry for each bit set in bitmap, in bit
+  //  order: either a key and its value, or a child one level down.
+  //  A collision node holds keys that differ but hash alike.
+  //
+  struct hamt_node
+  {
+    struct entry
+    {
+      std::size_t hash;
+      variant key, value;
+      hamt_node_ptr child;
+    };
+
+    unsigned count;
+    unsigned long edit;
+    boost::uint32_t bitmap;
+    bool collision;
+    std::vector<entry> entries;
+
+    hamt_node(unsigned long e) : count(0), edit(e), bitmap(0), collision(false) { }
+  };
+
+  // a leaf has items, anything above it children
+  struct pvector_node
+  {
+    unsigned count;
+    unsigned long edit;
+    std::vector<variant> items;
+    std::vector<pvector_node_ptr> children;
+
+    pvector_node(unsigned long e) : count(0), edit(e) { }
+  };
+
+  void intrusive_ptr_add_ref(hamt_node* n) { n->count++; }
+  void intrusive_ptr_release(hamt_node* n) { if (--n->count == 0) delete n; }
+  void intrusive_ptr_add_ref(pvector_node* n) { n->count++; }
+  void intrusive_ptr_release(pvector_node* n) { if (--n->count == 0) delete n; }
+  void intrusive_ptr_add_ref(pmap* m) { m->count++; }
+  void intrusive_ptr_release(pmap* m) { if (--m->count == 0) delete m; }
+  void intrusive_ptr_add_ref(pvector* v) { v->count++; }
+  void intrusive_ptr_release(pvector* v) { if (--v->count == 0) delete v; }
+
+  namespace {
+
+    enum { bits = 5, width = 1 << bits, mask = width - 1 };
+
+    // each transient gets a number of its own, never used again
+    unsigned long next_edit = 0;
+
+    unsigned long new_edit()
+    {
+      return ++next_edit;
+    }
+
+    unsigned popcount(boost::uint32_t x)
+    {
+      x = x - ((x >> 1) & 0x55555555);
+      x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+      return (((x + (x >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+    }
+
+    //
+    //  the hamt
+    //
+
+    typedef hamt_node::entry entry;
+
+    unsigned fragment(std::size_t hash, unsigned shift)
+    {
+      return (hash >> shift) & mask;
+    }
+
+    // node itself if edit may change it, otherwise a copy that it may
+    hamt_node_ptr editable(const hamt_node_ptr& node, unsigned long edit)
+    {
+      if (edit && node->edit == edit)
+	return node;
+      hamt_node_ptr copy(new hamt_node(edit));
+      copy->bitmap = node->bitmap;
+      copy->collision = node->collision;
+      copy->entries = node->entries;
+      return copy;
+    }
+
+    entry leaf(std::size_t hash, const variant& key, const variant& value)
+    {
+      entry e;
+      e.hash = hash;
+      e.key = key;
+      e.value = value;
+      return e;
+    }
+
+    entry branch(const hamt_node_ptr& child)
+    {
+      entry e;
+      e.hash = 0;
+      e.child = child;
+      return e;
+    }
+
+    // a node at shift holding both a and b, whose keys differ
+    hamt_node_ptr merge(unsigned long edit, unsigned shift, const entry& a, const entry& b)
+    {
+      hamt_node_ptr node(new hamt_node(edit));
+      if (a.hash == b.hash)
+	{
+	  node->collision = true;
+	  node->entries.push_back(a);
+	  node->entries.push_back(b);
+	  return node;
+	}
+      unsigned fa = fragment(a.hash, shift), fb = fragment(b.hash, shift);
+      if (fa == fb)
+	{
+	  node->bitmap = 1u << fa;
+	  node->entries.push_back(branch(merge(edit, shift + bits, a, b)));
+	}
+      else
+	{
+	  node->bitmap = (1u << fa) | (1u << fb);
+	  node->entries.push_back(fa < fb ? a : b);
+	  node->entries.push_back(fa < fb ? b : a);
+	}
+      return node;
+    }
+
+    const variant* find(const hamt_node_ptr& root, std::size_t hash, const variant& key)
+    {
+      hamt_node* node = root.get();
+      for (unsigned shift = 0; node; shift += bits)
+	{
+	  if (node->collision)
+	    {
+	      for (unsigned u = 0; u < node->entries.size(); u++)
+		if (node->entries[u].hash == hash
+		    && structurally_equal(node->entries[u].key, key))
+		  return &node->entries[u].value;
+	      return 0;
+	    }
+	  boost::uint32_t bit = 1u << fragment(hash, shift);
+	  if (!(node->bitmap & bit))
+	    return 0;
+	  const entry& e = node->entries[popcount(node->bitmap & (bit - 1))];
+	  if (!e.child)
+	    return e.hash == hash && structurally_equal(e.key, key) ? &e.value : 0;
+	  node = e.child.get();
+	}
+      return 0;
+    }
+
+    hamt_node_ptr assoc(const hamt_node_ptr& node, unsigned long edit, unsigned shift,
+			const entry& e, bool& added)
+    {
+      if (!node)
+	{
+	  hamt_node_ptr n(new hamt_node(edit));
+	  n->bitmap = 1u << fragment(e.hash, shift);
+	  n->entries.push_back(e);
+	  added = true;
+	  return n;
+	}
+
+      if (node->collision)
+	{
+	  if (node->entries[0].hash != e.hash)
+	    {
+	      // put the collisions one level down and try again from here
+	      hamt_node_ptr n(new hamt_node(edit));
+	      n->bitmap = 1u << fragment(node->entries[0].hash, shift);
+	      n->entries.push_back(branch(node));
+	      return assoc(n, edit, shift, e, added);
+	    }
+	  hamt_node_ptr n = editable(node, edit);
+	  for (unsigned u = 0; u < n->entries.size(); u++)
+	    if (structurally_equal(n->entries[u].key, e.key))
+	      {
+		n->entries[u].value = e.value;
+		return n;
+	      }
+	  n->entries.push_back(e);
+	  added = true;
+	  return n;
+	}
+
+      boost::uint32_t bit = 1u << fragment(e.hash, shift);
+      unsigned i = popcount(node->bitmap & (bit - 1));
+      if (!(node->bitmap & bit))
+	{
+	  hamt_node_ptr n = editable(node, edit);
+	  n->bitmap |= bit;
+	  n->entries.insert(n->entries.begin() + i, e);
+	  added = true;
+	  return n;
+	}
+
+      const entry& here = node->entries[i];
+      if (here.child)
+	{
+	  hamt_node_ptr child = assoc(here.child, edit, shift + bits, e, added);
+	  if (child == here.child)
+	    return node;
+	  hamt_node_ptr n = editable(node, edit);
+	  n->entries[i].child = child;
+	  return n;
+	}
+
+      hamt_node_ptr n = editable(node, edit);
+      if (here.hash == e.hash && structurally_equal(here.key, e.key))
+	n->entries[i].value = e.value;
+      else
+	{
+	  n->entries[i] = branch(merge(edit, shift + bits, here, e));
+	  added = true;
+	}
+      return n;
+    }
+
+    // 0 if nothing is left
+    hamt_node_ptr dissoc(const hamt_node_ptr& node, unsigned long edit, unsigned shift,
+			 std::size_t hash, const variant& key, bool& removed)
+    {
+      if (!node)
+	return node;
+
+      if (node->collision)
+	{
+	  for (unsigned u = 0; u < node->entries.size(); u++)
+	    if (node->entries[u].hash == hash
+		&& structurally_equal(node->entries[u].key, key))
+	      {
+		removed = true;
+		if (node->entries.size() == 1)
+		  return 0;
+		hamt_node_ptr n = editable(node, edit);
+		n->entries.erase(n->entries.begin() + u);
+		return n;
+	      }
+	  return node;
+	}
+
+      boost::uint32_t bit = 1u << fragment(hash, shift);
+      if (!(node->bitmap & bit))
+	return node;
+      unsigned i = popcount(node->bitmap & (bit - 1));
+      const entry& here = node->entries[i];
+
+      hamt_node_ptr child;
+      if (here.child)
+	{
+	  child = dissoc(here.child, edit, shift + bits, hash, key, removed);
+	  if (child == here.child)
+	    return node;
+	}
+      else if (here.hash != hash || !structurally_equal(here.key, key))
+	return node;
+      else
+	removed = true;
+
+      if (child)
+	{
+	  hamt_node_ptr n = editable(node, edit);
+	  n->entries[i].child = child;
+	  return n;
+	}
+      if (node->entries.size() == 1)
+	return 0;
+      hamt_node_ptr n = editable(node, edit);
+      n->bitmap &= ~bit;
+      n->entries.erase(n->entries.begin() + i);
+      return n;
+    }
+
+    void entries(const hamt_node_ptr& node, std::vector<std::pair<variant, variant> >& out)
+    {
+      if (!node)
+	return;
+      for (unsigned u = 0; u < node->entries.size(); u++)
+	if (node->entries[u].child)
+	  entries(node->entries[u].child, out);
+	else
+	  out.push_back(std::make_pair(node->entries[u].key, node->entries[u].value));
+    }
+
+    //
+    //  the vector.  Everything below works on the parts of one, so
+    //  that the persistent and transient versions can share it.
+    //
+
+    struct vector_parts
+    {
+      std::size_t size;
+      unsigned shift;
+      pvector_node_ptr root, tail;
+    };
+
+    pvector_node_ptr editable(const pvector_node_ptr& node, unsigned long edit)
+    {
+      if (edit && node->edit == edit)
+	return node;
+      pvector_node_ptr copy(new pvector_node(edit));
+      copy->items = node->items;
+      copy->children = node->children;
+      return copy;
+    }
+
+    // index of the first item in the tail
+    std::size_t tail_offset(std::size_t size)
+    {
+      return size < width ? 0 : ((size - 1) >> bits) << bits;
+    }
+
+    const variant& nth(const vector_parts& v, std::size_t i)
+    {
+      if (i >= tail_offset(v.size))
+	return v.tail->items[i & mask];
+      const pvector_node* node = v.root.get();
+      for (unsigned level = v.shift; level > 0; level -= bits)
+	node = node->children[(i >> level) & mask].get();
+      return node->items[i & mask];
+    }
+
+    // leaf, level levels down a fresh spine
+    pvector_node_ptr new_path(unsigned long edit, unsigned level, const pvector_node_ptr& leaf)
+    {
+      if (level == 0)
+	return leaf;
+      pvector_node_ptr node(new pvector_node(edit));
+      node->children.push_back(new_path(edit, level - bits, leaf));
+      return node;
+    }
+
+    // parent with leaf added as the last leaf below it
+    pvector_node_ptr push_tail(unsigned long edit, std::size_t size, unsigned level,
+			       const pvector_node_ptr& parent, const pvector_node_ptr& leaf)
+    {
+      pvector_node_ptr node = editable(parent, edit);
+      unsigned i = ((size - 1) >> level) & mask;
+      pvector_node_ptr child;
+      if (level == bits)
+	child = leaf;
+      else if (i < parent->children.size())
+	child = push_tail(edit, size, level - bits, parent->children[i], leaf);
+      else
+	child = new_path(edit, level - bits, leaf);
+      if (i < node->children.size())
+	node->children[i] = child;
+      else
+	node->children.push_back(child);
+      return node;
+    }
+
+    void conj(vector_parts& v, unsigned long edit, const variant& value)
+    {
+      if (v.size - tail_offset(v.size) < width)
+	{
+	  v.tail = editable(v.tail, edit);
+	  v.tail->items.push_back(value);
+	  v.size++;
+	  return;
+	}
+
+      // the tail is full: it goes into the tree, and a new one starts
+      if ((v.size >> bits) > (std::size_t(1) << v.shift))
+	{
+	  pvector_node_ptr root(new pvector_node(edit));
+	  root->children.push_back(v.root);
+	  root->children.push_back(new_path(edit, v.shift, v.tail));
+	  v.root = root;
+	  v.shift += bits;
+	}
+      else
+	v.root = push_tail(edit, v.size, v.shift, v.root, v.tail);
+      v.tail = new pvector_node(edit);
+      v.tail->items.push_back(value);
+      v.size++;
+    }
+
+    pvector_node_ptr assoc(unsigned long edit, unsigned level, const pvector_node_ptr& node,
+			   std::size_t i, const variant& value)
+    {
+      pvector_node_ptr n = editable(node, edit);
+      if (level == 0)
+	n->items[i & mask] = value;
+      else
+	{
+	  unsigned sub = (i >> level) & mask;
+	  n->children[sub] = assoc(edit, level - bits, node->children[sub], i, value);
+	}
+      return n;
+    }
+
+    // node without its last leaf, or 0 if that was all it had
+    pvector_node_ptr pop_tail(std::size_t size, unsigned level, const pvector_node_ptr& node)
+    {
+      unsigned i = ((size - 2) >> level) & mask;
+      if (level > bits)
+	{
+	  pvector_node_ptr child = pop_tail(size, level - bits, node->children[i]);
+	  if (!child && i == 0)
+	    return 0;
+	  pvector_node_ptr n = editable(node, 0);
+	  if (child)
+	    n->children[i] = child;
+	  else
+	    n->children.pop_back();
+	  return n;
+	}
+      if (i == 0)
+	return 0;
+      pvector_node_ptr n = editable(node, 0);
+      n->children.pop_back();
+      return n;
+    }
+
+    // the leaf holding item i, which isn't in the tail
+    pvector_node_ptr leaf_for(const vector_parts& v, std::size_t i)
+    {
+      pvector_node_ptr node = v.root;
+      for (unsigned level = v.shift; level > 0; level -= bits)
+	node = node->children[(i >> level) & mask];
+      return node;
+    }
+
+    pvector_ptr make_pvector(const vector_parts& v)
+    {
+      pvector_ptr p(new pvector);
+      p->size = v.size;
+      p->shift = v.shift;
+      p->root = v.root;
+      p->tail = v.tail;
+      return p;
+    }
+
+    vector_parts parts_of(const pvector& p)
+    {
+      vector_parts v = { p.size, p.shift, p.root, p.tail };
+      return v;
+    }
+  }
+
+  const variant* pmap::find(const variant& key) const
+  {
+    return lisp::find(root, structural_hash(key), key);
+  }
+
+  pmap_ptr pmap::assoc(const variant& key, const variant& value) const
+  {
+    bool added = false;
+    pmap_ptr m(new pmap);
+    m->root = lisp::assoc(root, 0, 0, leaf(structural_hash(key), key, value), added);
+    m->size = size + added;
+    return m;
+  }
+
+  pmap_ptr pmap::dissoc(const variant& key) const
+  {
+    bool removed = false;
+    hamt_node_ptr r = lisp::dissoc(root, 0, 0, structural_hash(key), key, removed);
+    pmap_ptr m(new pmap);
+    m->root = r;
+    m->size = size - removed;
+    return m;
+  }
+
+  void pmap::entries(std::vector<std::pair<variant, variant> >& out) const
+  {
+    lisp::entries(root, out);
+  }
+
+  pmap_transient::pmap_transient(const pmap& from)
+    : edit_(new_edit()), size_(from.size), root_(from.root)
+  { }
+
+  void pmap_transient::assoc(const variant& key, const variant& value)
+  {
+    bool added = false;
+    root_ = lisp::assoc(root_, edit_, 0, leaf(structural_hash(key), key, value), added);
+    size_ += added;
+  }
+
+  void pmap_transient::dissoc(const variant& key)
+  {
+    bool removed = false;
+    root_ = lisp::dissoc(root_, edit_, 0, structural_hash(key), key, removed);
+    size_ -= removed;
+  }
+
+  pmap_ptr pmap_transient::persistent()
+  {
+    // nodes still marked with our edit are safe: nobody will use it again
+    edit_ = 0;
+    pmap_ptr m(new pmap);
+    m->root = root_;
+    m->size = size_;
+    return m;
+  }
+
+  pvector::pvector()
+    : count(0), size(0), shift(bits),
+      root(new pvector_node(0)), tail(new pvector_node(0))
+  { }
+
+  const variant& pvector::nth(std::size_t i) const
+  {
+    return lisp::nth(parts_of(*this), i);
+  }
+
+  pvector_ptr pvector::assoc(std::size_t i, const variant& value) const
+  {
+    if (i == size)
+      return conj(value);
+    vector_parts v = parts_of(*this);
+    if (i >= tail_offset(size))
+      {
+	v.tail = editable(tail, 0);
+	v.tail->items[i & mask] = value;
+      }
+    else
+      v.root = lisp::assoc(0, shift, root, i, value);
+    return make_pvector(v);
+  }
+
+  pvector_ptr pvector::conj(const variant& value) const
+  {
+    vector_parts v = parts_of(*this);
+    lisp::conj(v, 0, value);
+    return make_pvector(v);
+  }
+
+  pvector_ptr pvector::pop() const
+  {
+    vector_parts v = parts_of(*this);
+    if (size == 1)
+      return pvector_ptr(new pvector);
+    if (size - tail_offset(size) > 1)
+      {
+	v.tail = editable(tail, 0);
+	v.tail->items.pop_back();
+      }
+    else
+      {
+	v.tail = leaf_for(v, size - 2);
+	v.root = pop_tail(size, shift, root);
+	if (!v.root)
+	  v.root = new pvector_node(0);
+	if (shift > bits && v.root->children.size() == 1)
+	  {
+	    v.root = v.root->children[0];
+	    v.shift -= bits;
+	  }
+      }
+    v.size--;
+    return make_pvector(v);
+  }
+
+  pvector_transient::pvector_transient(const pvector& from)
+    : edit_(new_edit()), size_(from.size), shift_(from.shift),
+      root_(from.root), tail_(from.tail)
+  { }
+
+  void pvector_transient::conj(const variant& value)
+  {
+    vector_parts v = { size_, shift_, root_, tail_ };
+    lisp::conj(v, edit_, value);
+    size_ = v.size;
+    shift_ = v.shift;
+    root_ = v.root;
+    tail_ = v.tail;
+  }
+
+  pvector_ptr pvector_transient::persistent()
+  {
+    edit_ = 0;
+    vector_parts v = { size_, shift_, root_, tail_ };
+    return make_pvector(v);
+  }
+
+  namespace ops {
+
+    namespace {
+
+      pmap_ptr as_pmap(const variant& v, const char* fn)
+      {
+	const pmap_ptr* m = get<pmap_ptr>(&v);
+	if (!m)
+	  throw std::runtime_error(std::string(fn) + ": not a pmap");
+	return *m;
+      }
+
+      pvector_ptr as_pvector(const variant& v, const char* fn)
+      {
+	const pvector_ptr* p = get<pvector_ptr>(&v);
+	if (!p)
+	  throw std::runtime_error(std::string(fn) + ": not a pvector");
+	return *p;
+      }
+
+      variant list_of(const std::vector<variant>& items)
+      {
+	variant l = nil;
+	for (unsigned u = items.size(); u > 0; u--)
+	  l = cons_ptr(new lisp::cons(items[u-1], l));
+	return l;
+      }
+    }
+
+    //
+    //  (pmap key value ...)
+    //
+    variant make_pmap::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      pmap empty;
+      pmap_transient t(empty);
+      for (; !is_nil(v); v = v >> cdr >> cdr)
+	{
+	  if (is_nil(v >> cdr))
+	    throw std::runtime_error("pmap: a key without a value");
+	  variant key = eval(c, v >> car);
+	  t.assoc(key, eval(c, v >> cdr >> car));
+	}
+      return t.persistent();
+    }
+
+    //
+    //  (pmap-from-alist '((key value) ...)), built in place by a
+    //  transient
+    //
+    variant pmap_from_alist::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      pmap empty;
+      pmap_transient t(empty);
+      for (variant l = eval(c, v >> car); !is_nil(l); l = l >> cdr)
+	{
+	  variant pair = l >> car;
+	  variant rest = pair >> cdr;
+	  // (key value) or (key . value)
+	  t.assoc(pair >> car, get<cons_ptr>(&rest) ? rest >> car : rest);
+	}
+      return t.persistent();
+    }
+
+    //
+    //  (pmap-get map key [default])
+    //
+    variant pmap_get::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      pmap_ptr m = as_pmap(eval(c, v >> car), "pmap-get");
+      variant key = eval(c, v >> cdr >> car);
+      if (const variant* found = m->find(key))
+	return *found;
+      variant rest = v >> cdr >> cdr;
+      return is_nil(rest) ? nil : eval(c, rest >> car);
+    }
+
+    //
+    //  (pmap-assoc map key value): a new map, map itself is unchanged
+    //
+    variant pmap_assoc::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      pmap_ptr m = as_pmap(eval(c, v >> car), "pmap-assoc");
+      variant key = eval(c, v >> cdr >> car);
+      return m->assoc(key, eval(c, v >> cdr >> cdr >> car));
+    }
+
+    variant pmap_dissoc::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      pmap_ptr m = as_pmap(eval(c, v >> car), "pmap-dissoc");
+      return m->dissoc(eval(c, v >> cdr >> car));
+    }
+
+    variant pmap_count::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      return double(as_pmap(eval(c, v >> car), "pmap-count")->size);
+    }
+
+    //
+    //  (pmap-alist map): ((key value) ...), in no particular order
+    //
+    variant pmap_alist::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      std::vector<std::pair<variant, variant> > entries;
+      as_pmap(eval(c, v >> car), "pmap-alist")->entries(entries);
+      std::vector<variant> pairs;
+      for (unsigned u = 0; u < entries.size(); u++)
+	pairs.push_back(cons_ptr(new lisp::cons(entries[u].first,
+						cons_ptr(new lisp::cons(entries[u].second)))));
+      return list_of(pairs);
+    }
+
+    //
+    //  (pvector item ...)
+    //
+    variant make_pvector::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      pvector empty;
+      pvector_transient t(empty);
+      for (; !is_nil(v); v = v >> cdr)
+	t.conj(eval(c, v >> car));
+      return t.persistent();
+    }
+
+    variant pvector_from_list::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      pvector empty;
+      pvector_transient t(empty);
+      for (variant l = eval(c, v >> car); !is_nil(l); l = l >> cdr)
+	t.conj(l >> car);
+      return t.persistent();
+    }
+
+    variant pvector_nth::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      pvector_ptr p = as_pvector(eval(c, v >> car), "pvector-nth");
+      return p->nth(as_index(eval(c, v >> cdr >> car), p->size, "pvector-nth"));
+    }
+
+    //
+    //  (pvector-assoc vector i item): a new vector with item at i,
+    //  which may also be one past the end
+    //
+    variant pvector_assoc::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      pvector_ptr p = as_pvector(eval(c, v >> car), "pvector-assoc");
+      std::size_t i = as_index(eval(c, v >> cdr >> car), p->size + 1, "pvector-assoc");
+      return p->assoc(i, eval(c, v >> cdr >> cdr >> car));
+    }
+
+    variant pvector_conj::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      pvector_ptr p = as_pvector(eval(c, v >> car), "pvector-conj");
+      return p->conj(eval(c, v >> cdr >> car));
+    }
+
+    variant pvector_pop::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      pvector_ptr p = as_pvector(eval(c, v >> car), "pvector-pop");
+      if (p->size == 0)
+	throw std::runtime_error("pvector-pop: empty pvector");
+      return p->pop();
+    }
+
+    variant pvector_list::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      pvector_ptr p = as_pvector(eval(c, v >> car), "pvector-list");
+      std::vector<variant> items;
+      for (std::size_t i = 0; i < p->size; i++)
+	items.push_back(p->nth(i));
+      return list_of(items);
+    }
+  }
+}
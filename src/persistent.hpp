@@ -0,0 +1,125 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_PERSISTENT_HPP_INCLUDED
+#define LISP_PERSISTENT_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/noncopyable.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+//
+//  Collections that are never changed once made.  Adding to one, or
+//  taking something out, gives a new one that shares everything but
+//  the path to what changed with the old, so keeping the old one
+//  around costs next to nothing.
+//
+//  A transient is how to make a lot of changes in a row: it marks the
+//  nodes it copies as its own and changes those in place, and when it
+//  is done hands out a persistent collection again.  It never touches
+//  a node anybody else can see.
+//
+
+namespace lisp {
+
+  //
+  //  Both kinds of node are refcounted like conses.  edit is the
+  //  transient that may still change the node, 0 once nobody may.
+  //
+  struct hamt_node;
+  typedef boost::intrusive_ptr<hamt_node> hamt_node_ptr;
+
+  struct pvector_node;
+  typedef boost::intrusive_ptr<pvector_node> pvector_node_ptr;
+
+  void intrusive_ptr_add_ref(hamt_node*);
+  void intrusive_ptr_release(hamt_node*);
+  void intrusive_ptr_add_ref(pvector_node*);
+  void intrusive_ptr_release(pvector_node*);
+
+  //
+  //  pmap: a hash array mapped trie.  Each level looks at the next
+  //  five bits of a key's hash, and keeps only the branches it has,
+  //  with a bitmap saying which those are.  Keys are the same if equal
+  //  says so, see equal.hpp.
+  //
+  struct pmap : boost::noncopyable
+  {
+    unsigned count;
+    std::size_t size;
+    hamt_node_ptr root;            // 0 when empty
+
+    pmap() : count(0), size(0) { }
+
+    const variant* find(const variant& key) const;
+    pmap_ptr assoc(const variant& key, const variant& value) const;
+    pmap_ptr dissoc(const variant& key) const;
+
+    // every key and value, in no particular order
+    void entries(std::vector<std::pair<variant, variant> >& out) const;
+  };
+
+  class pmap_transient : boost::noncopyable
+  {
+  public:
+    pmap_transient(const pmap& from);
+
+    void assoc(const variant& key, const variant& value);
+    void dissoc(const variant& key);
+
+    // the map as it stands; the transient can't be used after
+    pmap_ptr persistent();
+
+  private:
+    unsigned long edit_;
+    std::size_t size_;
+    hamt_node_ptr root_;
+  };
+
+  //
+  //  pvector: a tree of 32 way nodes with the items in the leaves, so
+  //  each level of it is five bits of the index.  The last leaf is
+  //  kept apart, in tail, which makes adding at the end cheap.
+  //
+  struct pvector : boost::noncopyable
+  {
+    unsigned count;
+    std::size_t size;
+    unsigned shift;                // of the root's level
+    pvector_node_ptr root, tail;
+
+    pvector();
+
+    const variant& nth(std::size_t i) const;
+    pvector_ptr assoc(std::size_t i, const variant& value) const;
+    pvector_ptr conj(const variant& value) const;
+    pvector_ptr pop() const;
+  };
+
+  class pvector_transient : boost::noncopyable
+  {
+  public:
+    pvector_transient(const pvector& from);
+
+    void conj(const variant& value);
+
+    // the vector as it stands; the transient can't be used after
+    pvector_ptr persistent();
+
+  private:
+    unsigned long edit_;
+    std::size_t size_;
+    unsigned shift_;
+    pvector_node_ptr root_, tail_;
+  };
+}
+
+#endif
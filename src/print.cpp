@@ -7,6 +7,13 @@
 
 #include <iostream>
 #include "print.hpp"
+#include "hash_table.hpp"
+#include "f64vector.hpp"
+#include "structure.hpp"
+#include "persistent.hpp"
+#include "bitvector.hpp"
+#include "table.hpp"
+#include "lazy.hpp"
 #include "config.hpp"
 
 namespace lisp {
@@ -29,10 +36,10 @@ namespace lisp {
     os << d;
   }
     
-  void cons_print::operator()(const std::string& s) const
+  void cons_print::operator()(const string_ptr& s) const
   {
     SHOW;
-    os << "\"" << s << "\"";
+    os << "\"" << s->chars << "\"";
   }
     
   void cons_print::operator()(const symbol& s) const
@@ -99,6 +106,87 @@ namespace lisp {
     visit(s.v);
   }
 
+  void cons_print::operator()(const array_ptr& a) const
+  {
+    os << "#(";
+    for (unsigned u = 0; u < a->items.size(); u++)
+      {
+	if (u)
+	  os << " ";
+	visit(a->items[u]);
+      }
+    os << ")";
+  }
+
+  void cons_print::operator()(const hash_table_ptr& h) const
+  {
+    os << "#<hash-table " << (h->kind() == hash_table::eq_test ? "eq" : "equal")
+       << " " << h->size() << ">";
+  }
+
+  void cons_print::operator()(const f64vector_ptr& f) const
+  {
+    os << "#<f64vector";
+    for (unsigned u = 0; u < f->items.size(); u++)
+      os << " " << f->items[u];
+    os << ">";
+  }
+
+  void cons_print::operator()(const structure_ptr& s) const
+  {
+    os << "#S(" << s->type->name;
+    for (unsigned u = 0; u < s->items.size(); u++)
+      {
+	os << " :" << s->type->slots[u] << " ";
+	visit(s->items[u]);
+      }
+    os << ")";
+  }
+
+  void cons_print::operator()(const pmap_ptr& m) const
+  {
+    std::vector<std::pair<variant, variant> > entries;
+    m->entries(entries);
+    os << "#<pmap";
+    for (unsigned u = 0; u < entries.size(); u++)
+      {
+	os << " ";
+	visit(entries[u].first);
+	os << " ";
+	visit(entries[u].second);
+      }
+    os << ">";
+  }
+
+  void cons_print::operator()(const pvector_ptr& p) const
+  {
+    os << "#<pvector";
+    for (std::size_t i = 0; i < p->size; i++)
+      {
+	os << " ";
+	visit(p->nth(i));
+      }
+    os << ">";
+  }
+
+  void cons_print::operator()(const bitvector_ptr& b) const
+  {
+    os << "#*" << b->str();
+  }
+
+  void cons_print::operator()(const table_ptr& t) const
+  {
+    os << "#<table " << t->rows;
+    for (unsigned u = 0; u < t->columns.size(); u++)
+      os << " (" << t->columns[u].name << " " << t->columns[u].kind_name() << ")";
+    os << ">";
+  }
+
+  void cons_print::operator()(const lazy_seq_ptr& l) const
+  {
+    os << "#<" << l->name() << ">";
+  }
+
   void print(std::ostream& os, const variant& v)
   {
     cons_print visitor(os);
@@ -0,0 +1,353 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "strings.hpp"
+#include "regex.hpp"
+
+// string_token.hpp uses std::hex without including <ios>
+#include <ios>
+// generator.hpp still uses std::auto_ptr
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#include <boost/spirit/home/support/detail/lexer/generator.hpp>
+#include <boost/spirit/home/support/detail/lexer/rules.hpp>
+#include <boost/spirit/home/support/detail/lexer/state_machine.hpp>
+#pragma GCC diagnostic pop
+#include <boost/shared_ptr.hpp>
+
+#include <cctype>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using boost::get;
+
+namespace lisp {
+
+  namespace {
+
+    //
+    //  A pattern compiled by lexertl into a minimal DFA, copied out
+    //  into one flat table.  The syntax is lexertl's: literals,
+    //  "." (not newline), [classes] with ranges and [^negation], \d \s \w and
+    //  their capitals, \n \t \xhh, grouping with (), | and the
+    //  repeats * + ? {n} {n,} {n,m}.  ^ and $ are anchors only at
+    //  the very start and end of the whole pattern.  There are no
+    //  backreferences, lookaround or captures.  Where lexertl would
+    //  read / as trailing context and "..." as a quoted string, they
+    //  are plain characters here, see lexertl_pattern; its {NAME}
+    //  macros are refused.
+    //
+    //  Row 0 is the dead state and row 1 the
+    //  start; the first dfa_offset columns of a row say whether it
+    //  accepts and where ^ and $ lead, the rest are indexed by
+    //  lookup[c].  A step is two loads, and nothing is ever tried
+    //  twice, so matching is linear in the length of the text.
+    //
+    struct dfa
+    {
+      std::size_t lookup[boost::lexer::num_chars];
+      std::size_t alphabet;
+      std::vector<std::size_t> table;
+      bool anchors;
+      // whether a match can begin with each character
+      bool starts[boost::lexer::num_chars];
+
+      const std::size_t* row(std::size_t state) const
+      {
+	return &table[state * alphabet];
+      }
+    };
+
+    typedef boost::shared_ptr<const dfa> dfa_ptr;
+
+    // pattern with / and " escaped, which lexertl would take apart
+    std::string lexertl_pattern(const std::string& pattern)
+    {
+      std::string escaped;
+      bool in_class = false;
+      for (std::size_t i = 0; i < pattern.size(); i++)
+	{
+	  char c = pattern[i];
+	  if (c == '\\' && i + 1 < pattern.size())
+	    {
+	      escaped += c;
+	      escaped += pattern[++i];
+	      continue;
+	    }
+	  if (in_class)
+	    in_class = c != ']';
+	  else if (c == '[')
+	    in_class = true;
+	  else if (c == '{' && i + 1 < pattern.size()
+		   && (std::isalpha(static_cast<unsigned char>(pattern[i + 1]))
+		       || pattern[i + 1] == '_'))
+	    throw std::runtime_error("regex-compile: \"" + pattern
+				     + "\": {name} macros aren't supported, write \\{ for a {");
+	  if (c == '/' || c == '"')
+	    escaped += '\\';
+	  escaped += c;
+	}
+      return escaped;
+    }
+
+    dfa_ptr compile_regex(const std::string& pattern)
+    {
+      boost::lexer::rules rules;
+      boost::lexer::state_machine machine;
+      std::string escaped = lexertl_pattern(pattern);
+      try {
+	rules.add(escaped, 1);
+	boost::lexer::generator::build(rules, machine);
+	boost::lexer::generator::minimise(machine);
+      } catch (const std::exception& e) {
+	throw std::runtime_error("regex-compile: \"" + pattern + "\": " + e.what());
+      }
+
+      const boost::lexer::detail::internals& data = machine.data();
+      boost::shared_ptr<dfa> d(new dfa);
+      d->alphabet = data._dfa_alphabet[0];
+      d->table = *data._dfa[0];
+      d->anchors = data._seen_BOL_assertion || data._seen_EOL_assertion;
+      const std::size_t* start = d->row(1);
+      for (std::size_t c = 0; c < boost::lexer::num_chars; c++)
+	{
+	  d->lookup[c] = (*data._lookup[0])[c];
+	  d->starts[c] = d->anchors || start[boost::lexer::end_state_index]
+	    || start[d->lookup[c]] != 0;
+	}
+      return d;
+    }
+
+    //
+    //  a compiled pattern as a lisp value: calling one searches its
+    //  argument, like regex-search
+    //
+    struct compiled_regex
+    {
+      dfa_ptr machine;
+      variant operator()(context_ptr c, variant v);
+    };
+
+    // so that (regex-search "[0-9]+" line) in a loop compiles once
+    string_keyed_cache<dfa> patterns(compile_regex);
+
+    dfa_ptr as_regex(const variant& v, const char* fn)
+    {
+      if (const function* f = get<function>(&v))
+	if (compiled_regex* r = const_cast<function*>(f)->f.target<compiled_regex>())
+	  return r->machine;
+
+      const string_ptr* s = get<string_ptr>(&v);
+      if (!s)
+	throw std::runtime_error(std::string(fn) + ": not a regex or a pattern");
+      return patterns(*s);
+    }
+
+    const std::string& as_text(const variant& v, const char* fn)
+    {
+      const std::string* s = string_chars(v);
+      if (!s)
+	throw std::runtime_error(std::string(fn) + ": not a string");
+      return *s;
+    }
+
+    //
+    //  Runs a dfa over text.  Searching keeps one thread per live
+    //  state, each with the leftmost position it could have started
+    //  from, so there are never more threads than states and each
+    //  character is looked at once: the leftmost, then longest,
+    //  match in time linear in the text.
+    //
+    class matcher
+    {
+    public:
+      matcher(const dfa& d, const std::string& text)
+	: d_(d), begin_(text.data()), end_(text.data() + text.size()),
+	  seen_(d.table.size() / d.alphabet, 0), stamp_(0)
+      { }
+
+      bool match() const
+      {
+	std::size_t state = 1;
+	for (const char* p = begin_; ; ++p)
+	  {
+	    state = anchor(state, p);
+	    if (p == end_)
+	      return d_.row(state)[boost::lexer::end_state_index] != 0;
+	    state = d_.row(state)[d_.lookup[static_cast<unsigned char>(*p)]];
+	    if (!state)
+	      return false;
+	  }
+      }
+
+      // the first match at or after from, into [start, stop)
+      bool search(const char* from, const char*& start, const char*& stop)
+      {
+	bool found = false;
+	now_.clear();
+	for (const char* p = from; ; ++p)
+	  {
+	    if (!found)
+	      {
+		// nothing running: skip to where something could start
+		if (now_.empty())
+		  while (p != end_ && !d_.starts[static_cast<unsigned char>(*p)])
+		    ++p;
+		now_.push_back(thread(1, p));
+	      }
+
+	    next_.clear();
+	    ++stamp_;
+	    for (std::size_t i = 0; i < now_.size(); i++)
+	      {
+		std::size_t state = anchor(now_[i].state, p);
+		const char* origin = now_[i].start;
+		if (found && origin > start)
+		  break;
+		if (d_.row(state)[boost::lexer::end_state_index]
+		    && (!found || origin < start || p > stop))
+		  {
+		    found = true;
+		    start = origin;
+		    stop = p;
+		  }
+		if (p == end_)
+		  continue;
+		state = d_.row(state)[d_.lookup[static_cast<unsigned char>(*p)]];
+		if (!state || seen_[state] == stamp_)
+		  continue;
+		seen_[state] = stamp_;
+		next_.push_back(thread(state, origin));
+	      }
+	    now_.swap(next_);
+	    if (p == end_ || (found && now_.empty()))
+	      return found;
+	  }
+      }
+
+    private:
+      // follows ^ at the start of a line and $ at the end of one
+      std::size_t anchor(std::size_t state, const char* p) const
+      {
+	if (!d_.anchors)
+	  return state;
+	const std::size_t* row = d_.row(state);
+	if (row[boost::lexer::bol_index] && (p == begin_ || p[-1] == '\n'))
+	  row = d_.row(state = row[boost::lexer::bol_index]);
+	if (row[boost::lexer::eol_index] && (p == end_ || *p == '\n'))
+	  state = row[boost::lexer::eol_index];
+	return state;
+      }
+
+      struct thread
+      {
+	std::size_t state;
+	const char* start;
+	thread(std::size_t s, const char* p) : state(s), start(p) { }
+      };
+
+      const dfa& d_;
+      const char* begin_;
+      const char* end_;
+      std::vector<thread> now_, next_;
+      std::vector<unsigned> seen_;
+      unsigned stamp_;
+    };
+
+    variant search(const dfa& d, const std::string& text)
+    {
+      matcher m(d, text);
+      const char *start = 0, *stop = 0;
+      if (!m.search(text.data(), start, stop))
+	return nil;
+      return make_string(std::string(start, stop));
+    }
+
+    variant compiled_regex::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      return search(*machine, as_text(eval(c, v >> car), "regex-search"));
+    }
+  }
+
+  const void* regex_machine(const function& f)
+  {
+    const compiled_regex* r = f.f.target<compiled_regex>();
+    return r ? r->machine.get() : 0;
+  }
+
+  namespace ops {
+
+    variant regex_compile::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant pattern = eval(c, v >> car);
+      compiled_regex r;
+      r.machine = compile_regex(as_text(pattern, "regex-compile"));
+      return function(r);
+    }
+
+    // (regex-match re string): whether all of string matches
+    variant regex_match::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant re = eval(c, v >> car);
+      variant text = eval(c, v >> cdr >> car);
+      dfa_ptr d = as_regex(re, "regex-match");
+      return matcher(*d, as_text(text, "regex-match")).match() ? t : nil;
+    }
+
+    // (regex-search re string): the leftmost longest match, or nil
+    variant regex_search::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant re = eval(c, v >> car);
+      variant text = eval(c, v >> cdr >> car);
+      dfa_ptr d = as_regex(re, "regex-search");
+      return search(*d, as_text(text, "regex-search"));
+    }
+
+    //
+    //  (regex-split re string): the pieces of string between the
+    //  matches; a match of nothing doesn't split anything
+    //
+    variant regex_split::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant re = eval(c, v >> car);
+      variant text = eval(c, v >> cdr >> car);
+      dfa_ptr d = as_regex(re, "regex-split");
+      const std::string& s = as_text(text, "regex-split");
+
+      matcher m(*d, s);
+      list_builder pieces;
+      const char* piece = s.data();
+      const char* end = s.data() + s.size();
+      const char *start = 0, *stop = 0;
+      for (const char* from = piece; m.search(from, start, stop); )
+	{
+	  if (start == stop)
+	    {
+	      if (start == end)
+		break;
+	      from = start + 1;
+	      continue;
+	    }
+	  pieces.push(make_string(std::string(piece, start)));
+	  piece = from = stop;
+	}
+      pieces.push(make_string(std::string(piece, end)));
+      return pieces.head;
+    }
+  }
+}
@@ -0,0 +1,19 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_REGEX_HPP_INCLUDED
+#define LISP_REGEX_HPP_INCLUDED
+
+#include "types.hpp"
+
+namespace lisp {
+
+  // the DFA of a compiled regex, or 0 if f isn't one
+  const void* regex_machine(const function& f);
+}
+
+#endif
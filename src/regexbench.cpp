@@ -0,0 +1,137 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+//
+//  The workloads of regexbench.lisp done with std::regex, on the same
+//  made-up log, to compare the regex builtins against.  POSIX
+//  extended syntax, so that the matches are leftmost-longest like
+//  theirs and the results come out the same.  Run it with no
+//  arguments; as with time, the times go to stderr.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace {
+
+  // a number as format's ~d has it
+  void append_d(std::string& s, double d)
+  {
+    char buf[64];
+    std::snprintf(buf, sizeof buf, d == std::floor(d) ? "%.0f" : "%g", d);
+    s += buf;
+  }
+
+  std::string make_log(int n)
+  {
+    std::string text;
+    char buf[64];
+    for (int i = 0; i < n; i++)
+      {
+	text += "12:00:07 INFO worker-";
+	append_d(text, i / 1000.0);
+	text += " request ";
+	append_d(text, i);
+	std::snprintf(buf, sizeof buf, " took %.1fms\n", i / 7.0);
+	text += buf;
+      }
+    for (int i = 0; i < n; i += 97)
+      {
+	text += "12:00:09 ERROR worker-";
+	append_d(text, i / 1000.0);
+	text += " request ";
+	append_d(text, i);
+	text += " failed\n";
+      }
+    return text;
+  }
+
+  // the pieces between the matches, as regex-split has them
+  std::vector<std::string> split(const std::regex& re, const std::string& s)
+  {
+    std::vector<std::string> pieces;
+    std::string::const_iterator piece = s.begin(), from = s.begin();
+    std::smatch m;
+    while (std::regex_search(from, s.end(), m, re))
+      {
+	if (m.length(0) == 0)
+	  {
+	    if (m[0].first == s.end())
+	      break;
+	    from = m[0].first + 1;
+	    continue;
+	  }
+	pieces.push_back(std::string(piece, m[0].first));
+	piece = from = m[0].second;
+      }
+    pieces.push_back(std::string(piece, s.end()));
+    return pieces;
+  }
+
+  struct timer
+  {
+    const char* what;
+    timespec start;
+
+    timer(const char* w) : what(w)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &start);
+    }
+
+    ~timer()
+    {
+      timespec end;
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      std::cerr << "; " << what << ": " << ((end.tv_sec - start.tv_sec) * 1e3
+					      + (end.tv_nsec - start.tv_nsec) * 1e-6) << " ms\n";
+    }
+  };
+}
+
+int main()
+{
+  const std::regex::flag_type syntax = std::regex::extended;
+  std::string text = make_log(20000);
+  std::cout << text.size() << "\n";
+
+  std::vector<std::string> lines;
+  {
+    timer t("split into lines");
+    lines = split(std::regex("\n", syntax), text);
+  }
+  std::cout << lines.size() << "\n";
+
+  {
+    timer t("regex-match per line");
+    std::regex re("[^E]*", syntax);
+    unsigned unmatched = 0;
+    for (unsigned u = 0; u < lines.size(); u++)
+      if (!std::regex_match(lines[u], re))
+	unmatched++;
+    std::cout << unmatched << "\n";
+  }
+
+  {
+    timer t("search across lines");
+    std::smatch m;
+    std::regex re("took [0-9]+\\.[0-9]ms\n[^\n]*ERROR[^\n]*", syntax);
+    if (std::regex_search(text, m, re))
+      std::cout << '"' << m.str(0) << "\"\n";
+    else
+      std::cout << "NIL\n";
+  }
+
+  {
+    timer t("split into words");
+    std::cout << split(std::regex("[ \n]+", syntax), text).size() << "\n";
+  }
+}
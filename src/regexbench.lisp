@@ -0,0 +1,20 @@
+;
+; regex-split, regex-search and regex-match over a made-up log;
+; run with lisp src/regexbench.lisp, the times go to stderr.  The
+; regexbench program does the same with std::regex.
+;
+
+(defvar n 20000)
+(defvar text
+  (with-output-to-string (s)
+    (mapcar (lambda (i) (format s "12:00:07 INFO worker-~d request ~d took ~,1fms~%" (/ i 1000) i (/ i 7)))
+	    (into nil (range 0 n)))
+    (mapcar (lambda (i) (format s "12:00:09 ERROR worker-~d request ~d failed~%" (/ i 1000) i))
+	    (into nil (range 0 n 97)))))
+
+(print (length text))
+(defvar lines (time (regex-split "\\n" text)))
+(print (length lines))
+(print (time (length (remove-if (lambda (l) (regex-match "[^E]*" l)) lines))))
+(print (time (regex-search "took [0-9]+\\.[0-9]ms\\n[^\\n]*ERROR[^\\n]*" text)))
+(print (time (length (regex-split "[ \\n]+" text))))
@@ -0,0 +1,252 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "analysis.hpp"
+#include "runtime.hpp"
+#include "stack.hpp"
+#include "bitvector.hpp"
+
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+
+namespace lisp {
+
+  bool debug_contexts, debug_all;
+
+  void add_builtins()
+  {
+    global->put("+", lisp::function(lisp::ops::op<std::plus<double> >(0)));
+    global->put("*", lisp::function(lisp::ops::op<std::multiplies<double> >(1)));
+    global->put("-", lisp::function(lisp::ops::minus()));
+    global->put("/", lisp::function(lisp::ops::divides()));
+    global->put("<", lisp::function(lisp::ops::compare<std::less<double> >()));
+    global->put(">", lisp::function(lisp::ops::compare<std::greater<double> >()));
+    global->put("<=", lisp::function(lisp::ops::compare<std::less_equal<double> >()));
+    global->put(">=", lisp::function(lisp::ops::compare<std::greater_equal<double> >()));
+    global->put("=", lisp::function(lisp::ops::compare<std::equal_to<double> >()));
+    global->put("string<", lisp::function(lisp::ops::string_compare<std::less<std::string> >()));
+    global->put("string>", lisp::function(lisp::ops::string_compare<std::greater<std::string> >()));
+    global->put("cons", lisp::function(lisp::ops::cons()));
+    global->put("list", lisp::function(lisp::ops::list()));
+    global->put("defvar", lisp::function(lisp::ops::defvar()));
+    global->put("print", lisp::function(lisp::ops::print()));
+    global->put("eval", lisp::function(lisp::ops::evaluate()));
+    global->put("funcall", lisp::function(lisp::ops::funcall()));
+    global->put("defun", lisp::function(lisp::ops::defun()));
+    global->put("progn", lisp::function(lisp::ops::progn()));
+    global->put("quote", lisp::function(lisp::ops::quote()));
+    global->put("equal", lisp::function(lisp::ops::equal()));
+    global->put("if", lisp::function(lisp::ops::if_clause()));
+    global->put("setf", lisp::function(lisp::ops::setf()));
+    global->put("defmacro", lisp::function(lisp::ops::defmacro()));
+    global->put("lambda", lisp::function(lisp::ops::lambda()));
+    global->put("let", lisp::function(lisp::ops::let()));
+    global->put("declare", lisp::function(lisp::ops::declare()));
+    global->put("tier-stats", lisp::function(lisp::ops::tier_stats()));
+    global->put("describe", lisp::function(lisp::ops::describe()));
+    global->put("defun-memo", lisp::function(lisp::ops::defun_memo()));
+    global->put("memoize", lisp::function(lisp::ops::memoize()));
+    global->put("memo-stats", lisp::function(lisp::ops::memo_stats()));
+    global->put("make-array", lisp::function(lisp::ops::make_array()));
+    global->put("vector", lisp::function(lisp::ops::vector()));
+    global->put("aref", lisp::function(lisp::ops::aref()));
+    global->put("length", lisp::function(lisp::ops::length()));
+    global->put("make-hash-table", lisp::function(lisp::ops::make_hash_table()));
+    global->put("gethash", lisp::function(lisp::ops::gethash()));
+    global->put("puthash", lisp::function(lisp::ops::puthash()));
+    global->put("remhash", lisp::function(lisp::ops::remhash()));
+    global->put("maphash", lisp::function(lisp::ops::maphash()));
+    global->put("hash-table-count", lisp::function(lisp::ops::hash_table_count()));
+    global->put("eq", lisp::function(lisp::ops::eq()));
+    global->put("time", lisp::function(lisp::ops::time()));
+    global->put("make-f64vector", lisp::function(lisp::ops::make_f64vector()));
+    global->put("f64ref", lisp::function(lisp::ops::f64ref()));
+    global->put("f64-sum", lisp::function(lisp::ops::f64_sum()));
+    global->put("f64-dot", lisp::function(lisp::ops::f64_dot()));
+    global->put("f64-min", lisp::function(lisp::ops::f64_min()));
+    global->put("f64-max", lisp::function(lisp::ops::f64_max()));
+    global->put("f64-add", lisp::function(lisp::ops::f64_add()));
+    global->put("f64-mul", lisp::function(lisp::ops::f64_mul()));
+    global->put("f64-scale", lisp::function(lisp::ops::f64_scale()));
+    global->put("f64-prefix-sum", lisp::function(lisp::ops::f64_prefix_sum()));
+    global->put("f64-kernels", lisp::function(lisp::ops::f64_kernels()));
+    global->put("defstruct", lisp::function(lisp::ops::defstruct()));
+    global->put("pmap", lisp::function(lisp::ops::make_pmap()));
+    global->put("pmap-from-alist", lisp::function(lisp::ops::pmap_from_alist()));
+    global->put("pmap-get", lisp::function(lisp::ops::pmap_get()));
+    global->put("pmap-assoc", lisp::function(lisp::ops::pmap_assoc()));
+    global->put("pmap-dissoc", lisp::function(lisp::ops::pmap_dissoc()));
+    global->put("pmap-count", lisp::function(lisp::ops::pmap_count()));
+    global->put("pmap-alist", lisp::function(lisp::ops::pmap_alist()));
+    global->put("pvector", lisp::function(lisp::ops::make_pvector()));
+    global->put("pvector-from-list", lisp::function(lisp::ops::pvector_from_list()));
+    global->put("pvector-nth", lisp::function(lisp::ops::pvector_nth()));
+    global->put("pvector-assoc", lisp::function(lisp::ops::pvector_assoc()));
+    global->put("pvector-conj", lisp::function(lisp::ops::pvector_conj()));
+    global->put("pvector-pop", lisp::function(lisp::ops::pvector_pop()));
+    global->put("pvector-list", lisp::function(lisp::ops::pvector_list()));
+    global->put("make-bit-vector", lisp::function(lisp::ops::make_bit_vector()));
+    global->put("sbit", lisp::function(lisp::ops::sbit()));
+    global->put("bit-and", lisp::function(lisp::ops::bit_and()));
+    global->put("bit-or", lisp::function(lisp::ops::bit_or()));
+    global->put("bit-xor", lisp::function(lisp::ops::bit_xor()));
+    global->put("bit-not", lisp::function(lisp::ops::bit_not()));
+    global->put("popcount", lisp::function(lisp::ops::popcount()));
+    global->put("find-first-set", lisp::function(lisp::ops::find_first_set()));
+    global->put("map-set-bits", lisp::function(lisp::ops::map_set_bits()));
+    global->put("bit-positions", lisp::function(lisp::ops::bit_positions()));
+    global->put("bit-kernels", lisp::function(lisp::ops::bit_kernels()));
+    global->put("make-table", lisp::function(lisp::ops::make_table()));
+    global->put("table-rows", lisp::function(lisp::ops::table_rows()));
+    global->put("table-columns", lisp::function(lisp::ops::table_columns()));
+    global->put("table-column", lisp::function(lisp::ops::table_column()));
+    global->put("table-select", lisp::function(lisp::ops::table_select()));
+    global->put("table-where", lisp::function(lisp::ops::table_where()));
+    global->put("table-filter", lisp::function(lisp::ops::table_filter()));
+    global->put("table-sort", lisp::function(lisp::ops::table_sort()));
+    global->put("table-group-by", lisp::function(lisp::ops::table_group_by()));
+    global->put("table-join", lisp::function(lisp::ops::table_join()));
+    global->put("mapcar", lisp::function(lisp::ops::mapcar()));
+    global->put("reduce", lisp::function(lisp::ops::reduce()));
+    global->put("remove-if", lisp::function(lisp::ops::remove_if()));
+    global->put("find", lisp::function(lisp::ops::find()));
+    global->put("assoc", lisp::function(lisp::ops::assoc()));
+    global->put("nth", lisp::function(lisp::ops::nth()));
+    global->put("append", lisp::function(lisp::ops::append()));
+    global->put("reverse", lisp::function(lisp::ops::reverse()));
+    global->put("range", lisp::function(lisp::ops::range()));
+    global->put("lazy-map", lisp::function(lisp::ops::lazy_map()));
+    global->put("lazy-filter", lisp::function(lisp::ops::lazy_filter()));
+    global->put("take", lisp::function(lisp::ops::take()));
+    global->put("into", lisp::function(lisp::ops::into()));
+    global->put("make-generator", lisp::function(lisp::ops::make_generator()));
+    global->put("yield", lisp::function(lisp::ops::yield()));
+    global->put("next", lisp::function(lisp::ops::next()));
+    global->put("sort", lisp::function(lisp::ops::sort()));
+    global->put("stable-sort", lisp::function(lisp::ops::stable_sort()));
+    global->put("concatenate", lisp::function(lisp::ops::concatenate()));
+    global->put("make-string-output-stream", lisp::function(lisp::ops::make_string_output_stream()));
+    global->put("write-string", lisp::function(lisp::ops::write_string()));
+    global->put("get-output-stream-string", lisp::function(lisp::ops::get_output_stream_string()));
+    global->put("with-output-to-string", lisp::ops::with_output_to_string());
+    global->put("format", lisp::function(lisp::ops::format()));
+    global->put("regex-compile", lisp::function(lisp::ops::regex_compile()));
+    global->put("regex-match", lisp::function(lisp::ops::regex_match()));
+    global->put("regex-search", lisp::function(lisp::ops::regex_search()));
+    global->put("regex-split", lisp::function(lisp::ops::regex_split()));
+
+    global->put("t", t);
+    global->put("nil",  nil);
+  }
+
+  namespace rt {
+
+    variant arg(context_ptr& c, variant& args, const char* fn)
+    {
+      if (is_nil(args))
+	throw std::runtime_error(std::string("too few arguments to ") + fn);
+      variant v = eval(c, args >> car);
+      args = args >> cdr;
+      return v;
+    }
+
+    double num(const variant& v)
+    {
+      return boost::get<double>(v);
+    }
+
+    variant cons(const variant& car, const variant& cdr)
+    {
+      return cons_ptr(new lisp::cons(car, cdr));
+    }
+
+    variant quoted(const variant& v)
+    {
+      return special<quoted_>(v);
+    }
+
+    variant backquoted(const variant& v)
+    {
+      return special<backquoted_>(v);
+    }
+
+    variant comma(const variant& v)
+    {
+      return special<comma_>(v);
+    }
+
+    variant comma_at(const variant& v)
+    {
+      return special<comma_at_>(v);
+    }
+
+    variant bits(const char* s)
+    {
+      return bitvector_ptr(new bitvector(s));
+    }
+
+    variant value(const context_ptr& home, const char* name)
+    {
+      return home->get<variant>(name);
+    }
+
+    variant args(const variant& v, const variant& rest)
+    {
+      return cons(quoted(v), rest);
+    }
+
+    variant call(const context_ptr& home, const char* name, variant args)
+    {
+      function f = boost::get<function>(home->get<variant>(name));
+      context_ptr c = home;
+      return f(c, args);
+    }
+
+    void defun(const context_ptr& scope, const char* name, const function& f)
+    {
+      scope->put(name, f);
+      invalidate(name);
+    }
+
+    namespace {
+
+      struct toplevel_form
+      {
+	const context_ptr* scope;
+	void (*form)(const context_ptr&);
+      };
+
+      void run_form(void* arg)
+      {
+	toplevel_form& f = *static_cast<toplevel_form*>(arg);
+	f.form(*f.scope);
+      }
+    }
+
+    void toplevel(const context_ptr& scope, void (*form)(const context_ptr&))
+    {
+      toplevel_form f = { &scope, form };
+      try {
+	on_eval_stack(run_form, &f);
+      } catch (const std::exception& e) {
+	std::cout << "*** - EVAL exception caught: " << e.what() << "\n";
+      }
+    }
+
+    void eval(const context_ptr& scope, const variant& form)
+    {
+      context_ptr c = scope;
+      lisp::eval(c, form);
+    }
+  }
+}
@@ -0,0 +1,73 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_RUNTIME_HPP_INCLUDED
+#define LISP_RUNTIME_HPP_INCLUDED
+
+#include "config.hpp"
+#include "types.hpp"
+#include "context.hpp"
+#include "declare.hpp"
+
+#include <limits>
+#include <string>
+
+namespace lisp {
+
+  // bind the builtins in global
+  void add_builtins();
+
+  //
+  //  What the C++ that --compile-to-cpp writes (see compile.hpp) calls
+  //  on.  Compiled functions get their arguments evaluated, hold their
+  //  variables in C++ variables, and look everything else up in home,
+  //  the top level scope they were defined in.
+  //
+  namespace rt {
+
+    // evaluate the next of args in c; fn is who wants it
+    variant arg(context_ptr& c, variant& args, const char* fn);
+
+    double num(const variant& v);
+
+    inline bool truth(const variant& v) { return v == t; }
+    inline variant boolean(bool b) { return b ? t : nil; }
+
+    variant cons(const variant& car, const variant& cdr);
+    variant quoted(const variant& v);
+    variant backquoted(const variant& v);
+    variant comma(const variant& v);
+    variant comma_at(const variant& v);
+
+    // #*0101, from its 0s and 1s
+    variant bits(const char* s);
+
+    // the value of a variable that isn't local
+    variant value(const context_ptr& home, const char* name);
+
+    //
+    //  call the function named name with arguments already evaluated,
+    //  built with args(a, args(b, nil))
+    //
+    variant call(const context_ptr& home, const char* name, variant args);
+    variant args(const variant& v, const variant& rest);
+
+    // (defun name ...) of a compiled function
+    void defun(const context_ptr& scope, const char* name, const function& f);
+
+    //
+    //  run one top level form, reporting errors like the interpreter
+    //  does, and go on with the next
+    //
+    void toplevel(const context_ptr& scope, void (*form)(const context_ptr&));
+
+    // a form the compiler left to the interpreter
+    void eval(const context_ptr& scope, const variant& form);
+  }
+}
+
+#endif
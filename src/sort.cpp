@@ -0,0 +1,260 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "callback.hpp"
+#include "f64vector.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using boost::get;
+
+namespace lisp {
+
+  namespace {
+
+    enum order_t { lisp_order, ascending, descending };
+
+    // which way < > <= >= sort; lisp_order for anything else
+    order_t numeric_order(const function& f)
+    {
+      if (f.f.target<ops::compare<std::less<double> > >()
+	  || f.f.target<ops::compare<std::less_equal<double> > >())
+	return ascending;
+      if (f.f.target<ops::compare<std::greater<double> > >()
+	  || f.f.target<ops::compare<std::greater_equal<double> > >())
+	return descending;
+      return lisp_order;
+    }
+
+    order_t string_order(const function& f)
+    {
+      if (f.f.target<ops::string_compare<std::less<std::string> > >())
+	return ascending;
+      if (f.f.target<ops::string_compare<std::greater<std::string> > >())
+	return descending;
+      return lisp_order;
+    }
+
+    template <typename Less>
+    struct string_ptr_order
+    {
+      Less less;
+      bool operator()(const std::string* a, const std::string* b) const
+      {
+	return less(*a, *b);
+      }
+    };
+
+    // compares (key, index) pairs by key alone
+    template <typename Less>
+    struct by_key
+    {
+      Less less;
+      by_key(Less l) : less(l) { }
+
+      template <typename Pair>
+      bool operator()(const Pair& a, const Pair& b) const
+      {
+	return less(a.first, b.first);
+      }
+    };
+
+    template <typename Key, typename Less>
+    void sort_keys(std::vector<std::pair<Key, std::size_t> >& v, Less less, bool stable,
+		   std::vector<std::size_t>& order)
+    {
+      if (stable)
+	std::stable_sort(v.begin(), v.end(), by_key<Less>(less));
+      else
+	std::sort(v.begin(), v.end(), by_key<Less>(less));
+      for (std::size_t u = 0; u < v.size(); u++)
+	order[u] = v[u].second;
+    }
+
+    // a call to the predicate for each comparison
+    struct lisp_less
+    {
+      callback* pred;
+      context_ptr* c;
+      const std::vector<variant>* keys;
+
+      bool operator()(std::size_t a, std::size_t b) const
+      {
+	return (*pred)(*c, (*keys)[a], (*keys)[b]) == t;
+      }
+    };
+
+    //
+    //  The order the keys go in, as indices into keys.  When pred is
+    //  one of the numeric or string comparisons the keys are unboxed
+    //  once and compared in C++; otherwise it is called for each
+    //  comparison.  Whatever a Lisp predicate does, it gets the merge
+    //  sort: introsort can run off the end of the range when the
+    //  order it's given isn't a strict one, say (lambda (a b) t).
+    //
+    void sort_order(context_ptr& c, callback& pred, const std::vector<variant>& keys,
+		    bool stable, const char* fn, std::vector<std::size_t>& order)
+    {
+      std::size_t n = keys.size();
+      order.resize(n);
+
+      order_t o = numeric_order(pred.f());
+      if (o != lisp_order)
+	{
+	  std::vector<std::pair<double, std::size_t> > v(n);
+	  for (std::size_t u = 0; u < n; u++)
+	    {
+	      const double* d = get<double>(&keys[u]);
+	      if (!d)
+		throw std::runtime_error(std::string(fn) + ": not a number");
+	      v[u] = std::make_pair(*d, u);
+	    }
+	  if (o == ascending)
+	    sort_keys(v, std::less<double>(), stable, order);
+	  else
+	    sort_keys(v, std::greater<double>(), stable, order);
+	  return;
+	}
+
+      o = string_order(pred.f());
+      if (o != lisp_order)
+	{
+	  std::vector<std::pair<const std::string*, std::size_t> > v(n);
+	  for (std::size_t u = 0; u < n; u++)
+	    {
+	      const std::string* s = string_chars(keys[u]);
+	      if (!s)
+		throw std::runtime_error(std::string(fn) + ": not a string");
+	      v[u] = std::make_pair(s, u);
+	    }
+	  if (o == ascending)
+	    sort_keys(v, string_ptr_order<std::less<std::string> >(), stable, order);
+	  else
+	    sort_keys(v, string_ptr_order<std::greater<std::string> >(), stable, order);
+	  return;
+	}
+
+      for (std::size_t u = 0; u < n; u++)
+	order[u] = u;
+      lisp_less less = { &pred, &c, &keys };
+      std::stable_sort(order.begin(), order.end(), less);
+    }
+
+    //
+    //  (sort seq pred [key]): seq in the order pred says, comparing
+    //  (key x) rather than x if there is a key.  A list is sorted by
+    //  linking its own conses up again, and the sorted list returned;
+    //  a simple vector or f64vector is sorted where it is.
+    //
+    variant sort_sequence(context_ptr& c, variant v, bool stable, const char* fn)
+    {
+      variant seq = eval(c, v >> car);
+      callback pred(eval(c, v >> cdr >> car), 2, fn);
+      variant rest = v >> cdr >> cdr;
+      variant key = is_nil(rest) ? variant(nil) : eval(c, rest >> car);
+      bool keyed = get<function>(&key);
+      if (!keyed && !(key == nil))
+	throw std::runtime_error(std::string(fn) + ": the key is not a function");
+
+      // f64vectors in order by < or >: just sort the doubles
+      const f64vector_ptr* f = get<f64vector_ptr>(&seq);
+      order_t o = numeric_order(pred.f());
+      if (f && !keyed && o != lisp_order)
+	{
+	  std::vector<double>& items = (*f)->items;
+	  if (stable && o == ascending)
+	    std::stable_sort(items.begin(), items.end(), std::less<double>());
+	  else if (stable)
+	    std::stable_sort(items.begin(), items.end(), std::greater<double>());
+	  else if (o == ascending)
+	    std::sort(items.begin(), items.end(), std::less<double>());
+	  else
+	    std::sort(items.begin(), items.end(), std::greater<double>());
+	  return seq;
+	}
+
+      std::vector<variant> elements;
+      std::vector<cons_ptr> cells;
+      const cons_ptr* l = get<cons_ptr>(&seq);
+      const array_ptr* a = get<array_ptr>(&seq);
+      if (l)
+	for (cons_ptr p = *l; p; )
+	  {
+	    cells.push_back(p);
+	    elements.push_back(p->car);
+	    const cons_ptr* next = get<cons_ptr>(&p->cdr);
+	    if (!next)
+	      throw std::runtime_error(std::string(fn) + ": not a proper list");
+	    p = *next;
+	  }
+      else if (a)
+	elements = (*a)->items;
+      else if (f)
+	elements.assign((*f)->items.begin(), (*f)->items.end());
+      else
+	throw std::runtime_error(std::string(fn) + ": can't sort that");
+
+      std::size_t n = elements.size();
+      std::vector<variant> keys;
+      if (keyed)
+	{
+	  callback key_of(key, 1, fn);
+	  keys.resize(n);
+	  for (std::size_t u = 0; u < n; u++)
+	    keys[u] = key_of(c, elements[u]);
+	}
+      std::vector<std::size_t> order;
+      sort_order(c, pred, keyed ? keys : elements, stable, fn, order);
+
+      // nothing is changed until the sort is done, in case it throws
+      if (l)
+	{
+	  if (n == 0)
+	    return nil;
+	  for (std::size_t u = 0; u + 1 < n; u++)
+	    cells[order[u]]->cdr = cells[order[u+1]];
+	  cells[order[n-1]]->cdr = nil;
+	  return cells[order[0]];
+	}
+      if (a)
+	for (std::size_t u = 0; u < n; u++)
+	  (*a)->items[u] = elements[order[u]];
+      else
+	for (std::size_t u = 0; u < n; u++)
+	  (*f)->items[u] = get<double>(elements[order[u]]);
+      return seq;
+    }
+  }
+
+  namespace ops {
+
+    // (sort seq pred [key])
+    variant sort::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      return sort_sequence(c, v, false, "sort");
+    }
+
+    // (stable-sort seq pred [key]): elements that are neither before
+    // the other keep the order they had
+    variant stable_sort::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      return sort_sequence(c, v, true, "stable-sort");
+    }
+  }
+}
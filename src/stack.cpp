@@ -0,0 +1,134 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "eval.hpp"
+#include "stack.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+namespace lisp {
+
+  unsigned max_depth = 100000;
+
+  char* stack_limit = 0;
+
+  unsigned depth_guard::depth_ = 0;
+
+  namespace {
+
+    // roughly what a Lisp call costs in C++ frames, unoptimized
+    const std::size_t bytes_per_call = 8192;
+
+    // what's left when stack_low() says stop: enough to throw
+    const std::size_t margin = 256 * 1024;
+
+    struct eval_stack
+    {
+      char* base;
+      std::size_t size;
+      bool running;
+
+      ucontext_t caller, callee;
+
+      void (*f)(void*);
+      void* arg;
+      bool failed;
+      std::string error;
+
+      eval_stack() : base(0), size(0), running(false) { }
+    };
+
+    eval_stack stack;
+
+    // exceptions can't leave the other stack: carry them over by hand
+    void run()
+    {
+      try {
+	stack.f(stack.arg);
+      } catch (const std::exception& e) {
+	stack.failed = true;
+	stack.error = e.what();
+      }
+    }
+
+    void reserve()
+    {
+      std::size_t size = max_depth * bytes_per_call + margin;
+      if (stack.base && stack.size >= size)
+	return;
+      if (stack.base)
+	munmap(stack.base, stack.size);
+      void* p = mmap(0, size, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (p == MAP_FAILED)
+	throw std::runtime_error("can't reserve the evaluation stack");
+      stack.base = static_cast<char*>(p);
+      stack.size = size;
+    }
+  }
+
+  void stack_overflow()
+  {
+    throw std::runtime_error("stack-overflow");
+  }
+
+  void on_eval_stack(void (*f)(void*), void* arg)
+  {
+    if (stack.running)
+      return f(arg);
+
+    reserve();
+    stack.f = f;
+    stack.arg = arg;
+    stack.failed = false;
+
+    getcontext(&stack.callee);
+    stack.callee.uc_stack.ss_sp = stack.base;
+    stack.callee.uc_stack.ss_size = stack.size;
+    stack.callee.uc_link = &stack.caller;
+    makecontext(&stack.callee, run, 0);
+
+    stack.running = true;
+    stack_limit = stack.base + margin;
+    swapcontext(&stack.caller, &stack.callee);
+    stack_limit = 0;
+    stack.running = false;
+
+    if (stack.failed)
+      throw std::runtime_error(stack.error);
+  }
+
+  namespace {
+
+    struct toplevel_form
+    {
+      context_ptr* c;
+      const variant* v;
+      variant result;
+    };
+
+    void eval_form(void* arg)
+    {
+      toplevel_form& form = *static_cast<toplevel_form*>(arg);
+      form.result = eval(*form.c, *form.v);
+    }
+  }
+
+  variant eval_toplevel(context_ptr& c, const variant& v)
+  {
+    toplevel_form form;
+    form.c = &c;
+    form.v = &v;
+    on_eval_stack(eval_form, &form);
+    return form.result;
+  }
+}
@@ -0,0 +1,71 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_STACK_HPP_INCLUDED
+#define LISP_STACK_HPP_INCLUDED
+
+#include "types.hpp"
+#include "context.hpp"
+
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+
+namespace lisp {
+
+  //
+  //  The evaluator recurses in C++ for every Lisp call, and the
+  //  native stack is much too small for deep recursion.  So top level
+  //  forms are evaluated on a stack of our own, reserved in the heap
+  //  big enough for max_depth nested calls, and only committed as it
+  //  is touched.  Going deeper than max_depth, or running out of that
+  //  stack some other way, is a "stack-overflow" error.
+  //
+  extern unsigned max_depth;
+
+  variant eval_toplevel(context_ptr& c, const variant& v);
+
+  // f(arg), on the evaluation stack
+  void on_eval_stack(void (*f)(void*), void* arg);
+
+  // below this, the stack is about to run out; 0 when we aren't on ours
+  extern char* stack_limit;
+
+  inline bool stack_low()
+  {
+    char here;
+    return &here < stack_limit;
+  }
+
+  void stack_overflow();
+
+  //
+  //  one nested Lisp call, see dispatch
+  //
+  class depth_guard : boost::noncopyable
+  {
+  public:
+    depth_guard()
+    {
+      if (++depth_ > max_depth || stack_low())
+	{
+	  --depth_;
+	  stack_overflow();
+	}
+    }
+
+    ~depth_guard() { --depth_; }
+
+    // how deep we are, which a generator keeps while it's suspended
+    static unsigned depth() { return depth_; }
+    static void set_depth(unsigned d) { depth_ = d; }
+
+  private:
+    static unsigned depth_;
+  };
+}
+
+#endif
@@ -0,0 +1,163 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "strings.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using boost::get;
+
+namespace lisp {
+
+  namespace {
+
+    const std::string& chars_of(const variant& v, const char* fn)
+    {
+      const std::string* s = string_chars(v);
+      if (!s)
+	throw std::runtime_error(std::string(fn) + ": not a string");
+      return *s;
+    }
+
+    //
+    //  A string output stream: the text written to it so far, which
+    //  grows at the end like any std::string, so writing n pieces
+    //  costs about their total length rather than n times it.
+    //  Calling one writes its arguments.
+    //
+    struct string_output
+    {
+      boost::shared_ptr<std::string> text;
+
+      variant operator()(context_ptr c, variant v)
+      {
+	SHOW;
+	variant x;
+	for (; !is_nil(v); v = v >> cdr)
+	  {
+	    x = eval(c, v >> car);
+	    text->append(chars_of(x, "write-string"));
+	  }
+	return x;
+      }
+    };
+
+    //
+    //  (with-output-to-string (s) body...) is
+    //  (let ((s (make-string-output-stream))) body... (get-output-stream-string s))
+    //
+    variant expand_with_output_to_string(const variant& form)
+    {
+      variant args = form;
+      const cons_ptr* spec = get<cons_ptr>(&(args >> car));
+      if (!spec || !*spec || !get<symbol>(&(*spec)->car))
+	throw std::runtime_error("with-output-to-string: (with-output-to-string (name) body...)");
+      variant name = (*spec)->car;
+
+      list_builder binding;
+      binding.push(name);
+      binding.push(cons_ptr(new cons(symbol("make-string-output-stream"))));
+
+      list_builder expansion;
+      expansion.push(symbol("let"));
+      expansion.push(cons_ptr(new cons(binding.head)));
+      for (variant body = args >> cdr; !is_nil(body); body = body >> cdr)
+	expansion.push(body >> car);
+      list_builder get_string;
+      get_string.push(symbol("get-output-stream-string"));
+      get_string.push(name);
+      expansion.push(get_string.head);
+      return expansion.head;
+    }
+  }
+
+  std::string* output_buffer(const variant& v)
+  {
+    const function* f = get<function>(&v);
+    string_output* s = f ? const_cast<function*>(f)->f.target<string_output>() : 0;
+    return s ? s->text.get() : 0;
+  }
+
+  namespace {
+
+    std::string& as_stream(const variant& v, const char* fn)
+    {
+      std::string* text = output_buffer(v);
+      if (!text)
+	throw std::runtime_error(std::string(fn) + ": not a string output stream");
+      return *text;
+    }
+  }
+
+  namespace ops {
+
+    //
+    //  (concatenate 'string x...): the characters of each x, strings
+    //  or symbols, one after the other, made in one go
+    //
+    variant concatenate::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant type = eval(c, v >> car);
+      const symbol* s = get<symbol>(&type);
+      if (!s || *s != "string")
+	throw std::runtime_error("concatenate: only makes a string");
+
+      std::vector<variant> parts;
+      std::size_t size = 0;
+      for (variant l = v >> cdr; !is_nil(l); l = l >> cdr)
+	{
+	  parts.push_back(eval(c, l >> car));
+	  size += chars_of(parts.back(), "concatenate").size();
+	}
+      std::string result;
+      result.reserve(size);
+      for (unsigned u = 0; u < parts.size(); u++)
+	result += *string_chars(parts[u]);
+      return adopt_string(result);
+    }
+
+    variant make_string_output_stream::operator()(context_ptr, variant)
+    {
+      SHOW;
+      string_output s;
+      s.text.reset(new std::string);
+      return function(s);
+    }
+
+    // (write-string x stream): adds the characters of x to stream
+    variant write_string::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant x = eval(c, v >> car);
+      as_stream(eval(c, v >> cdr >> car), "write-string").append(chars_of(x, "write-string"));
+      return x;
+    }
+
+    // everything written to stream since the last time, which it forgets
+    variant get_output_stream_string::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      return adopt_string(as_stream(eval(c, v >> car), "get-output-stream-string"));
+    }
+
+    variant with_output_to_string()
+    {
+      native_macro m;
+      m.expand = expand_with_output_to_string;
+      return function(m);
+    }
+  }
+}
@@ -0,0 +1,61 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_STRINGS_HPP_INCLUDED
+#define LISP_STRINGS_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <string>
+
+namespace lisp {
+
+  // what a string output stream has had written to it, or 0 if v isn't one
+  std::string* output_buffer(const variant& v);
+
+  //
+  //  What has been compiled from the strings seen lately, each in the
+  //  one slot its hash picks; compile is called again only when that
+  //  slot holds some other string.  Format control strings and regex
+  //  patterns passed as plain strings are compiled through one.
+  //  Hold on to what it returns: another lookup may take the slot.
+  //
+  template <typename T>
+  class string_keyed_cache
+  {
+  public:
+    typedef boost::shared_ptr<const T> (*compiler)(const std::string&);
+
+    explicit string_keyed_cache(compiler c) : compile_(c) { }
+
+    boost::shared_ptr<const T> operator()(const string_ptr& key)
+    {
+      entry& e = entries_[key->hash() % size];
+      if (!e.key || (e.key != key && e.key->chars != key->chars))
+	{
+	  e.value = compile_(key->chars);
+	  e.key = key;
+	}
+      return e.value;
+    }
+
+  private:
+    static const std::size_t size = 64;
+
+    struct entry
+    {
+      string_ptr key;
+      boost::shared_ptr<const T> value;
+    };
+
+    compiler compile_;
+    entry entries_[size];
+  };
+}
+
+#endif
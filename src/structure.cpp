@@ -0,0 +1,126 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "analysis.hpp"
+#include "structure.hpp"
+
+#include <stdexcept>
+#include <string>
+
+using boost::get;
+
+namespace lisp {
+
+  void intrusive_ptr_add_ref(structure* s)
+  {
+    s->count++;
+  }
+
+  void intrusive_ptr_release(structure* s)
+  {
+    s->count--;
+    if (s->count == 0)
+      delete s;
+  }
+
+  namespace ops {
+
+    variant make_structure::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      structure_ptr s(new structure(type));
+      for (unsigned u = 0; u < type->slots.size(); u++)
+	if (is_nil(v))
+	  s->items[u] = eval(c, type->defaults[u]);
+	else
+	  {
+	    s->items[u] = eval(c, v >> car);
+	    v = v >> cdr;
+	  }
+      if (!is_nil(v))
+	throw std::runtime_error("too many arguments to make-" + type->name);
+      return s;
+    }
+
+    variant structure_p::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      variant x = eval(c, v >> car);
+      const structure_ptr* s = get<structure_ptr>(&x);
+      return s && (*s)->type == type ? t : nil;
+    }
+
+    variant& slot_ref::slot(const variant& v) const
+    {
+      const structure_ptr* s = get<structure_ptr>(&v);
+      if (!s || (*s)->type != type)
+	throw std::runtime_error(type->name + "-" + type->slots[offset]
+				 + ": not a " + type->name);
+      return (*s)->items[offset];
+    }
+
+    variant slot_ref::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      return slot(eval(c, v >> car));
+    }
+
+    //
+    //  (defstruct name slot...), where a slot is a name or (name
+    //  default).  Defines make-name, taking the slot values in order,
+    //  name-p, and an accessor name-slot for each slot, which setf
+    //  can assign through.  Defining name again makes a new type;
+    //  instances of the old one aren't name-p any more.
+    //
+    variant defstruct::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      const symbol* name = get<symbol>(&(v >> car));
+      if (!name)
+	throw std::runtime_error("defstruct: the name must be a symbol");
+      boost::shared_ptr<structure_type> type(new structure_type);
+      type->name = *name;
+      for (variant l = v >> cdr; !is_nil(l); l = l >> cdr)
+	{
+	  variant spec = l >> car;
+	  variant initial = nil;
+	  if (get<cons_ptr>(&spec))
+	    {
+	      initial = is_nil(spec >> cdr) ? nil : spec >> cdr >> car;
+	      spec = spec >> car;
+	    }
+	  const symbol* slot = get<symbol>(&spec);
+	  if (!slot)
+	    throw std::runtime_error("defstruct: bad slot in " + type->name);
+	  type->slots.push_back(*slot);
+	  type->defaults.push_back(initial);
+	}
+
+      std::vector<std::string> names;
+      make_structure make = { type };
+      global->put("make-" + type->name, function(make));
+      names.push_back("make-" + type->name);
+      structure_p p = { type };
+      global->put(type->name + "-p", function(p));
+      names.push_back(type->name + "-p");
+      for (unsigned u = 0; u < type->slots.size(); u++)
+	{
+	  slot_ref ref = { type, u };
+	  global->put(type->name + "-" + type->slots[u], function(ref));
+	  names.push_back(type->name + "-" + type->slots[u]);
+	}
+      for (unsigned u = 0; u < names.size(); u++)
+	invalidate(names[u]);
+      return *name;
+    }
+  }
+}
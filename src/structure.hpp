@@ -0,0 +1,81 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_STRUCTURE_HPP_INCLUDED
+#define LISP_STRUCTURE_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <string>
+#include <vector>
+
+namespace lisp {
+
+  //
+  //  What (defstruct name slot...) says: the slot names in order,
+  //  and the forms that give each one its value when the constructor
+  //  is called without it.
+  //
+  struct structure_type
+  {
+    std::string name;
+    std::vector<std::string> slots;
+    std::vector<variant> defaults;
+  };
+
+  typedef boost::shared_ptr<const structure_type> structure_type_ptr;
+
+  //
+  //  An instance: its type and one variant per slot, side by side in
+  //  a single array.  Slot i of every instance of a type is items[i].
+  //
+  struct structure : boost::noncopyable
+  {
+    unsigned count;
+    structure_type_ptr type;
+    std::vector<variant> items;
+
+    structure(const structure_type_ptr& t)
+      : count(0), type(t), items(t->slots.size())
+    { }
+  };
+
+  namespace ops {
+
+    // make-name: slot values in order, missing ones from the defaults
+    struct make_structure
+    {
+      structure_type_ptr type;
+      variant operator()(context_ptr, variant);
+    };
+
+    // name-p
+    struct structure_p
+    {
+      structure_type_ptr type;
+      variant operator()(context_ptr, variant);
+    };
+
+    //
+    //  name-slot.  Analysis puts these straight into the code in
+    //  place of their names (see inline.cpp), offset and all.
+    //
+    struct slot_ref
+    {
+      structure_type_ptr type;
+      unsigned offset;
+      variant operator()(context_ptr, variant);
+
+      // the slot in s, which had better be one of ours
+      variant& slot(const variant& s) const;
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,587 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "ops.hpp"
+#include "context.hpp"
+#include "eval.hpp"
+#include "f64vector.hpp"
+#include "table.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using boost::get;
+
+namespace lisp {
+
+  void intrusive_ptr_add_ref(table* t)
+  {
+    t->count++;
+  }
+
+  void intrusive_ptr_release(table* t)
+  {
+    t->count--;
+    if (t->count == 0)
+      delete t;
+  }
+
+  column::kind_t column::kind_named(const variant& v)
+  {
+    const symbol* s = boost::get<symbol>(&v);
+    if (s && *s == "double")
+      return doubles;
+    if (s && *s == "integer")
+      return integers;
+    if (s && *s == "string")
+      return strings;
+    if (s && *s == "symbol")
+      return symbols;
+    throw std::runtime_error("make-table: a column holds doubles, integers, strings or symbols");
+  }
+
+  const char* column::kind_name() const
+  {
+    static const char* const names[] = { "double", "integer", "string", "symbol" };
+    return names[kind];
+  }
+
+  variant column::cell(std::size_t row) const
+  {
+    switch (kind)
+      {
+      case doubles:
+	return d[row];
+      case integers:
+	return double(i[row]);
+      case strings:
+	return make_string(s[row]);
+      default:
+	return symbol(s[row]);
+      }
+  }
+
+  void column::push(const variant& v)
+  {
+    const double* x = boost::get<double>(&v);
+    if (kind == doubles && x)
+      d.push_back(*x);
+    else if (kind == integers && x && *x == std::floor(*x))
+      i.push_back(boost::int64_t(*x));
+    else if (kind == strings && boost::get<string_ptr>(&v))
+      s.push_back(boost::get<string_ptr>(v)->chars);
+    else if (kind == symbols && boost::get<symbol>(&v))
+      s.push_back(boost::get<symbol>(v));
+    else
+      throw std::runtime_error("table: column " + name + " holds only a " + kind_name());
+  }
+
+  namespace {
+
+    template <typename T>
+    void gather(const std::vector<T>& from, const std::vector<std::size_t>& rows,
+		std::vector<T>& to)
+    {
+      to.resize(rows.size());
+      for (std::size_t r = 0; r < rows.size(); r++)
+	to[r] = from[rows[r]];
+    }
+  }
+
+  column column::take(const std::vector<std::size_t>& rows) const
+  {
+    column c(name, kind);
+    if (kind == doubles)
+      gather(d, rows, c.d);
+    else if (kind == integers)
+      gather(i, rows, c.i);
+    else
+      gather(s, rows, c.s);
+    return c;
+  }
+
+  bool operator==(const column& lhs, const column& rhs)
+  {
+    return lhs.name == rhs.name && lhs.kind == rhs.kind
+      && lhs.d == rhs.d && lhs.i == rhs.i && lhs.s == rhs.s;
+  }
+
+  const column& table::find(const variant& name, const char* fn) const
+  {
+    const symbol* s = get<symbol>(&name);
+    if (!s)
+      throw std::runtime_error(std::string(fn) + ": a column name is a symbol");
+    for (unsigned u = 0; u < columns.size(); u++)
+      if (columns[u].name == *s)
+	return columns[u];
+    throw std::runtime_error(std::string(fn) + ": no column " + *s);
+  }
+
+  namespace {
+
+    table_ptr as_table(const variant& v, const char* fn)
+    {
+      const table_ptr* p = get<table_ptr>(&v);
+      if (!p)
+	throw std::runtime_error(std::string(fn) + ": not a table");
+      return *p;
+    }
+
+    // a new table of the given rows of tb, in that order
+    table_ptr take_rows(const table& tb, const std::vector<std::size_t>& rows)
+    {
+      table_ptr r(new table);
+      r->rows = rows.size();
+      for (unsigned u = 0; u < tb.columns.size(); u++)
+	r->columns.push_back(tb.columns[u].take(rows));
+      return r;
+    }
+
+    // the rows 0 to n-1
+    std::vector<std::size_t> every_row(std::size_t n)
+    {
+      std::vector<std::size_t> rows(n);
+      for (std::size_t r = 0; r < n; r++)
+	rows[r] = r;
+      return rows;
+    }
+
+    // whether rows of a and b can be compared with compare_rows()
+    bool comparable(const column& a, const column& b)
+    {
+      return a.numeric() ? b.numeric() : a.kind == b.kind;
+    }
+
+    // row i of a against row j of b: -1, 0 or 1
+    int compare_rows(const column& a, std::size_t i, const column& b, std::size_t j)
+    {
+      if (a.numeric())
+	{
+	  double x = a.number(i), y = b.number(j);
+	  return x < y ? -1 : y < x ? 1 : 0;
+	}
+      int c = a.s[i].compare(b.s[j]);
+      return c < 0 ? -1 : c > 0 ? 1 : 0;
+    }
+
+    // for sorting rows by some columns of one table
+    struct row_order
+    {
+      std::vector<const column*> keys;
+      std::vector<bool> descending;
+
+      bool operator()(std::size_t a, std::size_t b) const
+      {
+	for (unsigned u = 0; u < keys.size(); u++)
+	  if (int c = compare_rows(*keys[u], a, *keys[u], b))
+	    return descending[u] ? c > 0 : c < 0;
+	return false;
+      }
+    };
+
+    //
+    //  Writes the index of each row where cmp(col[r], x) holds to
+    //  rows, which has room for all of them, and says how many there
+    //  were.  Every index is stored but only the ones that pass are
+    //  counted, so the loop has no branch on the data.
+    //
+    template <typename T, typename X, typename Compare>
+    std::size_t select_loop(const std::vector<T>& col, const X& x, Compare cmp,
+			    std::size_t* rows)
+    {
+      std::size_t n = 0;
+      for (std::size_t r = 0; r < col.size(); r++)
+	{
+	  rows[n] = r;
+	  n += cmp(col[r], x);
+	}
+      return n;
+    }
+
+    template <typename T, typename X>
+    std::size_t select(const std::vector<T>& col, const symbol& op, const X& x,
+		       std::size_t* rows)
+    {
+      if (op == "<")
+	return select_loop(col, x, std::less<X>(), rows);
+      if (op == "<=")
+	return select_loop(col, x, std::less_equal<X>(), rows);
+      if (op == ">")
+	return select_loop(col, x, std::greater<X>(), rows);
+      if (op == ">=")
+	return select_loop(col, x, std::greater_equal<X>(), rows);
+      if (op == "=")
+	return select_loop(col, x, std::equal_to<X>(), rows);
+      if (op == "/=")
+	return select_loop(col, x, std::not_equal_to<X>(), rows);
+      throw std::runtime_error("table-where: the comparison is one of < <= > >= = /=");
+    }
+
+    double add(double a, double b) { return a + b; }
+    double smaller(double a, double b) { return b < a ? b : a; }
+    double larger(double a, double b) { return a < b ? b : a; }
+
+    // acc[g] = op(acc[g], col[r]) for the group g of each row r
+    template <typename T>
+    void accumulate(const std::vector<T>& col, const std::vector<std::size_t>& group,
+		    double (*op)(double, double), std::vector<double>& acc)
+    {
+      for (std::size_t r = 0; r < col.size(); r++)
+	acc[group[r]] = op(acc[group[r]], double(col[r]));
+    }
+  }
+
+  namespace ops {
+
+    //
+    //  (make-table '((name kind) ...) rows): each kind is double,
+    //  integer, string or symbol, and rows is a list of lists with a
+    //  value for each column, in order
+    //
+    variant make_table::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      table_ptr tb(new table);
+      for (variant l = eval(c, v >> car); !is_nil(l); l = l >> cdr)
+	{
+	  variant spec = l >> car;
+	  const symbol* name = get<symbol>(&(spec >> car));
+	  if (!name)
+	    throw std::runtime_error("make-table: a column name is a symbol");
+	  tb->columns.push_back(column(*name, column::kind_named(spec >> cdr >> car)));
+	}
+      for (variant l = eval(c, v >> cdr >> car); !is_nil(l); l = l >> cdr)
+	{
+	  variant row = l >> car;
+	  for (unsigned u = 0; u < tb->columns.size(); u++)
+	    {
+	      if (is_nil(row))
+		throw std::runtime_error("make-table: a row is too short");
+	      tb->columns[u].push(row >> car);
+	      row = row >> cdr;
+	    }
+	  if (!is_nil(row))
+	    throw std::runtime_error("make-table: a row is too long");
+	  tb->rows++;
+	}
+      return tb;
+    }
+
+    // (table-rows table): a list of lists, as make-table takes
+    variant table_rows::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      table_ptr tb = as_table(eval(c, v >> car), "table-rows");
+      list_builder rows;
+      for (std::size_t r = 0; r < tb->rows; r++)
+	{
+	  list_builder row;
+	  for (unsigned u = 0; u < tb->columns.size(); u++)
+	    row.push(tb->columns[u].cell(r));
+	  rows.push(row.head);
+	}
+      return rows.head;
+    }
+
+    // (table-columns table): ((name kind) ...), as make-table takes
+    variant table_columns::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      table_ptr tb = as_table(eval(c, v >> car), "table-columns");
+      list_builder specs;
+      for (unsigned u = 0; u < tb->columns.size(); u++)
+	{
+	  list_builder spec;
+	  spec.push(tb->columns[u].name);
+	  spec.push(symbol(tb->columns[u].kind_name()));
+	  specs.push(spec.head);
+	}
+      return specs.head;
+    }
+
+    //
+    //  (table-column table name): the values of one column, as an
+    //  f64vector if they are doubles, else as a simple vector
+    //
+    variant table_column::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      table_ptr tb = as_table(eval(c, v >> car), "table-column");
+      const column& col = tb->find(eval(c, v >> cdr >> car), "table-column");
+      if (col.kind == column::doubles)
+	{
+	  f64vector_ptr f(new f64vector(0, 0));
+	  f->items = col.d;
+	  return f;
+	}
+      array_ptr a(new array);
+      for (std::size_t r = 0; r < tb->rows; r++)
+	a->items.push_back(col.cell(r));
+      return a;
+    }
+
+    // (table-select table name...): just those columns, in that order
+    variant table_select::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      table_ptr tb = as_table(eval(c, v >> car), "table-select");
+      table_ptr r(new table);
+      r->rows = tb->rows;
+      for (variant l = v >> cdr; !is_nil(l); l = l >> cdr)
+	r->columns.push_back(tb->find(eval(c, l >> car), "table-select"));
+      return r;
+    }
+
+    //
+    //  (table-where table name op x): the rows where (op value x)
+    //  holds of the named column, op being one of < <= > >= = /=.
+    //  The comparison runs as a loop down the column, without calling
+    //  back into lisp.
+    //
+    variant table_where::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      table_ptr tb = as_table(eval(c, v >> car), "table-where");
+      v = v >> cdr;
+      const column& col = tb->find(eval(c, v >> car), "table-where");
+      variant opv = eval(c, v >> cdr >> car);
+      const symbol* op = get<symbol>(&opv);
+      if (!op)
+	throw std::runtime_error("table-where: the comparison is a symbol");
+      variant x = eval(c, v >> cdr >> cdr >> car);
+
+      std::vector<std::size_t> rows(tb->rows);
+      std::size_t* out = rows.empty() ? 0 : &rows[0];
+      std::size_t n;
+      if (col.numeric() && get<double>(&x))
+	n = col.kind == column::doubles
+	  ? select(col.d, *op, get<double>(x), out)
+	  : select(col.i, *op, get<double>(x), out);
+      else if (col.kind == column::strings && get<string_ptr>(&x))
+	n = select(col.s, *op, get<string_ptr>(x)->chars, out);
+      else if (col.kind == column::symbols && get<symbol>(&x))
+	n = select(col.s, *op, std::string(get<symbol>(x)), out);
+      else
+	throw std::runtime_error("table-where: can't compare column " + col.name
+				 + " with that");
+      rows.resize(n);
+      return take_rows(*tb, rows);
+    }
+
+    //
+    //  (table-filter table f name...): the rows for which (f value...)
+    //  is true, given the values of the named columns, or of every
+    //  column if none are named
+    //
+    variant table_filter::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      table_ptr tb = as_table(eval(c, v >> car), "table-filter");
+      function f = get<function>(eval(c, v >> cdr >> car));
+      std::vector<const column*> cols;
+      for (variant l = v >> cdr >> cdr; !is_nil(l); l = l >> cdr)
+	cols.push_back(&tb->find(eval(c, l >> car), "table-filter"));
+      if (cols.empty())
+	for (unsigned u = 0; u < tb->columns.size(); u++)
+	  cols.push_back(&tb->columns[u]);
+
+      std::vector<std::size_t> rows;
+      for (std::size_t r = 0; r < tb->rows; r++)
+	{
+	  variant args = nil;
+	  for (unsigned u = cols.size(); u > 0; u--)
+	    args = cons_ptr(new lisp::cons(special<quoted_>(cols[u-1]->cell(r)), args));
+	  if (f(c, args) == t)
+	    rows.push_back(r);
+	}
+      return take_rows(*tb, rows);
+    }
+
+    //
+    //  (table-sort table key...): the rows ordered by the first key,
+    //  then the next, and so on, keeping the order they had where all
+    //  the keys are the same.  A key is a column name, or (name
+    //  descending).
+    //
+    variant table_sort::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      table_ptr tb = as_table(eval(c, v >> car), "table-sort");
+      row_order order;
+      for (variant l = v >> cdr; !is_nil(l); l = l >> cdr)
+	{
+	  variant key = eval(c, l >> car);
+	  bool descending = false;
+	  if (const cons_ptr* p = get<cons_ptr>(&key))
+	    if (*p)
+	      {
+		const symbol* dir = get<symbol>(&(key >> cdr >> car));
+		if (!dir || (*dir != "ascending" && *dir != "descending"))
+		  throw std::runtime_error("table-sort: a key is a name or (name descending)");
+		descending = *dir == "descending";
+		key = key >> car;
+	      }
+	  order.keys.push_back(&tb->find(key, "table-sort"));
+	  order.descending.push_back(descending);
+	}
+      std::vector<std::size_t> rows = every_row(tb->rows);
+      std::stable_sort(rows.begin(), rows.end(), order);
+      return take_rows(*tb, rows);
+    }
+
+    //
+    //  (table-group-by table key aggregate...): a row for each value
+    //  of key, a column name or a list of them, ordered by key.  Each
+    //  aggregate is (count), or (sum name), (mean name), (min name)
+    //  or (max name) of a numeric column, and adds a column called
+    //  count, sum-name and so on.
+    //
+    variant table_group_by::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      table_ptr tb = as_table(eval(c, v >> car), "table-group-by");
+      variant keys = eval(c, v >> cdr >> car);
+      row_order order;
+      if (get<symbol>(&keys))
+	order.keys.push_back(&tb->find(keys, "table-group-by"));
+      else
+	for (variant l = keys; !is_nil(l); l = l >> cdr)
+	  order.keys.push_back(&tb->find(l >> car, "table-group-by"));
+      order.descending.resize(order.keys.size(), false);
+
+      // number the groups in key order, and note where each starts
+      std::vector<std::size_t> sorted = every_row(tb->rows);
+      std::stable_sort(sorted.begin(), sorted.end(), order);
+      std::vector<std::size_t> group(tb->rows), first;
+      for (std::size_t p = 0; p < sorted.size(); p++)
+	{
+	  if (p == 0 || order(sorted[p-1], sorted[p]))
+	    first.push_back(sorted[p]);
+	  group[sorted[p]] = first.size() - 1;
+	}
+      std::size_t groups = first.size();
+
+      table_ptr r(new table);
+      r->rows = groups;
+      for (unsigned u = 0; u < order.keys.size(); u++)
+	r->columns.push_back(order.keys[u]->take(first));
+
+      std::vector<double> counts(groups, 0);
+      for (std::size_t row = 0; row < tb->rows; row++)
+	counts[group[row]]++;
+
+      for (variant l = v >> cdr >> cdr; !is_nil(l); l = l >> cdr)
+	{
+	  variant spec = eval(c, l >> car);
+	  const symbol* op = get<symbol>(&(spec >> car));
+	  if (op && *op == "count")
+	    {
+	      column col(symbol("count"), column::integers);
+	      for (std::size_t g = 0; g < groups; g++)
+		col.i.push_back(boost::int64_t(counts[g]));
+	      r->columns.push_back(col);
+	      continue;
+	    }
+
+	  double (*combine)(double, double) = add;
+	  double initial = 0;
+	  if (op && *op == "min")
+	    {
+	      combine = smaller;
+	      initial = std::numeric_limits<double>::infinity();
+	    }
+	  else if (op && *op == "max")
+	    {
+	      combine = larger;
+	      initial = -std::numeric_limits<double>::infinity();
+	    }
+	  else if (!op || (*op != "sum" && *op != "mean"))
+	    throw std::runtime_error("table-group-by: an aggregate is count, sum, mean, min or max");
+
+	  const column& from = tb->find(spec >> cdr >> car, "table-group-by");
+	  if (!from.numeric())
+	    throw std::runtime_error("table-group-by: column " + from.name + " isn't numeric");
+	  column col(symbol(*op + "-" + from.name), column::doubles);
+	  col.d.resize(groups, initial);
+	  if (from.kind == column::doubles)
+	    accumulate(from.d, group, combine, col.d);
+	  else
+	    accumulate(from.i, group, combine, col.d);
+	  if (*op == "mean")
+	    for (std::size_t g = 0; g < groups; g++)
+	      col.d[g] /= counts[g];
+	  r->columns.push_back(col);
+	}
+      return r;
+    }
+
+    //
+    //  (table-join left right key [right-key]): a row for each pair of
+    //  rows whose keys are the same, the columns of left followed by
+    //  those of right but its key.  right-key is the column of right
+    //  to match, if it isn't called key too.
+    //
+    variant table_join::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      table_ptr left = as_table(eval(c, v >> car), "table-join");
+      table_ptr right = as_table(eval(c, v >> cdr >> car), "table-join");
+      variant key = eval(c, v >> cdr >> cdr >> car);
+      variant rest = v >> cdr >> cdr >> cdr;
+      variant right_key = is_nil(rest) ? key : eval(c, rest >> car);
+      const column& lk = left->find(key, "table-join");
+      const column& rk = right->find(right_key, "table-join");
+      if (!comparable(lk, rk))
+	throw std::runtime_error("table-join: the keys are of different kinds");
+
+      // look each left key up among the sorted right ones
+      row_order order;
+      order.keys.push_back(&rk);
+      order.descending.push_back(false);
+      std::vector<std::size_t> sorted = every_row(right->rows);
+      std::stable_sort(sorted.begin(), sorted.end(), order);
+
+      std::vector<std::size_t> lrows, rrows;
+      for (std::size_t l = 0; l < left->rows; l++)
+	{
+	  std::size_t lo = 0, hi = sorted.size();
+	  while (lo < hi)
+	    {
+	      std::size_t mid = lo + (hi - lo) / 2;
+	      if (compare_rows(rk, sorted[mid], lk, l) < 0)
+		lo = mid + 1;
+	      else
+		hi = mid;
+	    }
+	  for (; lo < sorted.size() && compare_rows(rk, sorted[lo], lk, l) == 0; lo++)
+	    {
+	      lrows.push_back(l);
+	      rrows.push_back(sorted[lo]);
+	    }
+	}
+
+      table_ptr r = take_rows(*left, lrows);
+      for (unsigned u = 0; u < right->columns.size(); u++)
+	{
+	  const column& col = right->columns[u];
+	  if (&col == &rk)
+	    continue;
+	  for (unsigned w = 0; w < r->columns.size(); w++)
+	    if (r->columns[w].name == col.name)
+	      throw std::runtime_error("table-join: both tables have a column " + col.name);
+	  r->columns.push_back(col.take(rrows));
+	}
+      return r;
+    }
+  }
+}
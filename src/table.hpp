@@ -0,0 +1,73 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_TABLE_HPP_INCLUDED
+#define LISP_TABLE_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace lisp {
+
+  //
+  //  One column of a table: a name, a kind, and the values of every
+  //  row side by side in the one vector for that kind.  Strings and
+  //  symbols both live in s.
+  //
+  struct column
+  {
+    enum kind_t { doubles, integers, strings, symbols };
+
+    symbol name;
+    kind_t kind;
+    std::vector<double> d;
+    std::vector<boost::int64_t> i;
+    std::vector<std::string> s;
+
+    column(const symbol& n, kind_t k) : name(n), kind(k) { }
+
+    // the kind called double, integer, string or symbol
+    static kind_t kind_named(const variant& v);
+    const char* kind_name() const;
+
+    bool numeric() const { return kind == doubles || kind == integers; }
+    double number(std::size_t row) const { return kind == doubles ? d[row] : double(i[row]); }
+
+    variant cell(std::size_t row) const;
+    // throws unless v is of the column's kind
+    void push(const variant& v);
+    // the given rows, in that order
+    column take(const std::vector<std::size_t>& rows) const;
+  };
+
+  bool operator==(const column& lhs, const column& rhs);
+
+  //
+  //  make-table: rows of values held column by column, so that a
+  //  filter or a sum runs down one contiguous vector instead of
+  //  chasing a list per row.  The table- builtins each give a new
+  //  table rather than changing the one they're given.
+  //
+  struct table : boost::noncopyable
+  {
+    unsigned count;
+    std::size_t rows;
+    std::vector<column> columns;
+
+    table() : count(0), rows(0) { }
+
+    // throws if there's no column of that name; fn is who's asking
+    const column& find(const variant& name, const char* fn) const;
+  };
+}
+
+#endif
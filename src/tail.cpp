@@ -0,0 +1,187 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "context.hpp"
+#include "ops.hpp"
+#include "dispatch.hpp"
+#include "analysis.hpp"
+#include "tail.hpp"
+
+#include <set>
+#include <string>
+
+using boost::get;
+
+namespace lisp {
+
+  bool tail_call_pending = false;
+  std::vector<variant> tail_call_args;
+
+  namespace ops {
+
+    variant self_call::operator()(context_ptr c, variant v)
+    {
+      SHOW;
+      std::vector<variant> args;
+      for (; !is_nil(v); v = v >> cdr)
+	args.push_back(eval(c, v >> car));
+      tail_call_args.swap(args);
+      tail_call_pending = true;
+      return nil;
+    }
+  }
+
+  namespace {
+
+    template <typename Op>
+    bool is(const function& f)
+    {
+      return f.f.target<Op>() != 0;
+    }
+
+    struct converter
+    {
+      const procedure_ptr& proc;
+      std::set<std::string> bound;
+      unsigned converted;
+
+      converter(const procedure_ptr& _proc) : proc(_proc), converted(0)
+      {
+	bound.insert(proc->args.begin(), proc->args.end());
+      }
+
+      // the function in the operator position of p, if we know it
+      bool resolve(const cons_ptr& p, function& f)
+      {
+	if (const function* embedded = get<function>(&p->car))
+	  {
+	    f = *embedded;
+	    return true;
+	  }
+	const symbol* s = get<symbol>(&p->car);
+	if (!s || bound.count(*s))
+	  return false;
+	try {
+	  if (const function* found = get<function>(&proc->ctx->get<variant>(*s)))
+	    {
+	      f = *found;
+	      return true;
+	    }
+	} catch (const std::exception&) { }
+	return false;
+      }
+
+      // forms, with the last one, which is in tail position, rewritten
+      variant last(const variant& forms)
+      {
+	const cons_ptr* p = get<cons_ptr>(&forms);
+	if (!p || !*p)
+	  return forms;
+	if (is_nil((*p)->cdr))
+	  return cons_ptr(new cons(tail((*p)->car)));
+	return cons_ptr(new cons((*p)->car, last((*p)->cdr)));
+      }
+
+      variant tail(const variant& form)
+      {
+	const cons_ptr* pp = get<cons_ptr>(&form);
+	if (!pp || !*pp)
+	  return form;
+	const cons_ptr& p = *pp;
+
+	function f;
+	if (!resolve(p, f))
+	  return form;
+
+	if (is<ops::progn>(f))
+	  return cons_ptr(new cons(p->car, last(p->cdr)));
+
+	if (is<ops::if_clause>(f))
+	  {
+	    const cons_ptr* rest = get<cons_ptr>(&p->cdr);
+	    if (!rest || !*rest)
+	      return form;
+	    return cons_ptr(new cons(p->car,
+				     cons_ptr(new cons((*rest)->car,
+						       branches((*rest)->cdr)))));
+	  }
+
+	if (is<ops::let>(f) || is<ops::stack_let>(f))
+	  {
+	    const cons_ptr* rest = get<cons_ptr>(&p->cdr);
+	    if (!rest || !*rest)
+	      return form;
+	    std::set<std::string> saved = bound;
+	    for (const cons_ptr* l = get<cons_ptr>(&(*rest)->car); l && *l;
+		 l = get<cons_ptr>(&(*l)->cdr))
+	      if (const cons_ptr* pair = get<cons_ptr>(&(*l)->car))
+		if (*pair)
+		  if (const symbol* s = get<symbol>(&(*pair)->car))
+		    bound.insert(*s);
+	    variant body = last((*rest)->cdr);
+	    bound.swap(saved);
+	    return cons_ptr(new cons(p->car, cons_ptr(new cons((*rest)->car, body))));
+	  }
+
+	if (as_procedure(f) == proc && arity(p->cdr) == proc->args.size())
+	  {
+	    static const function self = function(ops::self_call());
+	    converted++;
+	    return cons_ptr(new cons(embed(self, proc->name.c_str()), p->cdr));
+	  }
+
+	return form;
+      }
+
+      // the then and else of an if, both in tail position
+      variant branches(const variant& v)
+      {
+	const cons_ptr* p = get<cons_ptr>(&v);
+	if (!p || !*p)
+	  return v;
+	return cons_ptr(new cons(tail((*p)->car), branches((*p)->cdr)));
+      }
+
+      unsigned arity(const variant& args)
+      {
+	unsigned n = 0;
+	for (const cons_ptr* l = get<cons_ptr>(&args); l && *l; l = get<cons_ptr>(&(*l)->cdr))
+	  n++;
+	return n;
+      }
+    };
+  }
+
+  void tail_calls(const procedure_ptr& proc)
+  {
+    proc->tail_loop = false;
+    if (proc->name.empty())
+      return;
+
+    // somebody might rebind the name under us
+    std::set<std::string> assigned;
+    setf_targets(proc->source, assigned);
+    for (unsigned u = 0; u < proc->args.size(); u++)
+      assigned.insert(proc->args[u]);
+    if (assigned.count(proc->name))
+      return;
+
+    converter c(proc);
+    variant code;
+    try {
+      code = c.last(proc->code);
+    } catch (const std::exception&) {
+      return;
+    }
+    if (c.converted == 0)
+      return;
+    proc->set_code(code);
+    proc->tail_loop = true;
+  }
+}
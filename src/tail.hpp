@@ -0,0 +1,45 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_TAIL_HPP_INCLUDED
+#define LISP_TAIL_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace lisp {
+
+  struct procedure;
+
+  //
+  //  Rewrite the calls proc makes to itself in tail position into
+  //  self_calls, which dispatch turns into a loop over the same
+  //  frame instead of a nested call.  Accumulator style recursion
+  //  then runs in constant stack.
+  //
+  void tail_calls(const boost::shared_ptr<procedure>& proc);
+
+  //
+  //  What a self_call leaves behind for dispatch: the new values of
+  //  the arguments.  Nothing is evaluated between the self_call
+  //  returning and dispatch picking these up, so one of each will do.
+  //
+  extern bool tail_call_pending;
+  extern std::vector<variant> tail_call_args;
+
+  namespace ops {
+
+    struct self_call
+    {
+      variant operator()(context_ptr c, variant v);
+    };
+  }
+}
+
+#endif
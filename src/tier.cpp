@@ -0,0 +1,93 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#include "config.hpp"
+#include "types.hpp"
+#include "dispatch.hpp"
+#include "analysis.hpp"
+#include "tier.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <time.h>
+
+namespace lisp {
+
+  unsigned tier_hot_calls = 10;
+
+  unsigned tier_clock::current_ = cold_tier;
+
+  namespace {
+
+    double seconds[n_tiers];
+    std::vector<std::string> promoted;
+
+    double now()
+    {
+      timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    double since = now();
+
+    variant list_of(const std::vector<variant>& v)
+    {
+      variant l = nil;
+      for (unsigned u = v.size(); u > 0; u--)
+	l = cons_ptr(new cons(v[u-1], l));
+      return l;
+    }
+
+    variant entry(const char* name, double value)
+    {
+      std::vector<variant> v;
+      v.push_back(symbol(name));
+      v.push_back(value);
+      return list_of(v);
+    }
+  }
+
+  void tier_clock::switch_to(unsigned t)
+  {
+    double t1 = now();
+    seconds[current_] += t1 - since;
+    since = t1;
+    current_ = t;
+  }
+
+  void promote(const procedure_ptr& proc)
+  {
+    tier_clock clock(analysis_tier);
+    analyze(proc);
+    proc->tier = hot_tier;
+
+    if (std::find(promoted.begin(), promoted.end(), proc->name) == promoted.end())
+      promoted.push_back(proc->name);
+
+    // callers that were promoted first may do better now
+    invalidate(proc->name);
+  }
+
+  variant tier_stats()
+  {
+    tier_clock::switch_to(tier_clock::current_);
+
+    std::vector<variant> names;
+    names.push_back(symbol("promoted"));
+    for (unsigned u = 0; u < promoted.size(); u++)
+      names.push_back(symbol(promoted[u]));
+
+    std::vector<variant> v;
+    v.push_back(list_of(names));
+    v.push_back(entry("cold", seconds[cold_tier]));
+    v.push_back(entry("hot", seconds[hot_tier]));
+    v.push_back(entry("analysis", seconds[analysis_tier]));
+    return list_of(v);
+  }
+}
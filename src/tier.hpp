@@ -0,0 +1,74 @@
+//
+// Copyright Troy D. Straszheim 2009
+//
+// Distributed under the Boost Software License, Version 1.0
+// See http://www.boost.org/LICENSE_1.0.txt
+//
+
+#ifndef LISP_TIER_HPP_INCLUDED
+#define LISP_TIER_HPP_INCLUDED
+
+#include "types.hpp"
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace lisp {
+
+  struct procedure;
+
+  //
+  //  Functions start out cold: dispatch walks their source just as
+  //  it was written.  One that has been called tier_hot_calls times
+  //  is promoted, i.e. analyzed (see analysis.hpp), and from then on
+  //  runs whatever the analysis made of it.  One-shot code never pays
+  //  for analysis it can't earn back.
+  //
+  enum tier
+    {
+      cold_tier,
+      hot_tier,
+      analysis_tier,            // not code, the time spent promoting
+      n_tiers
+    };
+
+  // 0: promote every function as soon as it is defined
+  extern unsigned tier_hot_calls;
+
+  void promote(const boost::shared_ptr<procedure>& proc);
+
+  //
+  //  Charges the time until it goes away to tier t.  Only switching
+  //  tiers reads the clock, so calls within a tier cost a compare.
+  //
+  class tier_clock : boost::noncopyable
+  {
+  public:
+    tier_clock(unsigned t) : saved_(current_)
+    {
+      if (t != current_)
+	switch_to(t);
+    }
+
+    ~tier_clock()
+    {
+      if (saved_ != current_)
+	switch_to(saved_);
+    }
+
+  private:
+    unsigned saved_;
+
+    static unsigned current_;
+    static void switch_to(unsigned t);
+
+    friend variant tier_stats();
+  };
+
+  //
+  //  ((promoted name ...) (cold seconds) (hot seconds) (analysis seconds))
+  //
+  variant tier_stats();
+}
+
+#endif
@@ -8,6 +8,8 @@
 #include "types.hpp"
 #include "context.hpp"
 
+#include <boost/functional/hash.hpp>
+
 namespace lisp
 {
   variant function::operator()(context_ptr& ctx, variant& cns)
@@ -15,6 +17,43 @@ namespace lisp
     return f(ctx, cns);
   }
 
+  //
+  //  Each cons of the rest of the list is taken off it before it is
+  //  let go, so freeing a long list doesn't recurse through ~cons
+  //  once per element and run out of stack.
+  //
+  void free_cons(cons* c)
+  {
+    cons_ptr rest;
+    if (cons_ptr* p = boost::get<cons_ptr>(&c->cdr))
+      rest.swap(*p);
+    delete c;
+    while (rest && rest->count == 1)
+      {
+	cons_ptr next;
+	if (cons_ptr* p = boost::get<cons_ptr>(&rest->cdr))
+	  next.swap(*p);
+	rest.swap(next);
+      }
+  }
+
+  std::size_t string_data::hash() const
+  {
+    if (!hashed_)
+      {
+	hash_ = boost::hash<std::string>()(chars);
+	hashed_ = true;
+      }
+    return hash_;
+  }
+
+  const std::string* string_chars(const variant& v)
+  {
+    if (const string_ptr* s = boost::get<string_ptr>(&v))
+      return &(*s)->chars;
+    return boost::get<symbol>(&v);
+  }
+
   const variant nil(cons_ptr(0));
   const variant t(symbol("t"));
 }
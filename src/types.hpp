@@ -19,7 +19,7 @@ namespace lisp
 {
   struct symbol : std::string
   {
-    symbol(const std::string& s) : std::string(s) { }
+    explicit symbol(const std::string& s) : std::string(s) { }
     symbol(const char* s, unsigned len) : std::string(s, len) { }
     symbol(const std::vector<char>& s) 
       : std::string(s.begin(), s.end()) 
@@ -34,6 +34,52 @@ namespace lisp
   struct cons;
   typedef boost::intrusive_ptr<cons> cons_ptr;
 
+  struct string_data;
+  typedef boost::intrusive_ptr<string_data> string_ptr;
+
+  struct array;
+  typedef boost::intrusive_ptr<array> array_ptr;
+
+  class hash_table;
+  typedef boost::intrusive_ptr<hash_table> hash_table_ptr;
+  void intrusive_ptr_add_ref(hash_table*);
+  void intrusive_ptr_release(hash_table*);
+
+  struct f64vector;
+  typedef boost::intrusive_ptr<f64vector> f64vector_ptr;
+  void intrusive_ptr_add_ref(f64vector*);
+  void intrusive_ptr_release(f64vector*);
+
+  struct structure;
+  typedef boost::intrusive_ptr<structure> structure_ptr;
+  void intrusive_ptr_add_ref(structure*);
+  void intrusive_ptr_release(structure*);
+
+  struct pmap;
+  typedef boost::intrusive_ptr<pmap> pmap_ptr;
+  void intrusive_ptr_add_ref(pmap*);
+  void intrusive_ptr_release(pmap*);
+
+  struct pvector;
+  typedef boost::intrusive_ptr<pvector> pvector_ptr;
+  void intrusive_ptr_add_ref(pvector*);
+  void intrusive_ptr_release(pvector*);
+
+  struct bitvector;
+  typedef boost::intrusive_ptr<bitvector> bitvector_ptr;
+  void intrusive_ptr_add_ref(bitvector*);
+  void intrusive_ptr_release(bitvector*);
+
+  struct table;
+  typedef boost::intrusive_ptr<table> table_ptr;
+  void intrusive_ptr_add_ref(table*);
+  void intrusive_ptr_release(table*);
+
+  struct lazy_seq;
+  typedef boost::intrusive_ptr<lazy_seq> lazy_seq_ptr;
+  void intrusive_ptr_add_ref(lazy_seq*);
+  void intrusive_ptr_release(lazy_seq*);
+
   struct context;
   typedef boost::shared_ptr<context> context_ptr;
 
@@ -46,14 +92,23 @@ namespace lisp
   template <typename T> struct special;
 
   typedef boost::variant<double,
-			 std::string,
+			 string_ptr,
 			 symbol,
 			 boost::recursive_wrapper<function>,
 			 cons_ptr,
 			 boost::recursive_wrapper<special<quoted_> >, 
 			 boost::recursive_wrapper<special<backquoted_> >, 
 			 boost::recursive_wrapper<special<comma_> >,
-			 boost::recursive_wrapper<special<comma_at_> >
+			 boost::recursive_wrapper<special<comma_at_> >,
+			 array_ptr,
+			 hash_table_ptr,
+			 f64vector_ptr,
+			 structure_ptr,
+			 pmap_ptr,
+			 pvector_ptr,
+			 bitvector_ptr,
+			 table_ptr,
+			 lazy_seq_ptr
 			 > variant;
 
   extern const variant nil;
@@ -126,12 +181,91 @@ namespace lisp
     c->count++;
   }
   
+  // deletes c and as much of the list after it as nobody else holds
+  void free_cons(cons* c);
+
   inline void intrusive_ptr_release(cons* c)
   {
     //    std::cout << "dec cons @ " << c << "\n";
     c->count--;
     if (c->count == 0)
-      delete c;
+      free_cons(c);
+  }
+
+  //
+  //  A Lisp string.  Its characters are never changed once it's made,
+  //  so all the copies of a string_ptr share the one std::string, and
+  //  the hash is worked out only the first time it's asked for.
+  //
+  struct string_data
+  {
+    unsigned count;
+
+    std::string chars;
+
+    string_data() : count(0), hashed_(false) { }
+    string_data(const std::string& s) : count(0), chars(s), hashed_(false) { }
+
+    std::size_t hash() const;
+
+  private:
+    mutable std::size_t hash_;
+    mutable bool hashed_;
+  };
+
+  inline void intrusive_ptr_add_ref(string_data* s)
+  {
+    s->count++;
+  }
+
+  inline void intrusive_ptr_release(string_data* s)
+  {
+    s->count--;
+    if (s->count == 0)
+      delete s;
+  }
+
+  inline string_ptr make_string(const std::string& s)
+  {
+    return string_ptr(new string_data(s));
+  }
+
+  // a new string with the characters of s, which is left empty
+  inline string_ptr adopt_string(std::string& s)
+  {
+    string_ptr p(new string_data);
+    p->chars.swap(s);
+    return p;
+  }
+
+  // the characters of a string or symbol, or 0 for anything else
+  const std::string* string_chars(const variant& v);
+
+  //
+  //  A simple vector, #(...): its elements side by side, indexed in
+  //  constant time.  Shared, like conses, and changed in place.
+  //
+  struct array
+  {
+    unsigned count;
+
+    std::vector<variant> items;
+
+    array() : count(0) { }
+    array(const std::vector<variant>& v) : count(0), items(v) { }
+    array(std::size_t n, const variant& v) : count(0), items(n, v) { }
+  };
+
+  inline void intrusive_ptr_add_ref(array* a)
+  {
+    a->count++;
+  }
+
+  inline void intrusive_ptr_release(array* a)
+  {
+    a->count--;
+    if (a->count == 0)
+      delete a;
   }
 
   extern const variant nil;
@@ -181,6 +315,27 @@ namespace lisp
     return boost::get<cons_ptr>(v)->cdr;
   };
 
+  //
+  //  builds a list front to back, keeping hold of its last cons so
+  //  each push is one allocation
+  //
+  struct list_builder
+  {
+    variant head;
+    cons_ptr last;
+
+    list_builder() : head(cons_ptr(0)) { }
+
+    void push(const variant& v)
+    {
+      cons_ptr cell(new cons(v));
+      if (last)
+	last->cdr = cell;
+      else
+	head = cell;
+      last = cell;
+    }
+  };
 }
 
 #endif
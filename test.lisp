@@ -174,6 +174,372 @@
 (setf y 13)
 (check (equal (funcall closure 1) 5))
 
+;
+; small functions get pasted into their callers...
+;
+(defun sq (x) (* x x))
+(defun sq-plus-one (x) (+ (sq x) 1))
+(defun sq-of-sum (x y) (sq (+ x y)))
+(check (equal (sq-plus-one 3) 10))
+(check (equal (sq-of-sum 1 2) 9))
+(defun quoted-x (x) (quote x))
+(defun call-quoted-x (y) (quoted-x y))
+(check (equal (mapcar call-quoted-x '(1 2 3 4 5 6 7 8 9 10 11 12)) '(x x x x x x x x x x x x)))
+
+;
+; ...and taken back out when they are redefined
+;
+(defun sq (x) (* x x x))
+(check (equal (sq-plus-one 3) 28))
+(check (equal (sq-of-sum 1 2) 27))
+
+;
+; frames nobody can capture live on the frame stack, the rest on the heap
+;
+(defun sum-squares (n)
+  (if (equal n 0)
+      0
+    (let ((s (* n n)))
+      (+ s (sum-squares (- n 1))))))
+(check (equal (sum-squares 4) 30))
+
+(defun make-counter ()
+  (let ((n 0))
+    (lambda () (setf n (+ n 1)))))
+(setf counter (make-counter))
+(funcall counter)
+(check (equal (funcall counter) 2))
+(check (equal (funcall (make-counter)) 1))
+
+; eval through a variable makes closures analysis can't see coming
+(setf eval-later eval)
+(defun bump-then-scale (n)
+  (let ((x n))
+    (let ((bump (funcall eval-later '(lambda () (setf x (+ x 1)) (eval 'x))))
+	  (scale (funcall eval-later '(lambda () (setf x (* x 10)) (eval 'x)))))
+      (list (funcall bump) (funcall scale) x))))
+(check (equal (mapcar bump-then-scale '(1 1 1 1 1 1 1 1 1 1 1 1))
+	      '((2 20 20) (2 20 20) (2 20 20) (2 20 20) (2 20 20) (2 20 20)
+		(2 20 20) (2 20 20) (2 20 20) (2 20 20) (2 20 20) (2 20 20))))
+
+;
+; closures keep only the variables they mention, sharing the assigned ones
+;
+(defun adder (n) (lambda (x) (+ x n)))
+(check (equal (funcall (adder 3) 4) 7))
+
+(defun curry (a) (lambda (b) (lambda (c) (+ a b c))))
+(check (equal (funcall (funcall (curry 1) 2) 3) 6))
+
+(defun bump-twice ()
+  (let ((n 0))
+    (funcall (lambda () (setf n (+ n 1))))
+    (funcall (lambda () (setf n (+ n 1))))
+    n))
+(check (equal (bump-twice) 2))
+
+(setf late 1)
+(setf get-late (lambda () late))
+(setf late 2)
+(check (equal (funcall get-late) 2))
+
+(check (< 1 2 3))
+(check (equal (<= 2 2 1) nil))
+
+(defun nfib (n) (if (< n 2) n (+ (nfib (- n 1)) (nfib (- n 2)))))
+(check (equal (nfib 15) 610))
+
+(defun half (x) (/ x 2))
+(defun quarter (x) (half (half x)))
+(check (equal (quarter 10) 2.5))
+(defun half (x) (list x))
+(check (equal (quarter 1) '((1))))
+
+(defun is-even (n) (if (< n 1) (= n 0) (is-even (- n 2))))
+(check (is-even 10))
+(check (equal (is-even 7) nil))
+
+(defun dsum (n acc)
+  (declare (type double n acc))
+  (if (< n 1) acc (dsum (- n 1) (+ acc n))))
+(check (equal (dsum 100 0) 5050))
+
+(defun fast-inc (x) (declare (double x) (optimize (speed 3))) (+ x 1))
+(check (equal (fast-inc 2) 3))
+
+(check (equal (funcall (lambda (l) (declare (list l)) l) '(1 2)) '(1 2)))
+(check (equal (let ((a 1) (b 2)) (declare (type number a b)) (+ a b)) 3))
+
+; promoted to the hot tier halfway down the recursion
+(defun tri (n) (if (< n 1) 0 (+ n (tri (- n 1)))))
+(check (equal (tri 30) 465))
+
+; far deeper than the C++ stack would allow
+(defun depth (n) (if (< n 1) 'bottom (if (depth (- n 1)) n n)))
+(check (equal (depth 20000) 20000))
+
+; self calls in tail position loop instead of nesting
+(defun count-down (n acc) (if (< n 1) acc (count-down (- n 1) acc)))
+(check (equal (count-down 120000 'done) 'done))
+(defun sum-to (n acc) (if (< n 1) acc (sum-to (- n 1) (+ acc n))))
+(check (equal (sum-to 150000 0) 11250075000))
+
+(defun-memo mfib (n) (if (< n 2) n (+ (mfib (- n 1)) (mfib (- n 2)))))
+(check (equal (mfib 60) 1548008755920))
+(defun pair (a b) (list a b))
+(memoize 'pair 2)
+(check (equal (pair 1 '(x "y")) '(1 (x "y"))))
+(check (equal (pair 1 '(x "y")) '(1 (x "y"))))
+(pair 2 2)
+(pair 3 3)
+(check (equal (memo-stats 'pair) '((hits 1) (misses 3) (evictions 1) (size 2) (limit 2))))
+
+(defvar vec #(1 "two" (3) #(4)))
+(check (equal (aref vec 1) "two"))
+(check (equal (length vec) 4))
+(check (equal vec #(1 "two" (3) #(4))))
+(check (equal (equal vec #(1 "two" (3) #(5))) nil))
+(setf (aref vec 0) 'one)
+(check (equal (aref vec 0) 'one))
+(check (equal (make-array 2 0) (vector 0 0)))
+(check (equal `#(a ,(+ 1 1)) #(a 2)))
+(check (equal (length '(1 2 3)) 3))
+
+(defvar table (make-hash-table 'equal))
+(puthash '(1 2) 'pair table)
+(puthash "key" 'string table)
+(setf (gethash 3 table) 'three)
+(check (equal (gethash (list 1 2) table) 'pair))
+(check (equal (gethash "key" table) 'string))
+(check (equal (gethash 'absent table 'none) 'none))
+(check (equal (hash-table-count table) 3))
+(remhash "key" table)
+(check (equal (gethash "key" table) nil))
+(defvar keys 0)
+(maphash (lambda (k v) (setf keys (+ keys 1))) table)
+(check (equal keys 2))
+(defvar ids (make-hash-table 'eq))
+(puthash 'a 1 ids)
+(puthash '(1) 2 ids)
+(check (equal (gethash 'a ids) 1))
+(check (equal (gethash '(1) ids 'other) 'other))
+(check (eq 'a 'a))
+(check (equal (eq (list 1) (list 1)) nil))
+
+(defvar fv (make-f64vector '(1 2 3 4 5 6 7 8 9)))
+(defvar twos (make-f64vector 9 2))
+(defun f64-checks ()
+  (check (equal (f64-sum fv) 45))
+  (check (equal (f64-dot fv twos) 90))
+  (check (equal (list (f64-min fv) (f64-max fv)) '(1 9)))
+  (check (equal (f64-add fv twos) (make-f64vector #(3 4 5 6 7 8 9 10 11))))
+  (check (equal (f64-mul fv twos) (f64-scale fv 2)))
+  (check (equal (f64-prefix-sum fv) (make-f64vector '(1 3 6 10 15 21 28 36 45)))))
+(f64-checks)
+(defvar simd (f64-kernels))
+(f64-kernels 'scalar)
+(f64-checks)
+(f64-kernels simd)
+(setf (f64ref fv 8) -1)
+(check (equal (list (f64ref fv 8) (f64-min fv) (length fv)) '(-1 -1 9)))
+
+(defstruct point x (y 0))
+(defvar pt (make-point 3 4))
+(check (equal (list (point-x pt) (point-y pt)) '(3 4)))
+(check (equal (point-y (make-point 1)) 0))
+(check (equal (list (point-p pt) (point-p '(3 4))) '(t nil)))
+(check (equal pt (make-point 3 4)))
+(check (equal (equal pt (make-point 3 5)) nil))
+(defun manhattan (p) (+ (point-x p) (point-y p)))
+(defun shift (p) (setf (point-x p) (+ (point-x p) 1)) p)
+(check (equal (manhattan (shift pt)) 8))
+(check (equal (manhattan pt) 8))
+
+(defvar config (pmap 'host "a" 'port 80 '(x y) 1))
+(defvar changed (pmap-assoc config 'port 8080))
+(check (equal (list (pmap-get config 'port) (pmap-get changed 'port)) '(80 8080)))
+(check (equal (pmap-get changed '(x y)) 1))
+(check (equal (pmap-get (pmap-dissoc changed 'host) 'host 'gone) 'gone))
+(check (equal (pmap-count (pmap-dissoc changed 'host)) 2))
+(check (equal (pmap-from-alist (pmap-alist config)) config))
+(defun pmap-fill (m i n) (if (< i n) (pmap-fill (pmap-assoc m i (* i i)) (+ i 1) n) m))
+(check (equal (pmap-get (pmap-fill (pmap) 0 200) 150) 22500))
+(defun pvector-fill (v i n) (if (< i n) (pvector-fill (pvector-conj v i) (+ i 1) n) v))
+(defvar pv (pvector-fill (pvector) 0 1100))
+(check (equal (list (length pv) (pvector-nth pv 0) (pvector-nth pv 1099)) '(1100 0 1099)))
+(check (equal (pvector-from-list (pvector-list pv)) pv))
+(check (equal (pvector-nth (pvector-assoc pv 1000 'x) 1000) 'x))
+(check (equal (pvector-nth pv 1000) 1000))
+(check (equal (pvector-pop (pvector 1 2 3)) (pvector 1 2)))
+(check (equal (length (pvector-pop (pvector-pop pv))) 1098))
+; pop from the trie into the tail, and down to a shorter root
+(defvar pv33 (pvector-fill (pvector) 0 33))
+(check (equal (pvector-conj (pvector-pop pv33) 'x) (pvector-conj (pvector-fill (pvector) 0 32) 'x)))
+(defvar pv1056 (pvector-pop (pvector-fill (pvector) 0 1057)))
+(check (equal (list (length pv1056) (pvector-nth pv1056 1055)) '(1056 1055)))
+(check (equal pv1056 (pvector-fill (pvector) 0 1056)))
+(check (equal (pvector-nth (pvector-conj pv1056 'y) 1056) 'y))
+; a list and a dotted pair of the same things hash alike, so these two collide
+(defvar k1 (list 1 2))
+(defvar k2 (cons 1 2))
+(defvar clash (pmap k1 'one k2 'two))
+(check (equal (list (pmap-count clash) (pmap-get clash k1) (pmap-get clash k2)) '(2 one two)))
+(check (equal (pmap-get (pmap-assoc clash k2 'deux) k2) 'deux))
+(check (equal (list (pmap-get (pmap-dissoc clash k1) k1 'gone) (pmap-get (pmap-dissoc clash k1) k2)) '(gone two)))
+(check (equal (pmap-count (pmap-dissoc (pmap-dissoc clash k1) k2)) 0))
+
+(defvar bv #*0110)
+(defun bit-checks ()
+  (check (equal (bit-and bv #*1010) #*0010))
+  (check (equal (bit-or bv #*1010) #*1110))
+  (check (equal (bit-xor bv #*1010) #*1100))
+  (check (equal (bit-not bv) #*1001))
+  (check (equal (popcount (bit-not (make-bit-vector 300))) 300))
+  (check (equal (popcount (bit-xor (make-bit-vector 300 1) (bit-not (make-bit-vector 300)))) 0)))
+(bit-checks)
+(defvar bit-simd (bit-kernels))
+(bit-kernels 'scalar)
+(bit-checks)
+(bit-kernels bit-simd)
+(check (equal (list (length bv) (sbit bv 0) (sbit bv 1)) '(4 0 1)))
+(check (equal (list (find-first-set bv) (find-first-set bv 2) (find-first-set bv 3)) '(1 2 nil)))
+(defvar wide (make-bit-vector 200))
+(setf (sbit wide 130) 1)
+(setf (sbit wide 7) 1)
+(check (equal (bit-positions wide) '(7 130)))
+(check (equal (find-first-set wide 8) 130))
+(defvar bit-sum 0)
+(map-set-bits (lambda (i) (setf bit-sum (+ bit-sum i))) wide)
+(check (equal bit-sum 137))
+
+(defvar weather (make-table '((city symbol) (day integer) (temp double))
+			    '((oslo 1 3.5) (rome 1 18) (oslo 2 4.5) (rome 2 20) (lima 1 25))))
+(check (equal (length weather) 5))
+(check (equal (make-table (table-columns weather) (table-rows weather)) weather))
+(check (equal (table-rows (table-where weather 'temp '> 10)) '((rome 1 18) (rome 2 20) (lima 1 25))))
+(check (equal (table-where weather 'city '= 'oslo) (table-filter weather (lambda (c) (eq c 'oslo)) 'city)))
+(check (equal (table-rows (table-select (table-sort weather '(temp descending)) 'city))
+	      '((lima) (rome) (rome) (oslo) (oslo))))
+(check (equal (table-rows (table-group-by weather 'city '(count) '(mean temp) '(max day)))
+	      '((lima 1 25 1) (oslo 2 4 2) (rome 2 19 2))))
+(defvar countries (make-table '((city symbol) (country string)) '((rome "Italy") (oslo "Norway"))))
+(check (equal (table-rows (table-select (table-join weather countries 'city) 'day 'country))
+	      '((1 "Norway") (1 "Italy") (2 "Norway") (2 "Italy"))))
+(check (equal (f64-sum (table-column weather 'temp)) 71))
+
+(check (equal (mapcar (lambda (x) (* x x)) '(1 2 3)) '(1 4 9)))
+(check (equal (mapcar + '(1 2 3) '(10 20)) '(11 22)))
+(check (equal (list (reduce + '(1 2 3 4)) (reduce * '(1 2 3 4) 10) (reduce + '())) '(10 240 0)))
+(check (equal (reduce (lambda (acc x) (+ acc (* x x))) '(1 2 3) 10) 24))
+(check (equal (reduce list '(1 2 3)) '((1 2) 3)))
+(check (equal (remove-if (lambda (x) (> x 2)) '(1 5 2 4 3)) '(1 2)))
+(check (equal (list (find '(b) '(a (b) c)) (find 'd '(a b))) '((b) nil)))
+(check (equal (assoc "two" '(("one" 1) ("two" 2))) '("two" 2)))
+(check (equal (list (nth 0 '(a b)) (nth 1 '(a b)) (nth 2 '(a b))) '(a b nil)))
+(check (equal (append '(1 2) '() '(3) '(4 5)) '(1 2 3 4 5)))
+(defvar shared '(3 4))
+(check (eq (append shared) shared))
+(check (equal (reverse '(1 2 3)) '(3 2 1)))
+(check (equal (mapcar list '(1 2) '(3 4)) '((1 3) (2 4))))
+
+(check (equal (into nil (take 5 (range))) '(0 1 2 3 4)))
+(check (equal (list (into nil (range 2 11 3)) (into nil (range 3 0 -1))) '((2 5 8) (3 2 1))))
+(check (equal (reduce + (lazy-map (lambda (x) (* x x)) (lazy-filter (lambda (x) (> x 2)) '(1 2 3 4)))) 25))
+(check (equal (into nil (take 3 (lazy-filter (lambda (x) (> x 1000)) (range)))) '(1001 1002 1003)))
+(defvar squares (lazy-map (lambda (x) (* x x)) (range 4)))
+(check (equal (into #(a) squares) #(a 0 1 4 9)))
+(check (equal (into (pvector) squares) (pvector 0 1 4 9)))
+(check (equal (into '(x) (take 2 squares)) '(x 0 1)))
+(check (equal (reduce + (take 100000 (range))) 4999950000))
+(check (equal (reduce (lambda (a b) (+ a b)) (take 2000 (lazy-map (lambda (x) (* 2 x)) (range)))) 3998000))
+
+;
+; generators: next runs the function until it yields
+;
+(defun count-from (i n) (if (< i n) (progn (yield i) (count-from (+ i 1) n)) nil))
+(defun counter (n) (make-generator (lambda () (count-from 0 n))))
+(setf gen (counter 2))
+(check (equal (next gen) 0))
+(check (equal (next gen) 1))
+(check (equal (next gen) nil))
+(check (equal (next gen 'done) 'done))
+(check (equal (into nil (counter 4)) '(0 1 2 3)))
+(check (equal (reduce + (take 3 (counter 1000))) 3))
+(defun letters () (make-generator (lambda () (yield 'a) (yield 'b))))
+(check (equal (into nil (make-generator (lambda () (let ((l (letters))) (yield (next l)) (yield 'mid) (yield (next l)))))) '(a mid b)))
+
+;
+; sort and stable-sort relink lists and sort vectors where they are
+;
+(check (equal (sort '(3 1 2) <) '(1 2 3)))
+(check (equal (sort '(3 1 2) >=) '(3 2 1)))
+(check (equal (sort nil <) nil))
+(check (equal (stable-sort '("pear" "apple" "fig") string<) '("apple" "fig" "pear")))
+(check (string< 'a 'b "c"))
+(check (equal (string> "a" "b") nil))
+(setf unsorted (vector 5 3 9 1))
+(sort unsorted <)
+(check (equal unsorted #(1 3 5 9)))
+(check (equal (sort (vector 1 2 3) (lambda (a b) (> a b))) #(3 2 1)))
+(check (equal (stable-sort '((b 2) (a 1) (c 1)) < (lambda (p) (nth 1 p))) '((a 1) (c 1) (b 2))))
+(check (equal (stable-sort '((b 2) (a 1) (c 1)) (lambda (x y) (> x y)) (lambda (p) (nth 1 p))) '((b 2) (a 1) (c 1))))
+(check (equal (nth 0 (sort (into nil (range 100000 0 -1)) <)) 1))
+
+;
+; strings are shared, and built up without copying them over and over
+;
+(check (equal (concatenate 'string "ab" "cd" 'ef "") "abcdef"))
+(check (equal (with-output-to-string (s) (write-string "x" s) (write-string "yz" s)) "xyz"))
+(defun join (l) (with-output-to-string (out) (mapcar (lambda (x) (write-string x out)) l)))
+(check (equal (join '("a" "b" "c")) "abc"))
+(setf stream (make-string-output-stream))
+(write-string "once" stream)
+(check (equal (get-output-stream-string stream) "once"))
+(check (equal (get-output-stream-string stream) ""))
+(check (equal (length (concatenate 'string "abc" "de")) 5))
+(check (equal (eq (make-string-output-stream) (make-string-output-stream)) nil))
+(check (eq stream stream))
+(defvar by-stream (make-hash-table 'eq))
+(defvar other-stream (make-string-output-stream))
+(puthash stream 1 by-stream)
+(puthash other-stream 2 by-stream)
+(check (equal (list (gethash stream by-stream) (gethash other-stream by-stream)) '(1 2)))
+
+;
+; format runs a control string compiled once into directives
+;
+(check (equal (format nil "~a-~d" "x" 3) "x-3"))
+(check (equal (format nil "~s ~a" "q" '(1 2)) "\"q\" (1 2)"))
+(check (equal (format nil "~,2f|~5d|~3a|~~" 3.14159 42 'ab) "3.14|   42|ab |~"))
+(check (equal (format nil "~f ~F" 2.5 1000000) "2.5 1000000.0"))
+(check (equal (format nil "~{<~a>~}~%" '(a b c)) "<a><b><c>
+"))
+(defun pair (k v) (format nil "~a=~d" k v))
+(check (equal (mapcar (lambda (n) (pair 'n n)) '(1 2 3)) '("n=1" "n=2" "n=3")))
+(check (equal (with-output-to-string (s) (format s "~d," 1) (format s "~d" 2)) "1,2"))
+; the two control strings share a slot in format's cache
+(check (equal (format nil "outer ~a" (format nil "inner 66 ~a" 1)) "outer inner 66 1"))
+
+;
+; regexes are compiled to DFAs and matched leftmost-longest
+;
+(check (equal (regex-match "[0-9]+" "123") t))
+(check (equal (regex-match "[0-9]+" "123a") nil))
+(check (equal (regex-search "[0-9]+" "abc 123 45") "123"))
+(check (equal (regex-search "abcd|c" "xabcd") "abcd"))
+(check (equal (regex-search "a*b" "aaaac") nil))
+(check (equal (regex-search "^ERROR.*" "ok
+ERROR: bad") "ERROR: bad"))
+(check (equal (regex-split "\\s*,\\s*" "a , b,c,,d") '("a" "b" "c" "" "d")))
+(check (equal (regex-split "a*" "baaac") '("b" "c")))
+(setf mail (regex-compile "[a-z]+@[a-z]+\\.com"))
+(check (equal (regex-search mail "to bob@example.com now") "bob@example.com"))
+(check (equal (mail "x@y.org") nil))
+(check (equal (list (eq mail mail) (eq mail (regex-compile "[a-z]+@[a-z]+\\.com"))) '(t nil)))
+(check (equal (regex-search "GET /index[^ ]*" "x GET /index.html HTTP") "GET /index.html"))
+(check (equal (regex-search "status=\"[a-z]+\"" "a status=ok status=\"ok\"") "status=\"ok\""))
+(check (equal (regex-split "[/\"]" "a/b\"c") '("a" "b" "c")))
+
 ;
 ; messy result display
 ;